@@ -0,0 +1,97 @@
+#ifndef __KOMP_ASMGEN__
+#define __KOMP_ASMGEN__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+
+
+//
+// x86-64 assembly generation
+//
+// AssemblyGenerator translates quads to System V x86-64 assembly in
+// GNU as Intel syntax. Every variable and temporary gets a slot in
+// its function's stack frame; quads load their operands into rax/rcx
+// or xmm0/xmm1, compute, and store the result back.
+//
+// Frame layout, relative to rbp:
+//
+//     +16 ...      Arguments that didn't fit in registers
+//      -8          Static link (rbp of the enclosing function)
+//     -16          Where to copy an array result
+//     ...          Parameters, then locals and temporaries
+//
+// Addresses are word addresses, just like in the virtual machine:
+// iaddr shifts the byte address right by three and loads and stores
+// scale it back up.
+//
+// Calling convention: integer and array arguments go in rdi, rsi,
+// rdx, rcx, r8 and r9, reals in xmm0 to xmm7, the static link in r10
+// and, for functions returning arrays, the result address in rdi
+// ahead of the other arguments. Arrays are passed as pointers and
+// copied by the callee. Extra arguments stay on the stack where the
+// param quads pushed them, one 16-byte cell each so that the stack
+// is always aligned at calls.
+//
+
+class AsmFunction
+{
+public:
+    FunctionInformation                    *info;
+    AsmFunction                            *parent;
+    int                                     level;
+    std::string                             label;
+
+    long                                    frameSize;
+    long                                    parameterEnd;
+    std::map<VariableInformation *, long>   offsets;
+    std::vector<VariableInformation *>      parameters;
+    std::vector<long>                       pointers;
+
+    AsmFunction(FunctionInformation *i, AsmFunction *p) :
+        info(i),
+        parent(p),
+        level(p ? p->level + 1 : 0),
+        frameSize(16),
+        parameterEnd(16) {};
+};
+
+
+class AssemblyGenerator
+{
+    std::map<FunctionInformation *, AsmFunction *>  functions;
+    std::vector<AsmFunction *>                       order;
+    std::ostream&                                    o;
+    int                                              pending;
+
+    AsmFunction    *Function(FunctionInformation *);
+    AsmFunction    *Owner(AsmFunction *, VariableInformation *, int&);
+    long            Slot(AsmFunction *, VariableInformation *);
+    void            Layout(AsmFunction *);
+
+    std::string     Frame(AsmFunction *, VariableInformation *);
+    void            Load(AsmFunction *, VariableInformation *, const char *);
+    void            Store(AsmFunction *, const char *, VariableInformation *);
+    void            LoadReal(AsmFunction *, VariableInformation *, const char *);
+    void            StoreReal(AsmFunction *, const char *, VariableInformation *);
+    void            Address(AsmFunction *, VariableInformation *, const char *);
+    void            StaticLink(AsmFunction *, AsmFunction *);
+
+    void            Prologue(AsmFunction *);
+    void            Call(AsmFunction *, Quad *);
+    void            Generate(AsmFunction *);
+
+public:
+    AssemblyGenerator(std::ostream& out) :
+        o(out),
+        pending(0) {};
+    ~AssemblyGenerator();
+
+    void Generate(FunctionInformation *);
+};
+
+
+#endif
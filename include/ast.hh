@@ -1,6 +1,9 @@
 #ifndef __KOMP_AST__
 #define __KOMP_AST__
 
+#include <cstddef>
+#include <vector>
+
 #include <symtab.hh>
 #include <codegen.hh>
 
@@ -41,10 +44,105 @@ class Equal;                    // X
 class NotEqual;                 // X
 class BooleanConstant;          // X
 
+//
+// Node kinds. Every concrete node class sets its kind when it is
+// created, and the nodes of a FlatAST carry the same kinds, so code
+// that walks either form can switch on the kind instead of calling a
+// virtual method. ElseIfList and ExpressionList only occur in the
+// parse tree; flattening folds them into their if statement and
+// function call.
+//
+
 typedef enum
 {
+    kStatementList,
+    kElseIfList,
+    kIfStatement,
+    kAssignment,
+    kCallStatement,
+    kReturnStatement,
+    kWhileStatement,
+    kExpressionList,
+    kFunctionCall,
+    kIntegerToReal,
+    kTruncateReal,
+    kIntegerConstant,
+    kRealConstant,
+    kPlus,
+    kMinus,
+    kTimes,
+    kDivide,
+    kPower,
+    kUnaryMinus,
+    kArrayReference,
+    kIdentifier,
+    kLessThan,
+    kGreaterThan,
+    kGreaterThanOrEqual,
+    kLessThanOrEqual,
+    kEqual,
+    kNotEqual,
+    kAnd,
+    kOr,
+    kNot,
+    kBooleanConstant
 } ASTNodeType;
 
+const char *ASTNodeName(ASTNodeType);
+
+
+//
+// AST nodes are allocated from an arena instead of one by one on the
+// heap. ASTArena hands out memory from large blocks by bumping a
+// pointer, and Release frees every node in one step. The parser
+// releases the arena once it has generated code for a function and
+// printed it, so nothing may hold on to AST nodes past that point.
+//
+// The arena keeps a count of nodes and bytes for every kind of node,
+// which Report prints. Nodes are counted by the constructors of the
+// concrete node classes, which know their kind and size.
+//
+
+#define AST_ARENA_BLOCK_SIZE    65536
+
+class ASTArena
+{
+    class ASTKindCount
+    {
+    public:
+        unsigned long   nodes;
+        unsigned long   bytes;
+
+        ASTKindCount() :
+            nodes(0),
+            bytes(0) {};
+    };
+
+    std::vector<char *>                             blocks;
+    char                                           *next;
+    char                                           *limit;
+    unsigned long                                   used;
+    unsigned long                                   peak;
+    unsigned long                                   releases;
+    ASTKindCount                                    kinds[kBooleanConstant + 1];
+
+public:
+    ASTArena() :
+        next(NULL),
+        limit(NULL),
+        used(0),
+        peak(0),
+        releases(0) {};
+    ~ASTArena();
+
+    void *Allocate(size_t);
+    void  Count(ASTNodeType, size_t);
+    void  Release(void);
+    void  Report(std::ostream&);
+};
+
+extern ASTArena astArena;
+
 
 class ASTNode
 {
@@ -59,12 +157,16 @@ protected:
     void endChild(std::ostream& o);
     void lastChild(std::ostream& o);
     virtual void print(std::ostream& o);
-    virtual void xprint(std::ostream& o, char* cls);
+    virtual void xprint(std::ostream& o, const char* cls);
+    void Made(ASTNodeType k, size_t size)
+        { kind = k; astArena.Count(k, size); };
 
 public:
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
-    virtual VariableInformation *GenerateCodeAndJump(QuadsList &q,
-                                                     long label);
+    unsigned char   kind;       // ASTNodeType
+
+    static void *operator new(size_t size) { return astArena.Allocate(size); };
+    static void  operator delete(void *) {};
+
 
     friend std::ostream& operator<<(std::ostream&, ASTNode&);
     friend std::ostream& operator<<(std::ostream&, ASTNode*);
@@ -84,17 +186,13 @@ public:
 
     StatementList(StatementList *l, Statement *s) :
         statement(s),
-        precedingStatements(l) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        precedingStatements(l) { Made(kStatementList, sizeof(*this)); };
 };
 
 class Statement :  public ASTNode
 {
 protected:
     virtual void print(std::ostream& o);
-public:
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class ElseIfList  :  public ASTNode
@@ -110,11 +208,7 @@ public:
     ElseIfList(ElseIfList *p, Condition *c, StatementList *b) :
         preceding(p),
         condition(c),
-        body (b) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
-    virtual VariableInformation *GenerateCodeAndJump(QuadsList& q,
-                                                     long lbl);
+        body (b) { Made(kElseIfList, sizeof(*this)); };
 };
 
 class IfStatement :  public Statement
@@ -135,9 +229,7 @@ public:
         condition(c),
         thenStatements(ts),
         elseIfList(eif),
-        elseStatements(es) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        elseStatements(es) { Made(kIfStatement, sizeof(*this)); };
 };
 
 class Assignment :  public Statement
@@ -151,9 +243,7 @@ public:
 
     Assignment(LeftValue *l, Expression *r) :
         target(l),
-        value(r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        value(r) { Made(kAssignment, sizeof(*this)); };
 };
 
 class CallStatement :  public Statement
@@ -165,9 +255,7 @@ public:
     FunctionCall        *call;
 
     CallStatement(FunctionCall *c) :
-        call(c) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        call(c) { Made(kCallStatement, sizeof(*this)); };
 };
 
 class ReturnStatement :  public Statement
@@ -179,11 +267,9 @@ public:
     Expression          *value;
 
     ReturnStatement() :
-        value(NULL) {};
+        value(NULL) { Made(kReturnStatement, sizeof(*this)); };
     ReturnStatement(Expression *e) :
-        value(e) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        value(e) { Made(kReturnStatement, sizeof(*this)); };
 };
 
 class WhileStatement :  public Statement
@@ -197,9 +283,7 @@ public:
 
     WhileStatement(Condition *c, StatementList *b) :
         condition(c),
-        body(b) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        body(b) { Made(kWhileStatement, sizeof(*this)); };
 };
 
 
@@ -213,8 +297,6 @@ public:
 
     Expression(TypeInformation *t) :
         valueType(t) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class ExpressionList :  public ASTNode
@@ -229,11 +311,7 @@ public:
     ExpressionList(ExpressionList *pe,
                    Expression *e) :
         precedingExpressions(pe),
-        expression(e) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
-    virtual void GenerateParameterList(QuadsList &q,
-                                       VariableInformation *firstParam);
+        expression(e) { Made(kExpressionList, sizeof(*this)); };
 };
 
 class FunctionCall :  public Expression
@@ -249,9 +327,7 @@ public:
                  ExpressionList *a) :
         Expression(f->GetReturnType()),
         function(f),
-        arguments(a) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        arguments(a) { Made(kFunctionCall, sizeof(*this)); };
 };
 
 class IntegerToReal :  public Expression
@@ -264,9 +340,7 @@ public:
 
     IntegerToReal(Expression *e) :
         Expression(kRealType),
-        value(e) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        value(e) { Made(kIntegerToReal, sizeof(*this)); };
 };
 
 class TruncateReal :  public Expression
@@ -279,9 +353,7 @@ public:
 
     TruncateReal(Expression *e) :
         Expression(kIntegerType),
-        value(e) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        value(e) { Made(kTruncateReal, sizeof(*this)); };
 };
 
 class IntegerConstant :  public Expression
@@ -294,9 +366,7 @@ public:
 
     IntegerConstant(long int v) :
       Expression(kIntegerType),
-      value(v) {}
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+      value(v) { Made(kIntegerConstant, sizeof(*this)); };
 };
 
 class RealConstant :  public Expression
@@ -309,16 +379,14 @@ public:
 
     RealConstant(double v) :
         Expression(kRealType),
-        value(v) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        value(v) { Made(kRealConstant, sizeof(*this)); };
 };
 
 class BinaryOperation :  public Expression
 {
 protected:
     virtual void print(std::ostream& o);
-    virtual void xprint(std::ostream& o, char *);
+    virtual void xprint(std::ostream& o, const char *);
 
 public:
     Expression          *left, *right;
@@ -327,8 +395,6 @@ public:
         Expression(l->valueType),
         left(l),
         right(r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class Plus :  public BinaryOperation
@@ -338,9 +404,7 @@ protected:
 
 public:
     Plus(Expression *l, Expression *r) :
-        BinaryOperation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryOperation(l, r) { Made(kPlus, sizeof(*this)); };
 };
 
 
@@ -351,9 +415,7 @@ protected:
 
 public:
     Minus(Expression *l, Expression *r) :
-        BinaryOperation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryOperation(l, r) { Made(kMinus, sizeof(*this)); };
 };
 
 
@@ -364,9 +426,7 @@ protected:
 
 public:
     Times(Expression *l, Expression *r) :
-        BinaryOperation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryOperation(l, r) { Made(kTimes, sizeof(*this)); };
 };
 
 
@@ -377,9 +437,7 @@ protected:
 
 public:
     Divide(Expression *l, Expression *r) :
-        BinaryOperation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryOperation(l, r) { Made(kDivide, sizeof(*this)); };
 };
 
 
@@ -390,9 +448,7 @@ protected:
 
 public:
     Power(Expression *l, Expression *r) :
-        BinaryOperation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryOperation(l, r) { Made(kPower, sizeof(*this)); };
 };
 
 
@@ -406,9 +462,7 @@ public:
 
     UnaryMinus(Expression *e) :
         Expression(e->valueType),
-        right(e) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        right(e) { Made(kUnaryMinus, sizeof(*this)); };
 };
 
 
@@ -421,10 +475,6 @@ protected:
 public:
     LeftValue(TypeInformation *t) :
         Expression(t) {};
-
-    virtual void GenerateAssignment(QuadsList& q,
-                                    VariableInformation *val) = 0;
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class ArrayReference :  public LeftValue
@@ -440,11 +490,7 @@ public:
                    Expression *x) :
         LeftValue(i->type->elementType),
         id(i),
-        index(x) {};
-
-    virtual void GenerateAssignment(QuadsList& q,
-                                    VariableInformation *val);
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        index(x) { Made(kArrayReference, sizeof(*this)); };
 };
 
 
@@ -458,11 +504,7 @@ public:
 
     Identifier(VariableInformation *i) :
         LeftValue(i->type),
-        id(i) {};
-
-    virtual void GenerateAssignment(QuadsList& q,
-                                    VariableInformation *val);
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        id(i) { Made(kIdentifier, sizeof(*this)); };
 };
 
 
@@ -472,15 +514,13 @@ class Condition :  public ASTNode
 protected:
     virtual void print(std::ostream& o);
 
-public:
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class BinaryRelation :  public Condition
 {
 protected:
     virtual void print(std::ostream& o);
-    virtual void xprint(std::ostream& o, char *cls);
+    virtual void xprint(std::ostream& o, const char *cls);
 
 public:
     Expression      *left;
@@ -489,7 +529,6 @@ public:
     BinaryRelation(Expression *l, Expression *r) :
         left(l),
         right(r) {};
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class LessThan :  public BinaryRelation
@@ -498,9 +537,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     LessThan(Expression *l, Expression *r) :
-        BinaryRelation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryRelation(l, r) { Made(kLessThan, sizeof(*this)); };
 };
 
 class GreaterThan :  public BinaryRelation
@@ -509,9 +546,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     GreaterThan(Expression *l, Expression *r) :
-        BinaryRelation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryRelation(l, r) { Made(kGreaterThan, sizeof(*this)); };
 };
 
 class GreaterThanOrEqual :  public BinaryRelation
@@ -520,9 +555,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     GreaterThanOrEqual(Expression *l, Expression *r) :
-        BinaryRelation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryRelation(l, r) { Made(kGreaterThanOrEqual, sizeof(*this)); };
 };
 
 class LessThanOrEqual :  public BinaryRelation
@@ -531,9 +564,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     LessThanOrEqual(Expression *l, Expression *r) :
-        BinaryRelation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryRelation(l, r) { Made(kLessThanOrEqual, sizeof(*this)); };
 };
 
 class Equal :  public BinaryRelation
@@ -542,9 +573,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     Equal(Expression *l, Expression *r) :
-        BinaryRelation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryRelation(l, r) { Made(kEqual, sizeof(*this)); };
 };
 
 class NotEqual :  public BinaryRelation
@@ -553,9 +582,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     NotEqual(Expression *l, Expression *r) :
-        BinaryRelation(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryRelation(l, r) { Made(kNotEqual, sizeof(*this)); };
 };
 
 
@@ -563,7 +590,7 @@ class BinaryCondition : public Condition
 {
 protected:
     virtual void print(std::ostream& o);
-    virtual void xprint(std::ostream&o, char *cls);
+    virtual void xprint(std::ostream&o, const char *cls);
 
 public:
     Condition *left, *right;
@@ -571,8 +598,6 @@ public:
     BinaryCondition(Condition *l, Condition *r) :
         left(l),
         right(r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q) = 0;
 };
 
 class And : public BinaryCondition
@@ -581,9 +606,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     And(Condition *l, Condition *r) :
-        BinaryCondition(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryCondition(l, r) { Made(kAnd, sizeof(*this)); };
 };
 
 class Or : public BinaryCondition
@@ -592,9 +615,7 @@ protected:
     virtual void print(std::ostream& o);
 public:
     Or(Condition *l, Condition *r) :
-        BinaryCondition(l, r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        BinaryCondition(l, r) { Made(kOr, sizeof(*this)); };
 };
 
 class Not : public Condition
@@ -605,9 +626,7 @@ public:
     Condition *right;
 
     Not(Condition *r) :
-        right(r) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
+        right(r) { Made(kNot, sizeof(*this)); };
 };
 
 class BooleanConstant : public Condition
@@ -618,9 +637,107 @@ public:
     bool         value;
 
     BooleanConstant(int v) :
-        value(v?true:false) {};
-
-    virtual VariableInformation *GenerateCode(QuadsList &q);
-};
+        value(v?true:false) { Made(kBooleanConstant, sizeof(*this)); };
+};
+
+
+
+//
+// Flat ASTs
+//
+// Code is not generated from the parse tree directly. Once a function
+// has been parsed, its body is flattened into a FlatAST: all nodes in
+// one array, each with a one-byte kind and up to three 32-bit child
+// indices. Statement lists, the branches of an if statement and the
+// arguments of a call are ranges of node indices in a separate list
+// array, in source order. Children are always stored before their
+// parents, and code generation and printing switch on the kind.
+//
+// What a, b and c hold depends on the kind:
+//
+//   kStatementList     a = first list entry, b = number of statements
+//   kIfStatement       a = first list entry, b = number of branches,
+//                      c = else statements; the list entries are
+//                      condition and body pairs, then-branch first
+//   kAssignment        a = target, b = value
+//   kCallStatement     a = function call
+//   kReturnStatement   a = value
+//   kWhileStatement    a = condition, b = body
+//   kFunctionCall      a = first list entry, b = number of arguments
+//   kArrayReference    a = index
+//   unary kinds        a = operand
+//   binary kinds       a = left, b = right
+//
+// Functions, variables and constants are kept in value. Missing
+// children are FLAT_NONE.
+//
+// Fold, in fold.cc, rewrites the expressions of a FlatAST in place
+// before code is generated from it. A node that is folded becomes a
+// constant or a copy of one of its operands; the nodes it used to
+// refer to stay in the array but are no longer reachable.
+//
+
+#define FLAT_NONE       0xFFFFFFFFU
+#define NO_LABEL        0L          // Fall through instead of jumping
+
+class FlatNode
+{
+public:
+    unsigned char            kind;      // ASTNodeType
+    unsigned int             a, b, c;
+    TypeInformation         *type;      // Value type of expressions
+    union
+    {
+        long                 integer;
+        double               real;
+        VariableInformation *variable;
+        FunctionInformation *function;
+    }                        value;
+};
+
+class FlatAST
+{
+    std::vector<FlatNode>        nodes;
+    std::vector<unsigned int>    lists;
+    unsigned int                 root;
+
+    unsigned int         Add(ASTNodeType, TypeInformation *,
+                             unsigned int, unsigned int, unsigned int);
+    unsigned int         AddList(const std::vector<unsigned int>&);
+    unsigned int         Flatten(ASTNode *);
+
+    static unsigned long constantsFolded;
+    static unsigned long identitiesApplied;
+    static unsigned long nodesRemoved;
+
+    void                 MakeInteger(unsigned int, long);
+    void                 MakeReal(unsigned int, double);
+    void                 MakeBoolean(unsigned int, bool);
+    bool                 FoldConstant(unsigned int);
+    unsigned int         Simplify(unsigned int, const std::vector<char>&);
+
+    VariableInformation *GenerateCode(QuadsList&, unsigned int);
+    VariableInformation *GenerateBinary(QuadsList&, unsigned int,
+                                        tQuadType, tQuadType,
+                                        TypeInformation *);
+    void                 GenerateCondition(QuadsList&, unsigned int,
+                                           long, long);
+    void                 GenerateAssignment(QuadsList&, unsigned int,
+                                            VariableInformation *);
+
+    void                 print(std::ostream&, unsigned int, int);
+
+public:
+    FlatAST(StatementList *);
+
+    void                 Fold(void);
+    void                 GenerateCode(QuadsList&);
+    static void          Report(std::ostream&);
+    unsigned long        Size(void) { return nodes.size(); };
+
+    friend std::ostream& operator<<(std::ostream&, FlatAST*);
+};
+
+std::ostream& operator<<(std::ostream&, FlatAST*);
 
 #endif
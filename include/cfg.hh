@@ -0,0 +1,147 @@
+#ifndef __KOMP_CFG__
+#define __KOMP_CFG__
+
+#include <iostream>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+
+
+//
+// Control-flow graphs
+//
+// A ControlFlowGraph splits the quads of one function into basic
+// blocks and finds the edges between them, the dominators of every
+// block and the natural loops. The graph refers to quads by their
+// index in the QuadsList and doesn't follow changes to the list: a
+// pass that adds, removes or moves quads has to build a new graph
+// before it looks at the blocks again. Quads added since the graph
+// was built belong to no block.
+//
+
+/*
+ * BasicBlock is a run of quads that is only ever entered at the top
+ * and left at the bottom. first and last are the indices of its first
+ * and last quad. Blocks are numbered in the order their quads appear
+ * in the list, so block 0 is the entry and falling out of block n
+ * goes to block n + 1. A block with no successors leaves the
+ * function.
+ *
+ * dominator is the immediate dominator of the block, or -1 for the
+ * entry and for blocks that can't be reached. The dominance frontier
+ * holds the blocks where what this block dominates ends: blocks it
+ * doesn't strictly dominate that have a predecessor it does dominate.
+ * loop is the innermost natural loop the block belongs to, or -1.
+ */
+
+class BasicBlock
+{
+public:
+    long                 first;
+    long                 last;
+    long                 size;          // Number of quads
+    std::vector<int>     successors;
+    std::vector<int>     predecessors;
+    int                  dominator;
+    std::vector<int>     dominates;     // Children in the dominator tree
+    std::vector<int>     frontier;      // Dominance frontier
+    int                  loop;
+    int                  loopDepth;
+
+    BasicBlock(long f) :
+        first(f),
+        last(f),
+        size(0),
+        dominator(-1),
+        loop(-1),
+        loopDepth(0) {};
+};
+
+/*
+ * Loop is a natural loop: a header that dominates every block in the
+ * loop, and the blocks that reach one of the latches, the blocks with
+ * a back edge to the header, without passing through the header.
+ * Loops with the same header are merged. parent is the loop this one
+ * is nested in, or -1, and depth is 1 for an outermost loop.
+ */
+
+class Loop
+{
+public:
+    int                  header;
+    std::vector<int>     latches;
+    std::vector<int>     blocks;        // Sorted, header included
+    int                  parent;
+    int                  depth;
+
+    Loop(int h) :
+        header(h),
+        parent(-1),
+        depth(1) {};
+};
+
+
+class ControlFlowGraph
+{
+    FunctionInformation             *function;
+    QuadsList                       *quads;
+    std::vector<BasicBlock>          blocks;
+    std::vector<Loop>                loops;
+    std::vector<int>                 blockOf;       // Quad index to block
+    std::vector<int>                 order;         // Reverse postorder
+    std::vector<int>                 orderOf;       // Block to order, or -1
+    std::vector<int>                 treeEnter;     // Dominator tree preorder
+    std::vector<int>                 treeLeave;     // and postorder numbers
+    long                             edges;
+
+    class Summary
+    {
+    public:
+        FunctionInformation *function;
+        int                  blocks;
+        long                 edges;
+        int                  loops;
+        int                  depth;
+    };
+
+    static std::vector<Summary>      summaries;
+
+    void        FindBlocks(void);
+    void        AddEdge(int, int);
+    void        FindEdges(void);
+    void        Order(void);
+    int         Intersect(int, int);
+    void        FindDominators(void);
+    void        NumberDominatorTree(void);
+    void        FindLoops(void);
+
+public:
+    ControlFlowGraph(FunctionInformation *);
+
+    FunctionInformation *Function(void) { return function; };
+    QuadsList           *Quads(void) { return quads; };
+
+    int         Blocks(void) { return blocks.size(); };
+    BasicBlock& Block(int b) { return blocks[b]; };
+    int         BlockOf(long i) {
+        return i < (long)blockOf.size() ? blockOf[i] : -1; };
+    long        Edges(void) { return edges; };
+
+    int         Loops(void) { return loops.size(); };
+    Loop&       LoopAt(int l) { return loops[l]; };
+    int         LoopDepth(void);
+
+    const std::vector<int>& ReversePostorder(void) { return order; };
+    bool        Reachable(int b) { return orderOf[b] >= 0; };
+    bool        Dominates(int, int);
+    bool        InLoop(int, int);
+
+    void        PrintDot(std::ostream&);
+    void        Record(void);
+
+    static void Report(std::ostream&);
+};
+
+
+#endif
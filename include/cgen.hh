@@ -0,0 +1,74 @@
+#ifndef __KOMP_CGEN__
+#define __KOMP_CGEN__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+
+
+//
+// C source generation
+//
+// CGenerator translates the quads of a whole program to a single C11
+// translation unit that only needs the standard library and libm.
+//
+// Every function is lifted to the top level. Its parameters and local
+// variables live in a frame struct that starts with a pointer to the
+// enclosing function's frame, and a pointer to the caller's or an
+// outer frame is passed as the first argument, so nested functions
+// reach non-local variables through these environment pointers.
+// Temporaries become ordinary C locals and quad labels become goto
+// targets.
+//
+// Addresses are word addresses, as everywhere else: arrays are arrays
+// of komp_word, iaddr divides a pointer by the size of a word, and
+// loads and stores multiply it back.
+//
+
+class CFunction
+{
+public:
+    FunctionInformation                    *info;
+    CFunction                              *parent;
+    std::string                             name;
+    std::vector<VariableInformation *>      parameters;
+    std::vector<VariableInformation *>      locals;
+    std::set<VariableInformation *>         members;
+
+    CFunction(FunctionInformation *i, CFunction *p) :
+        info(i),
+        parent(p) {};
+};
+
+
+class CGenerator
+{
+    std::map<FunctionInformation *, CFunction *>    functions;
+    std::vector<CFunction *>                         order;
+    std::ostream&                                    o;
+
+    CFunction      *Function(FunctionInformation *);
+    CFunction      *Owner(CFunction *, VariableInformation *, int&);
+
+    std::string     Name(VariableInformation *);
+    std::string     Declare(VariableInformation *, const std::string&);
+    std::string     Ref(CFunction *, VariableInformation *);
+    std::string     Link(CFunction *, CFunction *);
+    std::string     Prototype(CFunction *);
+
+    void            Generate(CFunction *);
+
+public:
+    CGenerator(std::ostream& out) :
+        o(out) {};
+    ~CGenerator();
+
+    void Generate(FunctionInformation *);
+};
+
+
+#endif
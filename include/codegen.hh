@@ -1,6 +1,10 @@
 #ifndef __KOMP_CODEGEN__
 #define __KOMP_CODEGEN__
 
+#include <iostream>
+#include <map>
+#include <vector>
+
 
 //
 // Quad types
@@ -33,6 +37,12 @@ typedef enum
     rmul,       // Multiply a by b giving real r   : rmul <a> <b> <r>
     rdiv,       // Divide a by b giving real r     : rdiv <a> <b> <r>
     rpow,       // Raise x to y (reals)            : rpow <x> <y> <r>
+    ineg,       // Negate integer a giving int r   : ineg <a>  -  <r>
+    rneg,       // Negate real a giving real r     : rneg <a>  -  <r>
+    ishl,       // Shift a left n bits giving r    : ishl  <a> <n> <r>
+    isar,       // Shift a right n bits, keep sign : isar  <a> <n> <r>
+    ishr,       // Shift a right n bits, zero fill : ishr  <a> <n> <r>
+    imulh,      // High word of signed a * c       : imulh <a> <c> <r>
 
     // Comparisons
 
@@ -42,6 +52,12 @@ typedef enum
     rgt,        // If a > b, then r = 1, else r = 0: rgt <a> <b> <r>
     rlt,        // If a < b, then r = 1, else r = 0: rlt <a> <b> <r>
     req,        // If a = b, then r = 1, else r = 0: req <a> <b> <r>
+    ile,        // If a <= b, then r = 1, else r = 0: ile <a> <b> <r>
+    ige,        // If a >= b, then r = 1, else r = 0: ige <a> <b> <r>
+    ine,        // If a <> b, then r = 1, else r = 0: ine <a> <b> <r>
+    rle,        // If a <= b, then r = 1, else r = 0: rle <a> <b> <r>
+    rge,        // If a >= b, then r = 1, else r = 0: rge <a> <b> <r>
+    rne,        // If a <> b, then r = 1, else r = 0: rne <a> <b> <r>
 
     // Conjunctions
 
@@ -106,87 +122,235 @@ public:
     double             real3;
 
 
+    Quad(void) :
+        opcode(nop),
+        sym1(NULL),
+        sym2(NULL),
+        sym3(NULL),
+        int1(0),
+        int2(0),
+        int3(0),
+        real1(0.0),
+        real2(0.0),
+        real3(0.0)
+        {};
+
     Quad(tQuadType o,
          SymbolInformation *a, SymbolInformation *b, SymbolInformation *c) :
         opcode(o),
         sym1(a),
         sym2(b),
-        sym3(c)
+        sym3(c),
+        int1(0),
+        int2(0),
+        int3(0),
+        real1(0.0),
+        real2(0.0),
+        real3(0.0)
         {};
 
     Quad(tQuadType o, long a, SymbolInformation* b, SymbolInformation* c) :
         opcode(o),
+        sym1(NULL),
         sym2(b),
         sym3(c),
-        int1(a)
+        int1(a),
+        int2(0),
+        int3(0),
+        real1(0.0),
+        real2(0.0),
+        real3(0.0)
         {};
 
     Quad(tQuadType o, SymbolInformation *a, long b, SymbolInformation *c) :
         opcode(o),
         sym1(a),
+        sym2(NULL),
         sym3(c),
-        int2(b)
+        int1(0),
+        int2(b),
+        int3(0),
+        real1(0.0),
+        real2(0.0),
+        real3(0.0)
         {};
 
 
     Quad(tQuadType o,
          double a, SymbolInformation *b, SymbolInformation *c) :
         opcode(o),
+        sym1(NULL),
         sym2(b),
         sym3(c),
-        real1(a)
+        int1(0),
+        int2(0),
+        int3(0),
+        real1(a),
+        real2(0.0),
+        real3(0.0)
         {};
 
+    VariableInformation *Definition(void);
+    int                  Uses(VariableInformation **);
+    bool                 Pure(void);
+
     friend std::ostream& operator<<(std::ostream&, Quad*);
     friend std::ostream& operator<<(std::ostream&, Quad&);
 };
 
 
+//
+// Packed quads
+//
+// Quads are stored in a QuadsList in a packed form: a one-byte opcode
+// and three 32-bit operands. Each operand has a tag in its top three
+// bits saying what kind of operand it is, and an index below that
+// into one of the QuadsList's operand tables. Quad above is the
+// unpacked form that code generation builds and that passes read.
+//
+
+typedef enum
+{
+    qnone,      // No operand
+    qsymbol,    // Index into the symbol table
+    qinteger,   // Index into the integer constant table
+    qreal,      // Index into the real constant table
+    qlabel,     // Index into the label table
+    qtemporary  // Number of a temporary of the function
+} tOperandTag;
+
+#define QUAD_TAG_SHIFT      29
+#define QUAD_INDEX_MASK     ((1U << QUAD_TAG_SHIFT) - 1)
+
+class PackedQuad
+{
+public:
+    unsigned char    opcode;
+    unsigned int     operands[3];
+
+    tOperandTag  Tag(int n)   { return (tOperandTag)(operands[n] >> QUAD_TAG_SHIFT); };
+    unsigned int Index(int n) { return operands[n] & QUAD_INDEX_MASK; };
+};
+
+
 class QuadsListIterator;
 
+/*
+ * QuadsList holds the quads of one function. The quads themselves are
+ * stored packed in a single growing array, so a quad's index never
+ * changes once it has been added. Program order is kept separately as
+ * a doubly linked list of indices, which makes appending, inserting,
+ * removing and moving a run of quads O(1) without copying anything.
+ * Quads that are removed stay in the array but are no longer linked.
+ *
+ * The symbols, constants and labels that quads refer to are kept in
+ * per-list tables, each entered once however many quads use it.
+ * Temporaries are not entered at all; their operands hold their
+ * number, which is looked up in the function that owns the list.
+ * Quads go in and come out unpacked; use Replace to change one.
+ * Limit is one more than the largest index a quad has ever had.
+ */
+
 class QuadsList
 {
-    class QuadsListElement
-    {
-    public:
-        Quad                *data;
-        QuadsListElement    *next;
-
-        QuadsListElement(Quad *d, QuadsListElement *n) :
-            data(d),
-            next(n) {};
-        ~QuadsListElement() { delete data; next = NULL; }
-    };
-
-    QuadsListElement        *head, *tail;
-    static long              labelCounter;
+    std::vector<PackedQuad>          quads;
+    std::vector<int>                 next;
+    std::vector<int>                 prev;
+    long                             head, tail;
+    long                             count;
+    static long                      labelCounter;
+    FunctionInformation             *function;
+
+    std::vector<SymbolInformation *> symbols;
+    std::vector<long>                integers;
+    std::vector<double>              reals;
+    std::vector<long>                labels;
+    std::map<std::pair<int, long>, unsigned int> entries;
+
+    void          Link(long, long, long);
+    void          Unlink(long, long);
+
+    unsigned int  Enter(tOperandTag, SymbolInformation *, long, double);
+    PackedQuad    Pack(const Quad&);
+    Quad          Unpack(const PackedQuad&);
+    void          Unpack(unsigned int, Quad&, int);
 
     std::ostream& print(std::ostream&);
 
 public:
-    QuadsList() :
-        head(NULL),
-        tail(NULL) {};
+    QuadsList(FunctionInformation *f) :
+        head(-1),
+        tail(-1),
+        count(0),
+        function(f) { quads.reserve(64); next.reserve(64); prev.reserve(64); };
 
-    QuadsList& operator+=(Quad *q);
+    QuadsList& operator+=(const Quad& q) { Append(q); return *this; };
     long       NextLabel(void) { return (labelCounter += 1); };
 
+    long       Append(const Quad&);
+    long       InsertAfter(long, const Quad&);
+    long       InsertBefore(long, const Quad&);
+    void       Replace(long, const Quad&);
+    void       Remove(long);
+    void       Move(long, long, long);
+
+    Quad       operator[](long i) { return Unpack(quads[i]); };
+    tQuadType  Opcode(long i) { return (tQuadType)quads[i].opcode; };
+    long       First(void) { return head; };
+    long       Last(void)  { return tail; };
+    long       Next(long i) { return next[i]; };
+    long       Previous(long i) { return prev[i]; };
+    long       Size(void) { return count; };
+    long       Limit(void) { return quads.size(); };
+    long       Bytes(void);
+
     friend class QuadsListIterator;
     friend std::ostream& operator<<(std::ostream&, QuadsList*);
     friend std::ostream& operator<<(std::ostream&, QuadsList&);
 };
 
+/*
+ * QuadsListIterator walks a QuadsList in either direction. Next and
+ * Previous return the quad at the current position (or NULL at the
+ * end) and then move forwards or backwards. Index returns the index
+ * of the quad that was returned last. The quad returned is unpacked
+ * into the iterator and is only valid until the iterator moves.
+ */
+
 class QuadsListIterator
 {
-    QuadsList::QuadsListElement     *elem;
+    QuadsList                       *list;
+    long                             current;
+    long                             last;
+    Quad                             quad;
 
 public:
     QuadsListIterator(QuadsList *ql) :
-        elem(ql->head) {};
+        list(ql),
+        current(ql ? ql->head : -1),
+        last(-1),
+        quad() {};
+
+    void  First(void) { current = list ? list->head : -1; };
+    void  Last(void)  { current = list ? list->tail : -1; };
+    long  Index(void) { return last; };
 
     Quad *Next(void) {
-        elem = elem ? elem->next : (QuadsList::QuadsListElement*)NULL;
-        return elem ? (Quad*)NULL : elem->data;
+        if (current < 0)
+            return NULL;
+        last = current;
+        current = list->next[current];
+        quad = list->Unpack(list->quads[last]);
+        return &quad;
+    };
+
+    Quad *Previous(void) {
+        if (current < 0)
+            return NULL;
+        last = current;
+        current = list->prev[current];
+        quad = list->Unpack(list->quads[last]);
+        return &quad;
     };
 };
 
@@ -0,0 +1,223 @@
+#ifndef __KOMP_DATAFLOW__
+#define __KOMP_DATAFLOW__
+
+#include <stdint.h>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cfg.hh>
+
+
+//
+// Dataflow analysis
+//
+// Analyses over the control-flow graph of a function work on sets of
+// variables or definitions, stored as dense bit sets. Variables are
+// numbered once per function by a VariableNumbering, so that every
+// analysis agrees on which bit is which variable. A DataflowAnalysis
+// computes the gen and kill sets of each block and the solver does
+// the rest with a worklist.
+//
+// Most temporaries are assigned and read in the same block and are
+// never live at a block boundary. The sets kept for each block only
+// have room for the global variables, which are numbered first; the
+// sets used while walking a block have room for all of them.
+//
+
+/*
+ * BitSet is a fixed-size set of small integers kept in 64-bit words.
+ * The operations on whole sets are simple loops over the words, which
+ * the compiler can vectorize. Test is false for anything past the end,
+ * Union takes a set that is no larger than this one, and Resize grows
+ * or truncates the set.
+ */
+
+class BitSet
+{
+    std::vector<uint64_t>    words;
+    size_t                   bits;
+
+public:
+    BitSet(size_t n = 0) :
+        words((n + 63) / 64, 0),
+        bits(n) {};
+
+    size_t  Size(void) const { return bits; };
+    bool    Test(size_t i) const {
+        return i < bits && ((words[i / 64] >> (i % 64)) & 1); };
+    void    Set(size_t i) { words[i / 64] |= (uint64_t)1 << (i % 64); };
+    void    Reset(size_t i) { words[i / 64] &= ~((uint64_t)1 << (i % 64)); };
+
+    void    Clear(void);
+    void    Fill(void);
+    void    Resize(size_t);
+    bool    Union(const BitSet&);
+    bool    Intersect(const BitSet&);
+    void    Subtract(const BitSet&);
+    bool    Transfer(const BitSet&, const BitSet&, const BitSet&);
+    bool    Empty(void) const;
+    size_t  Count(void) const;
+    long    Next(long) const;
+
+    bool    operator==(const BitSet& s) const { return words == s.words; };
+    bool    operator!=(const BitSet& s) const { return words != s.words; };
+};
+
+
+/*
+ * VariableNumbering gives every variable that the quads of a function
+ * use a number. The global variables come first: the temporaries that
+ * are read in a block without being assigned there first, in the
+ * order of the temporaries, then the parameters and declared
+ * variables of the function, then the variables of enclosing
+ * functions in the order they first appear. Only the last ones are
+ * not local. The other temporaries are numbered after the globals.
+ *
+ * Visible returns the variables that the function called by a call
+ * quad may read or change: all but the temporaries if it is nested in
+ * this function, only those of enclosing functions if it isn't, and
+ * none at all if it is built in.
+ */
+
+class VariableNumbering
+{
+    FunctionInformation                     *function;
+    std::map<VariableInformation *, int>     numbers;
+    std::vector<int>                         temporaries;   // Or -1
+    std::vector<VariableInformation *>       variables;
+    std::vector<char>                        local;
+    int                                      globals;
+    BitSet                                   named;
+    BitSet                                   outer;
+    BitSet                                   none;
+
+    void        Add(VariableInformation *);
+
+public:
+    VariableNumbering(ControlFlowGraph *);
+
+    int                  Size(void) { return variables.size(); };
+    int                  Globals(void) { return globals; };
+    int                  Number(VariableInformation *);
+    VariableInformation *Variable(int n) { return variables[n]; };
+    bool                 IsLocal(int n) { return local[n]; };
+    bool                 IsTemporary(int n) {
+        return variables[n]->temporary > 0; };
+    const BitSet&        Visible(Quad&);
+};
+
+
+/*
+ * DataflowAnalysis is the base of the analyses. A subclass fills in
+ * gen and kill for every block and the boundary set, which holds at
+ * the entry of a forward analysis and at the exits of a backward one,
+ * and then calls Solve. Paths are joined with union, or with
+ * intersection if meetAll is set; in that case every set starts full
+ * and shrinks.
+ *
+ * Solve puts every reachable block on the worklist in reverse
+ * postorder, or in postorder for a backward analysis, and applies
+ * out = gen | (in - kill) until nothing changes. Blocks that can't be
+ * reached are left with empty sets.
+ */
+
+class DataflowAnalysis
+{
+protected:
+    ControlFlowGraph        *graph;
+    bool                     backward;
+    bool                     meetAll;
+    std::vector<BitSet>      gen;
+    std::vector<BitSet>      kill;
+    std::vector<BitSet>      in;
+    std::vector<BitSet>      out;
+    BitSet                   boundary;
+
+    static unsigned long     solved;
+    static unsigned long     visits;
+    static unsigned long     words;
+
+    DataflowAnalysis(ControlFlowGraph *, bool, bool);
+
+    void        Allocate(size_t);
+    void        Solve(void);
+
+public:
+    virtual ~DataflowAnalysis() {};
+
+    const BitSet& In(int b) { return in[b]; };
+    const BitSet& Out(int b) { return out[b]; };
+
+    static void Report(std::ostream&);
+};
+
+
+/*
+ * Liveness finds the global variables whose values may still be read.
+ * A variable is live at the exit of the function if it belongs to an
+ * enclosing function, and a call reads every variable the function it
+ * calls can see. Step moves a live set backwards over one quad; a set
+ * with room for every variable also follows the other temporaries.
+ * Update finds liveness again after quads have been changed in place,
+ * without changing the blocks.
+ */
+
+class Liveness : public DataflowAnalysis
+{
+    VariableNumbering        numbering;
+
+public:
+    Liveness(ControlFlowGraph *);
+
+    VariableNumbering&  Numbering(void) { return numbering; };
+    void                Step(Quad&, BitSet&);
+    void                Update(void);
+};
+
+
+/*
+ * ReachingDefinitions finds the definitions that may reach each
+ * point. A definition is a quad that assigns a variable. A call is a
+ * definition too, of every variable the function it calls can see,
+ * but it never kills the definitions of those that come before it,
+ * and an assignment doesn't kill it either. Arrays are memory, so
+ * stores to them are not definitions.
+ *
+ * The definitions of global variables and the calls are numbered
+ * first, in the order the quads appear, and only they are kept in the
+ * sets of each block. DefinitionsOf lists the definitions of a
+ * variable, calls included. Step moves a set of definitions forwards
+ * over one quad, and Reaching finds the definitions that reach a given
+ * quad; both need a set with room for every definition to follow the
+ * other temporaries.
+ */
+
+class ReachingDefinitions : public DataflowAnalysis
+{
+    VariableNumbering                numbering;
+    std::vector<long>                definitions;   // Definition to quad
+    std::vector<int>                 definitionOf;  // Quad to definition
+    std::vector<int>                 assigns;       // To variable, or -1
+    std::vector<std::vector<int> >   assignments;   // Variable to its own
+    std::vector<BitSet>              replaces;      // Same, for globals
+    std::vector<int>                 calls;
+
+public:
+    ReachingDefinitions(ControlFlowGraph *);
+
+    VariableNumbering&  Numbering(void) { return numbering; };
+    int                 Definitions(void) { return definitions.size(); };
+    int                 DefinitionOf(long i) { return definitionOf[i]; };
+    long                DefinitionQuad(int d) { return definitions[d]; };
+    int                 DefinitionVariable(int d) { return assigns[d]; };
+    void                DefinitionsOf(int, std::vector<int>&);
+
+    void                Step(long, BitSet&);
+    void                Reaching(long, BitSet&);
+};
+
+
+#endif
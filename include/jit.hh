@@ -0,0 +1,86 @@
+#ifndef __KOMP_JIT__
+#define __KOMP_JIT__
+
+#include <vector>
+#include <iostream>
+
+#include <vm.hh>
+
+
+//
+// Just-in-time compilation
+//
+// JITCompiler translates lowered VM functions to x86-64 machine code
+// in executable memory. The interpreter asks for a function to be
+// compiled once it has been called often enough; the JIT compiles it
+// together with every function it can call that isn't compiled yet,
+// so native code never has to return to the interpreter.
+//
+// Native code uses the same frames as the interpreter. It is called
+// as entry(vm, frame, state) and keeps these in callee-saved
+// registers for the whole function:
+//
+//     rbx      Integer registers of the frame
+//     r12      Real registers of the frame
+//     r13      The frame
+//     r14      The virtual machine
+//     r15      The VMState
+//     rbp      The word memory
+//
+// A call pushes the new frame through VirtualMachine::NativeFrame and
+// then calls the callee's entry point directly: with a relative call
+// if it is compiled together with the caller, and through its address
+// if it was compiled before. Calls to functions returning arrays go
+// through VirtualMachine::NativeCall, which also copies the result.
+//
+
+class JITFunction
+{
+public:
+    VMFunction                 *function;
+    long                        calls;
+    long                        size;
+};
+
+
+class JITCompiler
+{
+    std::vector<unsigned char>          code;
+    std::vector<std::pair<long, int> >  fixups;
+    std::vector<std::pair<long, VMFunction *> > callees;
+    std::vector<long>                   offsets;
+    std::vector<JITFunction>            compiled;
+    std::vector<std::pair<void *, long> > regions;
+    bool                                failed;
+
+    void            Byte(int);
+    void            Long(long);
+    void            Quad(long);
+    void            Operand(int, bool, int, int, int, int, long);
+    void            Direct(int, bool, int, int, int);
+    void            Move(int, long);
+    void            Call(const void *);
+    void            Jump(int, int);
+    void            Push(int);
+    void            Pop(int);
+
+    void            LoadInteger(int, int);
+    void            StoreInteger(int, int);
+    void            LoadReal(int, int);
+    void            StoreReal(int, int);
+    void            Up(int);
+    void            Check(int);
+    void            Boolean(int, int);
+
+    void            Translate(VMFunction *);
+
+public:
+    JITCompiler();
+    ~JITCompiler();
+
+    bool Compile(VMFunction *);
+    void Report(std::ostream&);
+};
+
+
+#endif
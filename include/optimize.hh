@@ -0,0 +1,343 @@
+#ifndef __KOMP_OPTIMIZE__
+#define __KOMP_OPTIMIZE__
+
+#include <iostream>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cfg.hh>
+#include <ssa.hh>
+
+
+//
+// Optimization
+//
+// With -O, the quads of each function are optimized as soon as they
+// have been generated, so the printed quads and every backend see the
+// result. Optimize runs the passes on one function in order, and
+// OptimizationReport prints what each pass did, for -r.
+//
+
+extern int optimizeQuads;
+
+void Optimize(FunctionInformation *);
+void OptimizationReport(std::ostream&);
+
+
+/*
+ * PeepholeOptimizer sweeps a window over the quads of a function and
+ * tries every rule in its pattern table at every position. A rule
+ * looks at the quads in the window starting at the current one, and
+ * may rewrite or remove them, but never touches any quad before the
+ * window; when one fires, the rules are tried again at the same
+ * place. The quads are swept until no rule fires any more.
+ *
+ * Rules can be turned off by name with Disable. The number of times
+ * each rule has fired, in all functions, is kept in the table.
+ */
+
+class PeepholeOptimizer
+{
+    typedef bool (PeepholeOptimizer::*Rule)(long *);
+
+    class Pattern
+    {
+    public:
+        const char      *name;
+        int              window;    // Number of quads the rule looks at
+        Rule             rule;
+        bool             enabled;
+        unsigned long    hits;
+    };
+
+    static Pattern                   patterns[];
+
+    FunctionInformation             *function;
+    QuadsList                       *quads;
+    std::map<long, long>             labels;        // Label to its clabel
+    std::map<long, int>              references;    // Jumps to each label
+    std::vector<int>                 reads;         // Reads of temporaries
+
+    void        Scan(void);
+    void        Remove(long);
+    void        Retarget(long, long);
+    long        FinalTarget(long);
+    bool        IsJump(long);
+
+    bool        JumpToNext(long *);
+    bool        JumpToJump(long *);
+    bool        BranchOverJump(long *);
+    bool        UnreachableCode(long *);
+    bool        UnusedLabel(long *);
+    bool        TemporaryCopy(long *);
+
+public:
+    PeepholeOptimizer(FunctionInformation *);
+
+    bool        Run(void);
+
+    static bool Disable(const char *);
+    static void Report(std::ostream&);
+};
+
+
+/*
+ * ConstantPropagation is sparse conditional constant propagation over
+ * the SSA form of a function. Every temporary starts out unknown and
+ * every block unreachable. Reachable blocks are evaluated as the
+ * edges into them are found to be taken, and a temporary whose value
+ * changes has the quads and phis that use it evaluated again; a value
+ * only ever goes from unknown to a constant to not constant. A branch
+ * on a constant only makes one of its edges taken, so code that can
+ * only be reached through the other edge is never evaluated and its
+ * assignments don't spoil the phis where the paths join.
+ *
+ * Constants are folded the way the virtual machine computes them.
+ * Integer division is folded only if it can't fail, and real results
+ * only if they are finite. The quads that compute a constant become
+ * iconst or rconst, branches on constants become jumps or go away,
+ * and the blocks that were never reached are removed.
+ */
+
+class ConstantPropagation
+{
+    enum { kUnknown, kConstant, kVarying };
+
+    class Value
+    {
+    public:
+        int          state;
+        long         integer;
+        double       real;
+
+        Value(int s = kUnknown) :
+            state(s),
+            integer(0),
+            real(0.0) {};
+    };
+
+    FunctionInformation                     *function;
+    QuadsList                               *quads;
+    ControlFlowGraph                        *graph;
+    SSAForm                                 *ssa;
+    std::map<long, int>                      labels;    // Label to its block
+    std::vector<Value>                       values;    // By temporary
+    std::vector<std::vector<long> >          users;     // Quads using each
+    std::vector<std::vector<int> >           phiUsers;  // Phis using each
+    std::vector<char>                        executable;
+    std::vector<std::vector<char> >          taken;     // By successor
+    std::deque<std::pair<int, int> >         edges;
+    std::deque<long>                         changed;   // Temporaries
+
+    static unsigned long                     propagated;
+    static unsigned long                     folded;
+    static unsigned long                     removed;
+
+    Value       ValueOf(SymbolInformation *);
+    bool        Equal(const Value&, const Value&);
+    void        Lower(VariableInformation *, const Value&);
+    Value       Evaluate(Quad&);
+    void        Take(int, int);
+    void        Visit(long);
+    void        VisitPhi(int);
+    void        Propagate(void);
+    Quad        Constant(VariableInformation *);
+    void        Rewrite(std::vector<long>&);
+
+public:
+    ConstantPropagation(FunctionInformation *);
+
+    bool        Run(void);
+
+    static void Report(std::ostream&);
+};
+
+
+/*
+ * ValueNumbering gives every value computed in a basic block a number,
+ * so that quads computing the same thing can be found. Variables get
+ * the number of the value they were last assigned, constants are
+ * numbered by their value, and every other quad is looked up by its
+ * opcode and the numbers of its operands. A quad whose value is
+ * already held by a variable becomes a copy from it, and operands are
+ * replaced by the first variable that holds their value, so that the
+ * copies are left dead.
+ *
+ * Loads are numbered too, but every store and call starts a new
+ * memory generation, and loads only match within one. A call may also
+ * change any variable that isn't a temporary or an array, so those
+ * are forgotten.
+ * Constants are never replaced, since the backends handle them better
+ * where they are.
+ */
+
+class ValueNumbering
+{
+    class Expression
+    {
+    public:
+        int          opcode;
+        long         a, b;
+        long         memory;
+
+        bool operator<(const Expression& e) const;
+    };
+
+    FunctionInformation                     *function;
+    QuadsList                               *quads;
+    std::map<VariableInformation *, long>    values;
+    std::map<Expression, long>               expressions;
+    std::vector<VariableInformation *>       holders;   // Value to variable
+    std::vector<char>                        constant;
+    long                                     memory;
+
+    static unsigned long                     redundant;
+    static unsigned long                     replaced;
+
+    long        NewValue(bool);
+    long        ValueOf(VariableInformation *);
+    void        Assign(VariableInformation *, long);
+    void        Forget(void);
+    bool        Replace(SymbolInformation *&);
+    bool        ReplaceOperands(Quad&);
+    bool        Numbered(Quad&, Expression&);
+    bool        Block(long, long);
+
+public:
+    ValueNumbering(FunctionInformation *);
+
+    bool        Run(void);
+
+    static void Report(std::ostream&);
+};
+
+
+/*
+ * LoopInvariantCodeMotion moves the quads that compute the same value
+ * on every trip around a natural loop out of it, into a preheader just
+ * before the header. Loops are taken innermost first, so that what
+ * leaves an inner loop can leave the one around it as well. A quad is
+ * invariant if it is pure and each of its operands is only reached by
+ * definitions outside the loop, or by a single one that has itself
+ * been hoisted. It is then moved if it is the only assignment to its
+ * variable in the loop, the variable isn't live into the header, and
+ * either the quad runs before every exit or the variable is dead
+ * after the loop.
+ *
+ * Constants are only hoisted along with a quad that uses them, and are
+ * copied rather than moved if the loop still uses them, since the
+ * backends handle them better where they are. Jumps from outside the
+ * loop to the header are sent to the preheader instead; a loop whose
+ * header is fallen into from inside the loop is left alone.
+ *
+ * The graph and the dataflow analyses are found once per function.
+ * Hoisting a quad doesn't change which definitions reach the operands
+ * of the quads that are left, nor what is live outside the loop, so
+ * they stay good for the loops around it. A hoisted quad is counted
+ * as being in the header of the loop it left, since its preheader
+ * dominates the same blocks as the header does.
+ */
+
+class LoopInvariantCodeMotion
+{
+    class Summary
+    {
+    public:
+        FunctionInformation *function;
+        long                 label;
+        int                  depth;
+        int                  hoisted;
+    };
+
+    class Member
+    {
+    public:
+        long                 quad;
+        int                  block;
+        int                  definition;    // Or -1
+        int                  variable;      // Assigned, or -1
+        int                  operands;
+        bool                 copy;          // Constant copied out of a loop
+        std::vector<int>     reaching[2];   // Definitions of each operand
+    };
+
+    FunctionInformation             *function;
+    QuadsList                       *quads;
+    ControlFlowGraph                *graph;
+    ReachingDefinitions             *definitions;
+    Liveness                        *liveness;
+    std::vector<Member>              members;
+    std::vector<size_t>              blockMembers;  // First member of each
+    std::vector<std::vector<size_t> > copies;       // Copies in each loop
+    std::vector<char>                inside;        // By definition
+    std::vector<char>                hoisted;
+    std::vector<char>                used;
+    std::vector<char>                needed;
+
+    static std::vector<Summary>      summaries;
+
+    void        Collect(void);
+    long        Preheader(int);
+    int         Hoist(int);
+
+public:
+    LoopInvariantCodeMotion(FunctionInformation *);
+
+    bool        Run(void);
+
+    static void Report(std::ostream&);
+};
+
+
+/*
+ * StrengthReduction replaces arithmetic by a constant with cheaper
+ * quads. The constants it knows are the temporaries that a single
+ * iconst or rconst assigns. An integer power with a small exponent
+ * becomes a chain of multiplications found by repeated squaring, and
+ * a real one with exponent 2 a single multiplication. Multiplying by
+ * a power of two becomes a left shift. Dividing by a power of two
+ * becomes an arithmetic right shift, with the dividend first biased
+ * when it is negative so that the quotient is still truncated towards
+ * zero. Dividing by any other constant becomes a multiplication by a
+ * fixed-point reciprocal that keeps the high word, which is shifted
+ * and then corrected by one when it is negative. Those two take four
+ * or five quads for one idiv, which only pays off where the quads are
+ * compiled; ReduceDivisions turns them off for a target that pays for
+ * every quad, like the virtual machine.
+ */
+
+class StrengthReduction
+{
+    FunctionInformation                     *function;
+    QuadsList                               *quads;
+    std::map<VariableInformation *, long>    constants;     // To its quad
+
+    static unsigned long                     powers;
+    static unsigned long                     products;
+    static unsigned long                     quotients;
+    static bool                              divisions;
+
+    void        Scan(void);
+    bool        IntegerConstant(SymbolInformation *, long&);
+    bool        RealConstant(SymbolInformation *, double&);
+    VariableInformation *Temporary(SymbolInformation *);
+    void        Rewrite(long, std::vector<Quad>&);
+
+    bool        Power(long, Quad&);
+    bool        Product(long, Quad&);
+    bool        Quotient(long, Quad&);
+
+public:
+    StrengthReduction(FunctionInformation *);
+
+    bool        Run(void);
+
+    static void ReduceDivisions(bool on) { divisions = on; };
+    static void Report(std::ostream&);
+};
+
+
+#endif
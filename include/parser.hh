@@ -107,7 +107,7 @@ typedef union YYSTYPE {
     TypeInformation         *type;
     FunctionInformation     *function;
 
-    string                  *id;
+    Atom                    *id;
     int                      integer;
     double                   real;
     void                    *null;
@@ -0,0 +1,104 @@
+#ifndef __KOMP_SSA__
+#define __KOMP_SSA__
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cfg.hh>
+#include <dataflow.hh>
+
+
+//
+// Static single assignment form
+//
+// SSAForm rewrites the quads of a function so that every variable it
+// takes care of is assigned by exactly one quad. Each assignment gets
+// a temporary of its own, and where different versions of a variable
+// meet, at the joins in the control-flow graph, a phi picks the one
+// belonging to the edge that was taken. Phis are not quads; they are
+// kept beside the quads until Destruct takes the function out of SSA
+// form again.
+//
+// Destruct gives every version back its variable, which is only right
+// while no two versions of a variable are live at the same time. That
+// holds for the form as it is built, and a pass in between may change
+// quads in place, fold branches and remove code without breaking it,
+// but must not move quads or replace one version by another.
+//
+
+/*
+ * Phi is a phi function at the top of block. result is the version of
+ * variable that it defines and arguments holds the version that
+ * arrives over each edge, in the order of the block's predecessors.
+ * An argument is NULL if its edge comes from a block that can't be
+ * reached.
+ */
+
+class Phi
+{
+public:
+    int                                  block;
+    VariableInformation                 *variable;
+    VariableInformation                 *result;
+    std::vector<VariableInformation *>   arguments;
+
+    Phi(int b, VariableInformation *v) :
+        block(b),
+        variable(v),
+        result(NULL) {};
+};
+
+
+/*
+ * SSAForm takes care of the temporaries that are assigned more than
+ * once and of the scalar variables of the function itself, unless the
+ * function calls one nested in it, which could read or change them.
+ * Variables of enclosing functions and arrays are left alone. Phis
+ * are placed on the iterated dominance frontiers of the assignments,
+ * but only where the variable is live, and the versions are named by
+ * walking the dominator tree. A use that no assignment reaches keeps
+ * the original variable.
+ *
+ * The graph must not have edges into its entry block. Blocks that
+ * can't be reached are not renamed and should be removed. Destruct
+ * releases the temporaries made for the versions, unless more have
+ * been made since.
+ */
+
+class SSAForm
+{
+    ControlFlowGraph                    *graph;
+    FunctionInformation                 *function;
+    QuadsList                           *quads;
+    std::vector<Phi>                     phis;
+    std::vector<std::vector<int> >       phisIn;        // Block to its phis
+    std::vector<char>                    promoted;      // By variable number
+    std::map<VariableInformation *, VariableInformation *> versions;
+    long                                 firstVersion;  // Temporaries before
+    long                                 lastVersion;   // And after Rename
+
+    static unsigned long                 placed;
+    static unsigned long                 renamed;
+
+    void        Promote(VariableNumbering&);
+    void        PlacePhis(Liveness&);
+    void        Rename(VariableNumbering&);
+
+public:
+    SSAForm(ControlFlowGraph *);
+
+    int                      Phis(void) { return phis.size(); };
+    Phi&                     PhiAt(int p) { return phis[p]; };
+    const std::vector<int>&  PhisIn(int b) { return phisIn[b]; };
+
+    void        Destruct(void);
+
+    static int  UseOperands(Quad&, SymbolInformation **[2]);
+    static void Report(std::ostream&);
+};
+
+
+#endif
@@ -5,40 +5,40 @@
 
 
 //
-// Note that the implementation of this class is rather inefficient.
-// When operating on strings and character pointers, this
-// implementation will create a lot of temporary objects. By
-// overloading all the operators on combinations of strings and
-// character pointers this could be avoided.
+// A string is a length and a pointer to NUL-terminated text. Strings
+// of up to STRING_INLINE_SIZE - 1 characters, which covers nearly
+// every identifier, keep their text in the string object itself and
+// never touch the heap. Longer strings grow their heap buffer by
+// doubling.
 //
-// The append and assignment operators (+=) are defined this way
-// because it is used a lot. Something similar should be done for all
-// other operators as well.
+// Concatenation returns by value, and strings can be moved, so the
+// temporaries in expressions like a + "<" + n hand their buffer on
+// instead of copying it. Appending to an rvalue reuses it.
 //
-// Finally, the class should avoid actually copying data unless it is
-// really necessary. If strings were considered read only (no
-// destructive update), then it would be possible to keep a pool of
-// strings with reference counts and just pass along references to
-// that pool.
+// Comparisons ignore case.
 //
 
+#define STRING_INLINE_SIZE      16
+
 class string
 {
 private:
     char        *text;
     int          size;
     int          position;
-    int          chunk_size;
+    char         local[STRING_INLINE_SIZE];
 
     void ensure_size(int);
+    void append(const char *, int);
 
 public:
     class error {};             // Exception thrown when out of memory
 
     string();                   // Default constructor creates empty string
-    string(char *);             // Create string from character pointer
-    string(char, int);          // Create string filles with characters
+    string(const char *);       // Create string from character pointer
+    string(char, int);          // Create empty string with room for sz
     string(const string &);     // Copy constructor
+    string(string &&);          // Move constructor
     string(int);                // Convert an integer
 
     ~string();                  // Destructor
@@ -47,16 +47,23 @@ public:
     void downcase(void);
 
     string& operator=(const string&); // Assignment operator
+    string& operator=(string&&);      // Move assignment operator
     string& operator=(const char *);  // Assignment operator
     string& operator=(const char);    // Assignment operator
 
     string& operator+=(const string&); // Append operator
     string& operator+=(const char);    // Append operator
     string& operator+=(const char *);  // Append operator
-
-    friend string& operator+(const string&, const string&); // Concatenate
-    friend string& operator+(const string&, const char);    // Concatenate
-    friend string& operator+(const string&, const int);     // Concatenate
+    string& operator+=(const int);     // Append operator
+
+    friend string operator+(const string&, const string&); // Concatenate
+    friend string operator+(const string&, const char *);  // Concatenate
+    friend string operator+(const string&, const char);    // Concatenate
+    friend string operator+(const string&, const int);     // Concatenate
+    friend string operator+(string&&, const string&);      // Concatenate
+    friend string operator+(string&&, const char *);       // Concatenate
+    friend string operator+(string&&, const char);         // Concatenate
+    friend string operator+(string&&, const int);          // Concatenate
 
     //
     // Comparison operators
@@ -1,9 +1,13 @@
 #ifndef __KOMP_SYMTAB__
 #define __KOMP_SYMTAB__
 
+#include <deque>
+#include <vector>
+
 #include <string.hh>
 
 class StatementList;
+class FlatAST;
 class QuadsList;
 
 class SymbolInformation;
@@ -12,6 +16,7 @@ class FunctionInformation;
 class TypeInformation;
 class SymbolTableElement;
 class SymbolTable;
+class Atom;
 
 extern FunctionInformation *currentFunction;
 
@@ -24,10 +29,43 @@ extern TypeInformation *kIntegerType;
 
 
 
+/*
+ * Atom is an identifier that has been interned in the global atom
+ * table. Identifiers are case insensitive, so there is one atom for
+ * all spellings of a name; name holds the first one seen. hash is
+ * the case-folded hash of the name and number is the atom's position
+ * in the table. Two identifiers are the same exactly when their atoms
+ * are.
+ */
+
+class Atom
+{
+public:
+    string                   name;
+    unsigned long            hash;
+    long                     number;
+
+    Atom(const string& n, unsigned long h, long i) :
+        name(n),
+        hash(h),
+        number(i) {};
+};
+
+Atom *InternIdentifier(const char *);
+Atom *InternIdentifier(const string&);
+long  AtomCount(void);
+
+
 /*
  * SymbolTable is a symbol table. You'll never really use this
  * directly. Instead, use the methods in the FunctionInformation
  * class for adding and looking up variables in the symbol table
+ *
+ * The table uses open addressing with linear probing. Symbols are
+ * kept in entries in the order they were added, together with the
+ * hash of their atom; the slots hold indices into entries, and names
+ * are compared by comparing atoms. The table starts small and doubles
+ * when it is two thirds full, rehashing from the cached hashes.
  */
 
 
@@ -35,7 +73,7 @@ class SymbolTableElement
 {
 public:
     SymbolInformation       *info;
-    SymbolTableElement      *next;
+    unsigned long            hash;
 };
 
 class SymbolTable
@@ -43,15 +81,28 @@ class SymbolTable
 protected:
     virtual std::ostream& print(std::ostream&);
 
+    long Find(Atom *);
+    void Grow(void);
+
+    static unsigned long     tables;
+    static unsigned long     symbols;
+    static unsigned long     lookups;
+    static unsigned long     probes;
+    static unsigned long     longestProbe;
+    static unsigned long     grows;
+
 public:
-    SymbolTableElement     **table;
-    int                      tableSize;
-    static int               nextTemporary;
+    std::vector<SymbolTableElement>  entries;
+    std::vector<int>                 slots;
+    int                              tableBits;
 
     SymbolTable();
 
     void AddSymbol(SymbolInformation *);
     SymbolInformation *LookupSymbol(const string&);
+    SymbolInformation *LookupSymbol(Atom *);
+
+    static void Report(std::ostream&);
 
     friend std::ostream& operator<<(std::ostream&, SymbolTable &);
     friend std::ostream& operator<<(std::ostream&, SymbolTable *);
@@ -96,11 +147,14 @@ protected:
 public:
     SymbolInformationType       tag;
     string                      id;
+    Atom                       *atom;
     SymbolTable                *table;
 
     SymbolInformation(SymbolInformationType t, const string &i) :
         tag(t),
-        id(i) {};
+        id(i),
+        atom(NULL),
+        table(NULL) {};
     virtual ~SymbolInformation() {}
 
     virtual FunctionInformation *SymbolAsFunction(void) { return NULL; };
@@ -112,11 +166,52 @@ public:
 };
 
 
+/*
+ * VariableInformation represents information stored about a variable
+ * in the symbol table. It contains a type field which specifies
+ * the type of the variable and a next field which is used to link
+ * together parameters and local variables in a symbol table.
+ *
+ * Temporaries are VariableInformation objects too, but they are never
+ * entered in a symbol table and have no id. Instead temporary holds
+ * their number, starting at 1, and they print as T:n. Named variables
+ * have temporary set to 0.
+ */
+
+class VariableInformation : public SymbolInformation
+{
+protected:
+    virtual std::ostream& print(std::ostream&);
+
+public:
+    TypeInformation             *type;
+    VariableInformation         *prev;
+    long                         temporary;
+
+    virtual VariableInformation *SymbolAsVariable(void) { return this; };
+
+    VariableInformation(const string& i) :
+        SymbolInformation(kVariableInformation, i),
+        type(NULL),
+        prev(NULL),
+        temporary(0) {};
+    VariableInformation(const string& i, TypeInformation *t) :
+        SymbolInformation(kVariableInformation, i),
+        type(t),
+        prev(NULL),
+        temporary(0) {};
+
+};
+
 /*
  * FunctionInformation represents information stored about a function
  * in the symbol table. It contains the return type of the function, a
  * pointer to the functions's last parameter and a pointer to the
  * symbol table for the function.
+ *
+ * ReleaseTemporaries drops the temporaries made after the first n,
+ * which nothing may refer to any more, so that their numbers can be
+ * used again.
  */
 
 class FunctionInformation : public SymbolInformation
@@ -135,17 +230,22 @@ private:
     SymbolTable                  symbolTable;
 
     StatementList               *body;
+    FlatAST                     *tree;
     QuadsList                   *quads;
 
+    std::deque<VariableInformation> temporaries;
+
 public:
 
     FunctionInformation(const string& i) :
         SymbolInformation(kFunctionInformation, i),
+        temporaryCount(0),
         parent(NULL),
         returnType(NULL),
         lastParam(NULL),
         lastLocal(NULL),
         body(NULL),
+        tree(NULL),
         quads(NULL) {};
 
     virtual FunctionInformation *SymbolAsFunction(void) { return this; };
@@ -153,11 +253,14 @@ public:
     void SetParent(FunctionInformation *);
     void SetReturnType(TypeInformation *);
     void SetBody(StatementList *);
+    void SetTree(FlatAST *);
     void SetQuads(QuadsList *);
 
     FunctionInformation *GetParent(void);
     TypeInformation     *GetReturnType(void);
     VariableInformation *GetLastParam(void);
+    VariableInformation *GetLastLocal(void);
+    SymbolTable         *GetSymbolTable(void);
     StatementList       *GetBody(void);
     QuadsList           *GetQuads(void);
 
@@ -168,41 +271,18 @@ public:
     TypeInformation     *AddArrayType(TypeInformation *, int);
 
     VariableInformation *TemporaryVariable(TypeInformation *type);
-
-    void GenerateCode(void);
+    VariableInformation *GetTemporary(long);
+    long                 GetTemporaryCount(void);
+    void                 ReleaseTemporaries(long);
 
     char OkToAddSymbol(const string&);
+    char OkToAddSymbol(Atom *);
 
     SymbolInformation *LookupIdentifier(const string&);
+    SymbolInformation *LookupIdentifier(Atom *);
 };
 
 
-/*
- * VariableInformation represents information stored about a variable
- * in the symbol table. It contains a type field which specifies
- * the type of the variable and a next field which is used to link
- * together parameters and local variables in a symbol table.
- */
-
-class VariableInformation : public SymbolInformation
-{
-protected:
-    virtual std::ostream& print(std::ostream&);
-
-public:
-    TypeInformation             *type;
-    VariableInformation         *prev;
-
-    virtual VariableInformation *SymbolAsVariable(void) { return this; };
-
-    VariableInformation(const string& i) :
-        SymbolInformation(kVariableInformation, i) {};
-    VariableInformation(const string& i, TypeInformation *t) :
-        SymbolInformation(kVariableInformation, i),
-        type(t) {};
-
-};
-
 class TypeInformation : public SymbolInformation
 {
 protected:
@@ -220,6 +300,8 @@ public:
 
     TypeInformation(const string& i, unsigned long s) :
         SymbolInformation(kTypeInformation, i),
+        elementType(NULL),
+        arrayDimensions(0),
         size(s) {};
 };
 
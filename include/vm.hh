@@ -0,0 +1,339 @@
+#ifndef __KOMP_VM__
+#define __KOMP_VM__
+
+#include <map>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+
+
+//
+// Virtual machine instructions
+//
+// The virtual machine does not interpret quads directly. Each
+// function's QuadsList is first lowered to an array of
+// VMInstructions where every operand has been resolved to a register
+// number, a frame offset or a constant, and every label has been
+// resolved to an instruction offset. The dispatch loop never has to
+// look anything up.
+//
+// Scalar variables and temporaries owned by a function live in the
+// integer and real register banks of its frame. Arrays live in the
+// word memory. Addresses, as computed by iaddr, are word indices into
+// that memory; each word holds either an integer or a real, which is
+// why the array code in codegen.cc never scales its index. Variables
+// owned by an enclosing function are reached by following static
+// links (the up* instructions).
+//
+// Operands are called a, b and c, in the same order as for quads.
+// Jump targets go in b, constants and callees in imm.
+//
+
+typedef enum
+{
+    vm_iconst,      // ireg[c] = imm.i
+    vm_rconst,      // rreg[c] = imm.r
+    vm_iaddr,       // ireg[c] = address of word a in this frame
+    vm_iaddrup,     // ireg[c] = address of word a, b static links up
+    vm_itor,        // rreg[c] = ireg[a]
+    vm_rtrunc,      // ireg[c] = rreg[a]
+
+    vm_iadd,        // ireg[c] = ireg[a] op ireg[b]
+    vm_isub,
+    vm_imul,
+    vm_idiv,
+    vm_ipow,
+    vm_radd,        // rreg[c] = rreg[a] op rreg[b]
+    vm_rsub,
+    vm_rmul,
+    vm_rdiv,
+    vm_rpow,
+    vm_ineg,        // ireg[c] = -ireg[a]
+    vm_rneg,        // rreg[c] = -rreg[a]
+    vm_ishl,        // ireg[c] = ireg[a] op imm.i
+    vm_isar,
+    vm_ishr,
+    vm_imulh,
+
+    vm_igt,         // ireg[c] = ireg[a] op ireg[b]
+    vm_ilt,
+    vm_ieq,
+    vm_ile,
+    vm_ige,
+    vm_ine,
+    vm_rgt,         // ireg[c] = rreg[a] op rreg[b]
+    vm_rlt,
+    vm_req,
+    vm_rle,
+    vm_rge,
+    vm_rne,
+
+    vm_iand,        // ireg[c] = ireg[a] op ireg[b]
+    vm_ior,
+    vm_inot,        // ireg[c] = !ireg[a]
+
+    vm_jtrue,       // if ireg[a] goto b
+    vm_jfalse,      // if !ireg[a] goto b
+    vm_jump,        // goto b
+
+    vm_istore,      // memory[ireg[c]] = ireg[a]
+    vm_iload,       // ireg[c] = memory[ireg[a]]
+    vm_rstore,      // memory[ireg[c]] = rreg[a]
+    vm_rload,       // rreg[c] = memory[ireg[a]]
+
+    vm_iupload,     // ireg[c] = ireg[a], b static links up
+    vm_iupstore,    // ireg[c], b static links up = ireg[a]
+    vm_rupload,     // rreg[c] = rreg[a], b static links up
+    vm_rupstore,    // rreg[c], b static links up = rreg[a]
+
+    vm_ireturn,     // Return ireg[a]
+    vm_rreturn,     // Return rreg[a]
+    vm_areturn,     // Return b words starting at ireg[a]
+    vm_return,      // Fall off the end of a function
+    vm_iparam,      // Push ireg[a]
+    vm_rparam,      // Push rreg[a]
+    vm_aparam,      // Push the b-word array at ireg[a]
+    vm_call,        // Call imm.f, result to register or word c
+
+    vm_putint,      // Built-in functions, result to ireg[c]
+    vm_putreal,
+    vm_getint,
+    vm_getreal,     // Result to rreg[c]
+
+    vm_imove,       // ireg[c] = ireg[a]
+    vm_rmove,       // rreg[c] = rreg[a]
+    vm_acopy,       // Copy b words from ireg[a] to ireg[c]
+
+    //
+    // Superinstructions. These are never produced by Lower; Fuse
+    // replaces common sequences of two or three instructions with
+    // them when the intermediate results aren't used anywhere else.
+    // Fused branches keep their target in c. Each integer branch also
+    // comes from the opposite comparison and jump, so ile, jtrue gives
+    // jle_ii just like igt, jfalse does.
+    //
+
+    vm_iadd_ic,     // ireg[c] = ireg[a] + imm.i       iconst, iadd
+    vm_isub_ic,     // ireg[c] = ireg[a] - imm.i       iconst, isub
+    vm_imul_ic,     // ireg[c] = ireg[a] * imm.i       iconst, imul
+    vm_ilt_ic,      // ireg[c] = ireg[a] < imm.i       iconst, ilt
+    vm_igt_ic,      // ireg[c] = ireg[a] > imm.i       iconst, igt
+    vm_ieq_ic,      // ireg[c] = ireg[a] == imm.i      iconst, ieq
+    vm_ile_ic,      // ireg[c] = ireg[a] <= imm.i      iconst, ile
+    vm_ige_ic,      // ireg[c] = ireg[a] >= imm.i      iconst, ige
+    vm_ine_ic,      // ireg[c] = ireg[a] != imm.i      iconst, ine
+
+    vm_jlt_ii,      // if ireg[a] < ireg[b] goto c     ilt, jtrue
+    vm_jge_ii,      // if ireg[a] >= ireg[b] goto c    ilt, jfalse
+    vm_jgt_ii,      // if ireg[a] > ireg[b] goto c     igt, jtrue
+    vm_jle_ii,      // if ireg[a] <= ireg[b] goto c    igt, jfalse
+    vm_jeq_ii,      // if ireg[a] == ireg[b] goto c    ieq, jtrue
+    vm_jne_ii,      // if ireg[a] != ireg[b] goto c    ieq, jfalse
+    vm_jlt_rr,      // if rreg[a] < rreg[b] goto c     rlt, jtrue
+    vm_jge_rr,      // if !(rreg[a] < rreg[b]) goto c  rlt, jfalse
+    vm_jgt_rr,      // if rreg[a] > rreg[b] goto c     rgt, jtrue
+    vm_jle_rr,      // if !(rreg[a] > rreg[b]) goto c  rgt, jfalse
+    vm_jeq_rr,      // if rreg[a] == rreg[b] goto c    req, jtrue
+    vm_jne_rr,      // if rreg[a] != rreg[b] goto c    req, jfalse
+    vm_jlt_ic,      // if ireg[a] < imm.i goto c       iconst, ilt, jtrue
+    vm_jge_ic,      // if ireg[a] >= imm.i goto c      iconst, ilt, jfalse
+    vm_jgt_ic,      // if ireg[a] > imm.i goto c       iconst, igt, jtrue
+    vm_jle_ic,      // if ireg[a] <= imm.i goto c      iconst, igt, jfalse
+    vm_jeq_ic,      // if ireg[a] == imm.i goto c      iconst, ieq, jtrue
+    vm_jne_ic,      // if ireg[a] != imm.i goto c      iconst, ieq, jfalse
+
+    vm_iaddr_ix,    // ireg[c] = address of word a + ireg[b]  iaddr, iadd
+    vm_iload_ix,    // ireg[c] = word a + ireg[b]    iaddr, iadd, iload
+    vm_rload_ix,    // rreg[c] = word a + ireg[b]    iaddr, iadd, rload
+    vm_istore_ix,   // word c + ireg[b] = ireg[a]    iaddr, iadd, istore
+    vm_rstore_ix,   // word c + ireg[b] = rreg[a]    iaddr, iadd, rstore
+
+    vm_hcf,         // Crash
+
+    vm_last         // Just end the enum
+} tVMOpcode;
+
+
+class VMFunction;
+class JITCompiler;
+
+union VMWord
+{
+    long            i;
+    double          r;
+};
+
+class VMInstruction
+{
+public:
+    const void     *handler;    // Set when the code is threaded
+    tVMOpcode       opcode;
+    int             a;
+    int             b;
+    int             c;
+    union
+    {
+        long        i;
+        double      r;
+        VMFunction *f;
+    } imm;
+
+    VMInstruction(tVMOpcode o, int x, int y, int z) :
+        handler(NULL),
+        opcode(o),
+        a(x),
+        b(y),
+        c(z) { imm.i = 0; };
+};
+
+
+/*
+ * VMParameter describes where an incoming argument goes in the
+ * callee's frame: an integer or real register, or a number of words
+ * of array memory.
+ */
+
+class VMParameter
+{
+public:
+    TypeInformation            *type;
+    int                         slot;
+    int                         words;
+};
+
+
+/*
+ * VMFunction is the lowered form of a FunctionInformation. Register
+ * and memory slots are assigned on demand as variables are seen, so
+ * the bank sizes are only final once every function that can refer
+ * to this function's variables has been lowered.
+ *
+ * When the JIT is on, calls counts how many times the function has
+ * been called by the interpreter, native is set once it has been
+ * compiled, and callers lists every call instruction that has to be
+ * patched when that happens.
+ */
+
+class VMFunction
+{
+public:
+    FunctionInformation                    *info;
+    VMFunction                             *parent;
+    int                                     level;
+    tVMOpcode                               builtin;
+
+    int                                     integerRegisters;
+    int                                     realRegisters;
+    int                                     memoryWords;
+
+    std::vector<VMParameter>                parameters;
+    std::vector<VMInstruction>              code;
+    std::map<VariableInformation *, int>    slots;
+
+    long                                    calls;
+    const void                             *native;
+    std::vector<VMInstruction *>            callers;
+
+    VMFunction(FunctionInformation *i, VMFunction *p) :
+        info(i),
+        parent(p),
+        level(p ? p->level + 1 : 0),
+        builtin(vm_last),
+        integerRegisters(0),
+        realRegisters(0),
+        memoryWords(0),
+        calls(0),
+        native(NULL) {};
+};
+
+
+/*
+ * VMFrame is an activation record. Register banks and array memory
+ * are carved out of three stacks owned by the VirtualMachine.
+ */
+
+class VMFrame
+{
+public:
+    VMFunction                 *function;
+    VMFrame                    *staticLink;
+    const VMInstruction        *returnAddress;
+    long                       *integerRegisters;
+    double                     *realRegisters;
+    long                        memoryBase;
+    int                         result;
+};
+
+
+/*
+ * VMState is the part of the machine state that native code reads
+ * and updates directly: the word memory, the top of the memory stack
+ * and the top of the argument stack. The interpreter keeps its own
+ * copies of the last two and only synchronises them at calls.
+ */
+
+class VMState
+{
+public:
+    VMWord                     *memory;
+    long                        memoryTop;
+    VMWord                     *arguments;
+};
+
+
+class VirtualMachine
+{
+    std::map<FunctionInformation *, VMFunction *>  functions;
+    std::vector<VMFunction *>                       pending;
+
+    long            stackSize;
+    long           *integerStack;
+    double         *realStack;
+    VMWord         *memory;
+    VMWord         *arguments;
+    VMFrame        *frames;
+    VMState         state;
+    char           *stackLimit;
+
+    JITCompiler    *jit;
+    bool            superinstructions;
+    bool            profile;
+    unsigned long   dispatches[vm_last];
+
+    VMFunction     *Function(FunctionInformation *);
+    void            Lower(VMFunction *);
+    void            Fuse(VMFunction *);
+    VMFunction     *Owner(VMFunction *, VariableInformation *, int&);
+    int             Slot(VMFunction *, VariableInformation *);
+    int             Use(VMFunction *, VariableInformation *, int);
+    int             Def(VMFunction *, VariableInformation *);
+    void            Commit(VMFunction *, VariableInformation *);
+    int             Address(VMFunction *, VariableInformation *, int);
+    VMInstruction&  Emit(VMFunction *, tVMOpcode, int, int, int);
+
+    VMFrame        *Push(VMFrame *, const VMInstruction *);
+    long            Execute(VMFunction *);
+
+public:
+    VirtualMachine(long size = 1L << 20);
+    ~VirtualMachine();
+
+    void UseSuperinstructions(bool on) { superinstructions = on; };
+    void CountDispatches(bool on)      { profile = on; };
+    void UseJIT(bool);
+
+    long Run(FunctionInformation *);
+    void Report(std::ostream&);
+
+    static VMFrame *NativeFrame(VirtualMachine *, VMFrame *, const VMInstruction *);
+    static void NativeCall(VirtualMachine *, VMFrame *, const VMInstruction *);
+};
+
+
+long IntegerPower(long, long);
+void PutReal(double);
+void RuntimeError(const char *);
+
+
+#endif
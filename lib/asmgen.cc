@@ -0,0 +1,745 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <iostream>
+#include <sstream>
+
+#include <ast.hh>
+#include <symtab.hh>
+#include <codegen.hh>
+#include <asmgen.hh>
+
+
+static const char *integerArguments[] =
+{
+    "rdi", "rsi", "rdx", "rcx", "r8", "r9"
+};
+
+static const char *realArguments[] =
+{
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"
+};
+
+#define INTEGER_ARGUMENTS 6
+#define REAL_ARGUMENTS    8
+
+
+static bool IsArray(VariableInformation *var)
+{
+    return var->type != NULL && var->type->elementType != NULL;
+}
+
+static long Words(VariableInformation *var)
+{
+    return IsArray(var) ? var->type->arrayDimensions : 1;
+}
+
+
+AssemblyGenerator::~AssemblyGenerator()
+{
+    std::map<FunctionInformation *, AsmFunction *>::iterator  i;
+
+    for (i = functions.begin(); i != functions.end(); ++i)
+        delete i->second;
+}
+
+
+/*
+ * AssemblyGenerator::Function
+ *
+ * Find the AsmFunction for a FunctionInformation, creating it the
+ * first time. Functions are named after the chain of functions they
+ * are nested in, since the same name can be used in different scopes.
+ */
+
+AsmFunction *AssemblyGenerator::Function(FunctionInformation *info)
+{
+    AsmFunction         *fn;
+    std::ostringstream   name;
+    std::string          label;
+    unsigned             i;
+
+    if (functions.count(info))
+        return functions[info];
+
+    fn = new AsmFunction(info,
+                         info->GetParent() ? Function(info->GetParent())
+                                           : (AsmFunction *)NULL);
+    functions[info] = fn;
+
+    if (fn->parent == NULL)
+        fn->label = "komp_main";
+    else
+    {
+        name << fn->parent->label << '.' << info->id;
+        label = name.str();
+        for (i = 0; i < label.size(); i++)
+            label[i] = tolower(label[i]);
+        fn->label = label;
+    }
+
+    order.push_back(fn);
+    return fn;
+}
+
+
+/*
+ * AssemblyGenerator::Owner
+ * AssemblyGenerator::Slot
+ *
+ * Find the function whose frame holds a variable, and the variable's
+ * offset below rbp in that frame.
+ */
+
+AsmFunction *AssemblyGenerator::Owner(AsmFunction *fn,
+                                      VariableInformation *var,
+                                      int& depth)
+{
+    depth = 0;
+    while (fn != NULL)
+    {
+        if (var->table == fn->info->GetSymbolTable())
+            return fn;
+        fn = fn->parent;
+        depth += 1;
+    }
+
+    std::cerr << "Bug: variable " << var->id << " has no owner.\n";
+    abort();
+}
+
+long AssemblyGenerator::Slot(AsmFunction *fn, VariableInformation *var)
+{
+    if (fn->offsets.count(var) == 0)
+    {
+        fn->frameSize += 8 * Words(var);
+        fn->offsets[var] = fn->frameSize;
+    }
+
+    return fn->offsets[var];
+}
+
+
+/*
+ * AssemblyGenerator::Layout
+ *
+ * Assign frame slots. Parameters come first, followed by a slot for
+ * the pointer to each array parameter. Everything below that is
+ * zeroed by the prologue. Every variable mentioned in the quads gets
+ * a slot in its owner's frame, which is why all functions are laid
+ * out before any code is generated.
+ */
+
+void AssemblyGenerator::Layout(AsmFunction *fn)
+{
+    VariableInformation     *var;
+    SymbolInformation       *syms[3];
+    QuadsListIterator       *iter;
+    Quad                    *quad;
+    int                      depth, i;
+
+    for (var = fn->info->GetLastParam(); var; var = var->prev)
+        fn->parameters.insert(fn->parameters.begin(), var);
+
+    for (i = 0; i < (int)fn->parameters.size(); i++)
+        Slot(fn, fn->parameters[i]);
+    for (i = 0; i < (int)fn->parameters.size(); i++)
+    {
+        if (IsArray(fn->parameters[i]))
+        {
+            fn->frameSize += 8;
+            fn->pointers.push_back(fn->frameSize);
+        }
+        else
+            fn->pointers.push_back(0);
+    }
+    fn->parameterEnd = fn->frameSize;
+
+    if (fn->info->GetQuads() == NULL)
+        return;
+
+    iter = new QuadsListIterator(fn->info->GetQuads());
+    while ((quad = iter->Next()) != NULL)
+    {
+        syms[0] = quad->opcode == call ? NULL : quad->sym1;
+        syms[1] = quad->sym2;
+        syms[2] = quad->sym3;
+
+        if (quad->opcode == call &&
+            quad->sym1->SymbolAsFunction()->GetQuads() != NULL)
+            Function(quad->sym1->SymbolAsFunction());
+
+        for (i = 0; i < 3; i++)
+            if (syms[i] != NULL && (var = syms[i]->SymbolAsVariable()))
+                Slot(Owner(fn, var, depth), var);
+    }
+    delete iter;
+}
+
+
+/*
+ * AssemblyGenerator::Frame
+ *
+ * Return a memory operand for a variable. If the variable belongs to
+ * an enclosing function, emit code that follows the static links
+ * into r11 first.
+ */
+
+std::string AssemblyGenerator::Frame(AsmFunction *fn,
+                                     VariableInformation *var)
+{
+    std::ostringstream   operand;
+    AsmFunction         *owner;
+    int                  depth;
+
+    owner = Owner(fn, var, depth);
+    if (depth == 0)
+    {
+        operand << "[rbp-" << Slot(owner, var) << "]";
+    }
+    else
+    {
+        o << "\tmov\tr11, QWORD PTR [rbp-8]\n";
+        while (--depth > 0)
+            o << "\tmov\tr11, QWORD PTR [r11-8]\n";
+        operand << "[r11-" << Slot(owner, var) << "]";
+    }
+
+    return operand.str();
+}
+
+void AssemblyGenerator::Load(AsmFunction *fn,
+                             VariableInformation *var, const char *reg)
+{
+    std::string m = Frame(fn, var);
+    o << "\tmov\t" << reg << ", QWORD PTR " << m << '\n';
+}
+
+void AssemblyGenerator::Store(AsmFunction *fn,
+                              const char *reg, VariableInformation *var)
+{
+    std::string m = Frame(fn, var);
+    o << "\tmov\tQWORD PTR " << m << ", " << reg << '\n';
+}
+
+void AssemblyGenerator::LoadReal(AsmFunction *fn,
+                                 VariableInformation *var, const char *reg)
+{
+    std::string m = Frame(fn, var);
+    o << "\tmovsd\t" << reg << ", QWORD PTR " << m << '\n';
+}
+
+void AssemblyGenerator::StoreReal(AsmFunction *fn,
+                                  const char *reg, VariableInformation *var)
+{
+    std::string m = Frame(fn, var);
+    o << "\tmovsd\tQWORD PTR " << m << ", " << reg << '\n';
+}
+
+void AssemblyGenerator::Address(AsmFunction *fn,
+                                VariableInformation *var, const char *reg)
+{
+    std::string m = Frame(fn, var);
+    o << "\tlea\t" << reg << ", " << m << '\n';
+}
+
+
+/*
+ * AssemblyGenerator::StaticLink
+ *
+ * Load the frame pointer of callee's parent into r10.
+ */
+
+void AssemblyGenerator::StaticLink(AsmFunction *fn, AsmFunction *callee)
+{
+    AsmFunction     *up;
+
+    if (callee->parent == fn)
+    {
+        o << "\tmov\tr10, rbp\n";
+        return;
+    }
+
+    o << "\tmov\tr10, QWORD PTR [rbp-8]\n";
+    for (up = fn->parent; up != NULL && up != callee->parent; up = up->parent)
+        o << "\tmov\tr10, QWORD PTR [r10-8]\n";
+}
+
+
+/*
+ * AssemblyGenerator::Prologue
+ *
+ * Set up the frame, spill the incoming arguments, clear the rest of
+ * the frame and copy array arguments into it.
+ */
+
+void AssemblyGenerator::Prologue(AsmFunction *fn)
+{
+    VariableInformation *var;
+    long                 size, incoming;
+    int                  i, n, ni, nr;
+
+    size = (fn->frameSize + 15) & ~15L;
+    n = fn->parameters.size();
+
+    o << "\tpush\trbp\n";
+    o << "\tmov\trbp, rsp\n";
+    o << "\tsub\trsp, " << size << '\n';
+    o << "\tmov\tQWORD PTR [rbp-8], r10\n";
+
+    ni = nr = 0;
+    if (fn->info->GetReturnType() != NULL &&
+        fn->info->GetReturnType()->elementType != NULL)
+    {
+        o << "\tmov\tQWORD PTR [rbp-16], rdi\n";
+        ni = 1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        var = fn->parameters[i];
+        incoming = 16 + 16 * (n - 1 - i);
+
+        std::ostringstream slot;
+        slot << "QWORD PTR [rbp-"
+             << (IsArray(var) ? fn->pointers[i] : fn->offsets[var]) << "]";
+
+        if (var->type == kRealType && nr < REAL_ARGUMENTS)
+            o << "\tmovsd\t" << slot.str() << ", " << realArguments[nr++] << '\n';
+        else if (var->type != kRealType && ni < INTEGER_ARGUMENTS)
+            o << "\tmov\t" << slot.str() << ", " << integerArguments[ni++] << '\n';
+        else
+        {
+            o << "\tmov\trax, QWORD PTR [rbp+" << incoming << "]\n";
+            o << "\tmov\t" << slot.str() << ", rax\n";
+        }
+    }
+
+    if (fn->frameSize > fn->parameterEnd)
+    {
+        o << "\tlea\trdi, [rbp-" << fn->frameSize << "]\n";
+        o << "\tmov\tecx, " << (fn->frameSize - fn->parameterEnd) / 8 << '\n';
+        o << "\txor\teax, eax\n";
+        o << "\trep stosq\n";
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        var = fn->parameters[i];
+        if (!IsArray(var))
+            continue;
+        o << "\tmov\trsi, QWORD PTR [rbp-" << fn->pointers[i] << "]\n";
+        o << "\tlea\trdi, [rbp-" << fn->offsets[var] << "]\n";
+        o << "\tmov\tecx, " << Words(var) << '\n';
+        o << "\trep movsq\n";
+    }
+}
+
+
+/*
+ * AssemblyGenerator::Call
+ *
+ * The param quads have pushed one 16-byte cell per argument. Load
+ * the ones that go in registers, call, and pop them all.
+ */
+
+void AssemblyGenerator::Call(AsmFunction *fn, Quad *quad)
+{
+    FunctionInformation *info = quad->sym1->SymbolAsFunction();
+    VariableInformation *result = quad->sym3->SymbolAsVariable();
+    VariableInformation *var;
+    AsmFunction         *callee;
+    int                  i, n, ni, nr;
+
+    if (info == kIPrintFunction || info == kFPrintFunction)
+    {
+        if (info == kIPrintFunction)
+            o << "\tmov\trdi, QWORD PTR [rsp]\n";
+        else
+            o << "\tmovsd\txmm0, QWORD PTR [rsp]\n";
+        o << "\tcall\t" << (info == kIPrintFunction ? "putint" : "putreal")
+          << '\n';
+        o << "\tadd\trsp, 16\n";
+        pending -= 1;
+        Store(fn, "rax", result);
+        return;
+    }
+    if (info == kIReadFunction)
+    {
+        o << "\tcall\tgetint\n";
+        Store(fn, "rax", result);
+        return;
+    }
+    if (info == kFReadFunction)
+    {
+        o << "\tcall\tgetreal\n";
+        StoreReal(fn, "xmm0", result);
+        return;
+    }
+
+    callee = Function(info);
+    n = callee->parameters.size();
+    ni = nr = 0;
+
+    if (IsArray(result))
+    {
+        Address(fn, result, "rdi");
+        ni = 1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        var = callee->parameters[i];
+        if (var->type == kRealType && nr < REAL_ARGUMENTS)
+            o << "\tmovsd\t" << realArguments[nr++]
+              << ", QWORD PTR [rsp+" << 16 * (n - 1 - i) << "]\n";
+        else if (var->type != kRealType && ni < INTEGER_ARGUMENTS)
+            o << "\tmov\t" << integerArguments[ni++]
+              << ", QWORD PTR [rsp+" << 16 * (n - 1 - i) << "]\n";
+    }
+
+    StaticLink(fn, callee);
+    o << "\tcall\t" << callee->label << '\n';
+    if (n > 0)
+        o << "\tadd\trsp, " << 16 * n << '\n';
+    pending -= n;
+
+    if (result->type == kRealType)
+        StoreReal(fn, "xmm0", result);
+    else if (!IsArray(result))
+        Store(fn, "rax", result);
+}
+
+
+/*
+ * AssemblyGenerator::Generate
+ *
+ * Generate code for one function.
+ */
+
+static const char *ArithmeticInstruction(tQuadType op)
+{
+    switch (op)
+    {
+    case iadd: return "add";
+    case isub: return "sub";
+    case imul: return "imul";
+    case radd: return "addsd";
+    case rsub: return "subsd";
+    case rmul: return "mulsd";
+    case rdiv: return "divsd";
+    default:   return NULL;
+    }
+}
+
+void AssemblyGenerator::Generate(AsmFunction *fn)
+{
+    VariableInformation     *a, *b, *c;
+    QuadsListIterator       *iter;
+    Quad                    *quad;
+    double                   real;
+    long                     bits;
+    bool                     swap;
+    long                     divisions;
+
+    o << "\n\t.text\n";
+    if (fn->parent == NULL)
+        o << "\t.globl\t" << fn->label << '\n';
+    o << "\t.type\t" << fn->label << ", @function\n";
+    o << fn->label << ":\n";
+
+    Prologue(fn);
+    pending = 0;
+    divisions = 0;
+
+    iter = new QuadsListIterator(fn->info->GetQuads());
+    while (fn->info->GetQuads() != NULL && (quad = iter->Next()) != NULL)
+    {
+        a = quad->sym1 ? quad->sym1->SymbolAsVariable() : NULL;
+        b = quad->sym2 ? quad->sym2->SymbolAsVariable() : NULL;
+        c = quad->sym3 ? quad->sym3->SymbolAsVariable() : NULL;
+
+        o << "\t# " << ShortSymbols << quad << LongSymbols << '\n';
+
+        switch (quad->opcode)
+        {
+        case iconst:
+            o << "\tmovabs\trax, " << quad->int1 << '\n';
+            Store(fn, "rax", c);
+            break;
+        case rconst:
+            real = quad->real1;
+            memcpy(&bits, &real, sizeof(bits));
+            o << "\tmovabs\trax, " << bits << '\n';
+            Store(fn, "rax", c);
+            break;
+        case iaddr:
+            Address(fn, a, "rax");
+            o << "\tshr\trax, 3\n";
+            Store(fn, "rax", c);
+            break;
+        case itor:
+            Load(fn, a, "rax");
+            o << "\tcvtsi2sd\txmm0, rax\n";
+            StoreReal(fn, "xmm0", c);
+            break;
+        case rtrunc:
+            LoadReal(fn, a, "xmm0");
+            o << "\tcvttsd2si\trax, xmm0\n";
+            Store(fn, "rax", c);
+            break;
+        case ineg:
+            Load(fn, a, "rax");
+            o << "\tneg\trax\n";
+            Store(fn, "rax", c);
+            break;
+        case rneg:
+            Load(fn, a, "rax");
+            o << "\tbtc\trax, 63\n";
+            Store(fn, "rax", c);
+            break;
+        case ishl:
+        case isar:
+        case ishr:
+            Load(fn, a, "rax");
+            o << '\t' << (quad->opcode == ishl ? "shl" :
+                          quad->opcode == isar ? "sar" : "shr")
+              << "\trax, " << quad->int2 << '\n';
+            Store(fn, "rax", c);
+            break;
+        case imulh:
+            Load(fn, a, "rax");
+            o << "\tmovabs\trcx, " << quad->int2 << '\n';
+            o << "\timul\trcx\n";
+            Store(fn, "rdx", c);
+            break;
+
+        case iadd:
+        case isub:
+        case imul:
+            Load(fn, a, "rax");
+            Load(fn, b, "rcx");
+            o << '\t' << ArithmeticInstruction(quad->opcode) << "\trax, rcx\n";
+            Store(fn, "rax", c);
+            break;
+        case idiv:
+            // A zero divisor is a run-time error, and dividing by -1
+            // negates so that LONG_MIN / -1 wraps instead of trapping.
+            Load(fn, a, "rax");
+            Load(fn, b, "rcx");
+            o << "\ttest\trcx, rcx\n";
+            o << "\tje\t.L" << fn->label << ".zero\n";
+            o << "\tcmp\trcx, -1\n";
+            o << "\tjne\t.L" << fn->label << ".div" << divisions << '\n';
+            o << "\tneg\trax\n";
+            o << "\tjmp\t.L" << fn->label << ".div" << divisions << ".done\n";
+            o << ".L" << fn->label << ".div" << divisions << ":\n";
+            o << "\tcqo\n";
+            o << "\tidiv\trcx\n";
+            o << ".L" << fn->label << ".div" << divisions << ".done:\n";
+            Store(fn, "rax", c);
+            divisions += 1;
+            break;
+        case ipow:
+            Load(fn, a, "rdi");
+            Load(fn, b, "rsi");
+            o << "\tcall\tkomp_ipow\n";
+            Store(fn, "rax", c);
+            break;
+        case radd:
+        case rsub:
+        case rmul:
+        case rdiv:
+            LoadReal(fn, a, "xmm0");
+            LoadReal(fn, b, "xmm1");
+            o << '\t' << ArithmeticInstruction(quad->opcode) << "\txmm0, xmm1\n";
+            StoreReal(fn, "xmm0", c);
+            break;
+        case rpow:
+            LoadReal(fn, a, "xmm0");
+            LoadReal(fn, b, "xmm1");
+            o << "\tcall\tpow\n";
+            StoreReal(fn, "xmm0", c);
+            break;
+
+        case igt:
+        case ilt:
+        case ieq:
+        case ile:
+        case ige:
+        case ine:
+            Load(fn, a, "rax");
+            Load(fn, b, "rcx");
+            o << "\tcmp\trax, rcx\n";
+            o << '\t' << (quad->opcode == igt ? "setg" :
+                          quad->opcode == ilt ? "setl" :
+                          quad->opcode == ile ? "setle" :
+                          quad->opcode == ige ? "setge" :
+                          quad->opcode == ine ? "setne" : "sete") << "\tal\n";
+            o << "\tmovzx\teax, al\n";
+            Store(fn, "rax", c);
+            break;
+        case rgt:
+        case rlt:
+        case rge:
+        case rle:
+            swap = quad->opcode == rlt || quad->opcode == rle;
+            LoadReal(fn, a, swap ? "xmm1" : "xmm0");
+            LoadReal(fn, b, swap ? "xmm0" : "xmm1");
+            o << "\tucomisd\txmm0, xmm1\n";
+            o << '\t' << (quad->opcode == rgt || quad->opcode == rlt ?
+                          "seta" : "setae") << "\tal\n";
+            o << "\tmovzx\teax, al\n";
+            Store(fn, "rax", c);
+            break;
+        case req:
+            LoadReal(fn, a, "xmm0");
+            LoadReal(fn, b, "xmm1");
+            o << "\tucomisd\txmm0, xmm1\n";
+            o << "\tsete\tal\n";
+            o << "\tsetnp\tcl\n";
+            o << "\tand\tal, cl\n";
+            o << "\tmovzx\teax, al\n";
+            Store(fn, "rax", c);
+            break;
+        case rne:
+            LoadReal(fn, a, "xmm0");
+            LoadReal(fn, b, "xmm1");
+            o << "\tucomisd\txmm0, xmm1\n";
+            o << "\tsetne\tal\n";
+            o << "\tsetp\tcl\n";
+            o << "\tor\tal, cl\n";
+            o << "\tmovzx\teax, al\n";
+            Store(fn, "rax", c);
+            break;
+
+        case iand:
+        case ior:
+            Load(fn, a, "rax");
+            Load(fn, b, "rcx");
+            o << "\ttest\trax, rax\n";
+            o << "\tsetne\tal\n";
+            o << "\ttest\trcx, rcx\n";
+            o << "\tsetne\tcl\n";
+            o << '\t' << (quad->opcode == iand ? "and" : "or") << "\tal, cl\n";
+            o << "\tmovzx\teax, al\n";
+            Store(fn, "rax", c);
+            break;
+        case inot:
+            Load(fn, a, "rax");
+            o << "\ttest\trax, rax\n";
+            o << "\tsete\tal\n";
+            o << "\tmovzx\teax, al\n";
+            Store(fn, "rax", c);
+            break;
+
+        case jtrue:
+        case jfalse:
+            Load(fn, b, "rax");
+            o << "\ttest\trax, rax\n";
+            o << '\t' << (quad->opcode == jtrue ? "jne" : "je")
+              << "\t.L" << quad->int1 << '\n';
+            break;
+        case jump:
+            o << "\tjmp\t.L" << quad->int1 << '\n';
+            break;
+        case clabel:
+            o << ".L" << quad->int1 << ":\n";
+            break;
+
+        case istore:
+        case rstore:
+            Load(fn, c, "rcx");
+            Load(fn, a, "rax");
+            o << "\tmov\tQWORD PTR [0+rcx*8], rax\n";
+            break;
+        case iload:
+        case rload:
+            Load(fn, a, "rcx");
+            o << "\tmov\trax, QWORD PTR [0+rcx*8]\n";
+            Store(fn, "rax", c);
+            break;
+
+        case creturn:
+            if (c->type == kRealType)
+                LoadReal(fn, c, "xmm0");
+            else if (!IsArray(c))
+                Load(fn, c, "rax");
+            else
+            {
+                Address(fn, c, "rsi");
+                o << "\tmov\trdi, QWORD PTR [rbp-16]\n";
+                o << "\tmov\tecx, " << Words(c) << '\n';
+                o << "\trep movsq\n";
+            }
+            o << "\tjmp\t.L" << fn->label << ".return\n";
+            break;
+        case param:
+            o << "\tsub\trsp, 16\n";
+            if (IsArray(a))
+                Address(fn, a, "rax");
+            else
+                Load(fn, a, "rax");
+            o << "\tmov\tQWORD PTR [rsp], rax\n";
+            pending += 1;
+            break;
+        case call:
+            Call(fn, quad);
+            break;
+
+        case iassign:
+        case rassign:
+            Load(fn, a, "rax");
+            Store(fn, "rax", c);
+            break;
+        case aassign:
+            Address(fn, a, "rsi");
+            Address(fn, c, "rdi");
+            o << "\tmov\tecx, " << quad->int2 << '\n';
+            o << "\trep movsq\n";
+            break;
+
+        case nop:
+            break;
+        case hcf:
+        default:
+            o << "\tud2\n";
+            break;
+        }
+    }
+    delete iter;
+
+    o << "\txor\teax, eax\n";
+    o << "\tpxor\txmm0, xmm0\n";
+    o << ".L" << fn->label << ".return:\n";
+    o << "\tleave\n";
+    o << "\tret\n";
+    if (divisions > 0)
+    {
+        o << ".L" << fn->label << ".zero:\n";
+        o << "\tcall\tkomp_division_by_zero\n";
+    }
+    o << "\t.size\t" << fn->label << ", .-" << fn->label << '\n';
+}
+
+
+/*
+ * AssemblyGenerator::Generate
+ *
+ * Lay out every function reachable from the main program, then
+ * generate code for all of them.
+ */
+
+void AssemblyGenerator::Generate(FunctionInformation *program)
+{
+    unsigned    i;
+
+    Function(program);
+    for (i = 0; i < order.size(); i++)
+        Layout(order[i]);
+
+    o << "\t.intel_syntax noprefix\n";
+    for (i = 0; i < order.size(); i++)
+        Generate(order[i]);
+    o << "\n\t.section\t.note.GNU-stack,\"\",@progbits\n";
+}
@@ -1,9 +1,129 @@
+#include <stdlib.h>
+#include <iomanip>
 #include <ast.hh>
 
 
 int  ASTNode::indentLevel = 0;
 bool ASTNode::branches[10000];
 
+ASTArena astArena;
+
+
+/*
+ * ASTArena::Allocate
+ *
+ * Return size bytes of memory for a node. Nodes are aligned like the
+ * pointers and doubles they are made of.
+ */
+
+void *ASTArena::Allocate(size_t size)
+{
+    void        *p;
+
+    size = (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    if (next == NULL || next + size > limit)
+    {
+        blocks.push_back((char *)malloc(AST_ARENA_BLOCK_SIZE));
+        if (blocks.back() == NULL)
+        {
+            std::cerr << "Out of memory for the syntax tree\n";
+            abort();
+        }
+        next = blocks.back();
+        limit = next + AST_ARENA_BLOCK_SIZE;
+    }
+
+    p = next;
+    next += size;
+    used += size;
+    if (used > peak)
+        peak = used;
+
+    return p;
+}
+
+
+/*
+ * ASTArena::Count
+ *
+ * Count a node of the given kind, rounding its size up the way
+ * Allocate did.
+ */
+
+void ASTArena::Count(ASTNodeType kind, size_t size)
+{
+    kinds[kind].nodes += 1;
+    kinds[kind].bytes += (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+}
+
+
+/*
+ * ASTArena::Release
+ *
+ * Free all nodes in the arena at once. The first block is kept for the
+ * next function.
+ */
+
+void ASTArena::Release(void)
+{
+    unsigned long    i;
+
+    for (i = 1; i < blocks.size(); i++)
+        free(blocks[i]);
+    if (blocks.size() > 1)
+        blocks.resize(1);
+
+    next = blocks.size() > 0 ? blocks[0] : NULL;
+    used = 0;
+    releases += 1;
+}
+
+ASTArena::~ASTArena()
+{
+    unsigned long    i;
+
+    for (i = 0; i < blocks.size(); i++)
+        free(blocks[i]);
+}
+
+
+/*
+ * ASTArena::Report
+ *
+ * Print the number of nodes and bytes allocated for each kind of node
+ * that was made.
+ */
+
+void ASTArena::Report(std::ostream& o)
+{
+    unsigned long   nodes, bytes;
+    int             k;
+
+    nodes = bytes = 0;
+    o << "AST report\n";
+    o << std::setw(20) << "node"
+      << std::setw(12) << "count"
+      << std::setw(12) << "bytes" << '\n';
+
+    for (k = 0; k <= kBooleanConstant; k++)
+    {
+        if (kinds[k].nodes == 0)
+            continue;
+
+        o << std::setw(20) << ASTNodeName((ASTNodeType)k)
+          << std::setw(12) << kinds[k].nodes
+          << std::setw(12) << kinds[k].bytes << '\n';
+
+        nodes += kinds[k].nodes;
+        bytes += kinds[k].bytes;
+    }
+
+    o << "Total nodes:         " << nodes << '\n';
+    o << "Total bytes:         " << bytes << '\n';
+    o << "Largest function:    " << peak << " bytes\n";
+    o << "Releases:            " << releases << '\n';
+}
+
 
 void ASTNode::beginChild(std::ostream& o)
 {
@@ -45,7 +165,7 @@ void ASTNode::print(std::ostream& o)
     o << "ASTNode";
 }
 
-void ASTNode::xprint(std::ostream& o, char *cls)
+void ASTNode::xprint(std::ostream& o, const char *cls)
 {
     o << "ASTNode (" << cls << ")";
 }
@@ -73,14 +193,34 @@ void ASTNode::indentLess(void)
     indentLevel -= 2;
 }
 
+/*
+ * StatementList::print
+ * ElseIfList::print
+ * ExpressionList::print
+ *
+ * Lists are linked from their last element. Their elements are
+ * collected first and printed as siblings in source order, so long
+ * lists neither recurse nor indent any deeper.
+ */
+
 void StatementList::print(std::ostream& o)
 {
-    o << "StatementList (statement, preceding)\n";
-    beginChild(o);
-    o << statement << '\n';
-    endChild(o);
+    std::vector<Statement *>     statements;
+    StatementList               *l;
+    unsigned long                i;
+
+    for (l = this; l != NULL; l = l->precedingStatements)
+        statements.push_back(l->statement);
+
+    o << "StatementList (statements)\n";
+    for (i = statements.size(); i > 1; i--)
+    {
+        beginChild(o);
+        o << statements[i - 1] << '\n';
+        endChild(o);
+    }
     lastChild(o);
-    o << precedingStatements;
+    o << statements[0];
     endChild(o);
 }
 
@@ -91,16 +231,28 @@ void Statement::print(std::ostream& o)
 
 void ElseIfList::print(std::ostream& o)
 {
-    o << "ElseIfList (preceding, condition, body)\n";
-    beginChild(o);
-    o << preceding << '\n';
-    endChild(o);
-    beginChild(o);
-    o << condition << '\n';
-    endChild(o);
-    lastChild(o);
-    o << body;
-    endChild(o);
+    std::vector<ElseIfList *>    branches;
+    ElseIfList                  *l;
+    unsigned long                i;
+
+    for (l = this; l != NULL; l = l->preceding)
+        branches.push_back(l);
+
+    o << "ElseIfList (condition, body, ...)\n";
+    for (i = branches.size(); i > 0; i--)
+    {
+        beginChild(o);
+        o << branches[i - 1]->condition << '\n';
+        endChild(o);
+        if (i > 1)
+            beginChild(o);
+        else
+            lastChild(o);
+        o << branches[i - 1]->body;
+        if (i > 1)
+            o << '\n';
+        endChild(o);
+    }
 }
 
 void IfStatement::print(std::ostream& o)
@@ -167,12 +319,22 @@ void Expression::print(std::ostream& o)
 
 void ExpressionList::print(std::ostream& o)
 {
-    o << "ExpressionList (expression, preceding)\n";
-    beginChild(o);
-    o << expression << '\n';
-    endChild(o);
+    std::vector<Expression *>    expressions;
+    ExpressionList              *l;
+    unsigned long                i;
+
+    for (l = this; l != NULL; l = l->precedingExpressions)
+        expressions.push_back(l->expression);
+
+    o << "ExpressionList (expressions)\n";
+    for (i = expressions.size(); i > 1; i--)
+    {
+        beginChild(o);
+        o << expressions[i - 1] << '\n';
+        endChild(o);
+    }
     lastChild(o);
-    o << precedingExpressions;
+    o << expressions[0];
     endChild(o);
 }
 
@@ -228,7 +390,7 @@ void BinaryOperation::print(std::ostream& o)
     xprint(o, "BinaryOperation");
 }
 
-void BinaryOperation::xprint(std::ostream& o, char *cls)
+void BinaryOperation::xprint(std::ostream& o, const char *cls)
 {
     o << cls << " (left, right) ["
       << ShortSymbols << valueType << LongSymbols
@@ -293,7 +455,7 @@ void BinaryRelation::print(std::ostream& o)
     xprint(o, "BinaryRelation");
 }
 
-void BinaryRelation::xprint(std::ostream& o, char *cls)
+void BinaryRelation::xprint(std::ostream& o, const char *cls)
 {
     o << cls << " (left, right)\n";
     beginChild(o);
@@ -316,7 +478,7 @@ void BinaryCondition::print(std::ostream& o)
     xprint(o, "BinaryCondition");
 }
 
-void BinaryCondition::xprint(std::ostream& o, char *cls)
+void BinaryCondition::xprint(std::ostream& o, const char *cls)
 {
     o << cls << " (left, right)\n";
     beginChild(o);
@@ -345,6 +507,353 @@ void BooleanConstant::print(std::ostream& o)
 
 
 
+/* ======================================================================
+ * Flat ASTs
+ */
+
+static const char *kindNames[] =
+{
+    "StatementList",
+    "ElseIfList",
+    "IfStatement",
+    "Assignment",
+    "CallStatement",
+    "ReturnStatement",
+    "WhileStatement",
+    "ExpressionList",
+    "FunctionCall",
+    "IntegerToReal",
+    "TruncateReal",
+    "IntegerConstant",
+    "RealConstant",
+    "Plus",
+    "Minus",
+    "Times",
+    "Divide",
+    "Power",
+    "UnaryMinus",
+    "ArrayReference",
+    "Identifier",
+    "LessThan",
+    "GreaterThan",
+    "GreaterThanOrEqual",
+    "LessThanOrEqual",
+    "Equal",
+    "NotEqual",
+    "And",
+    "Or",
+    "Not",
+    "BooleanConstant"
+};
+
+const char *ASTNodeName(ASTNodeType kind)
+{
+    return kindNames[kind];
+}
+
+
+FlatAST::FlatAST(StatementList *body)
+{
+    root = Flatten(body);
+}
+
+
+/*
+ * FlatAST::Add
+ * FlatAST::AddList
+ *
+ * Add appends a node and returns its index. AddList appends a range
+ * of node indices to the list array and returns where it starts.
+ */
+
+unsigned int FlatAST::Add(ASTNodeType kind, TypeInformation *type,
+                          unsigned int a, unsigned int b, unsigned int c)
+{
+    FlatNode    node;
+
+    if (nodes.size() >= FLAT_NONE)
+    {
+        std::cerr << "Too many nodes in the syntax tree\n";
+        abort();
+    }
+
+    node.kind = kind;
+    node.type = type;
+    node.a = a;
+    node.b = b;
+    node.c = c;
+    node.value.integer = 0;
+    nodes.push_back(node);
+
+    return nodes.size() - 1;
+}
+
+unsigned int FlatAST::AddList(const std::vector<unsigned int>& items)
+{
+    unsigned int    first;
+
+    first = lists.size();
+    lists.insert(lists.end(), items.begin(), items.end());
+
+    return first;
+}
+
+
+/*
+ * FlatAST::Flatten
+ *
+ * Add the tree rooted at node and return the index of its root. The
+ * linked statement, elseif and argument lists are collected first and
+ * then flattened in source order, so that each one ends up as a single
+ * range in the list array.
+ */
+
+unsigned int FlatAST::Flatten(ASTNode *node)
+{
+    std::vector<ASTNode *>       children;
+    std::vector<unsigned int>    items;
+    unsigned int                 n, m;
+    unsigned long                i;
+
+    if (node == NULL)
+        return FLAT_NONE;
+
+    switch (node->kind)
+    {
+    case kStatementList:
+        for (StatementList *l = static_cast<StatementList *>(node);
+             l != NULL;
+             l = l->precedingStatements)
+            children.push_back(l->statement);
+        for (i = children.size(); i > 0; i--)
+            items.push_back(Flatten(children[i - 1]));
+        return Add(kStatementList, NULL, AddList(items), items.size(), 0);
+
+    case kIfStatement:
+    {
+        IfStatement *s = static_cast<IfStatement *>(node);
+
+        items.push_back(Flatten(s->condition));
+        items.push_back(Flatten(s->thenStatements));
+        for (ElseIfList *e = s->elseIfList; e != NULL; e = e->preceding)
+            children.push_back(e);
+        for (i = children.size(); i > 0; i--)
+        {
+            items.push_back(Flatten(static_cast<ElseIfList *>(children[i - 1])->condition));
+            items.push_back(Flatten(static_cast<ElseIfList *>(children[i - 1])->body));
+        }
+        m = Flatten(s->elseStatements);
+        return Add(kIfStatement, NULL, AddList(items), items.size() / 2, m);
+    }
+
+    case kAssignment:
+        n = Flatten(static_cast<Assignment *>(node)->target);
+        m = Flatten(static_cast<Assignment *>(node)->value);
+        return Add(kAssignment, NULL, n, m, 0);
+
+    case kCallStatement:
+        n = Flatten(static_cast<CallStatement *>(node)->call);
+        return Add(kCallStatement, NULL, n, 0, 0);
+
+    case kReturnStatement:
+        n = Flatten(static_cast<ReturnStatement *>(node)->value);
+        return Add(kReturnStatement, NULL, n, 0, 0);
+
+    case kWhileStatement:
+        n = Flatten(static_cast<WhileStatement *>(node)->condition);
+        m = Flatten(static_cast<WhileStatement *>(node)->body);
+        return Add(kWhileStatement, NULL, n, m, 0);
+
+    case kFunctionCall:
+    {
+        FunctionCall *f = static_cast<FunctionCall *>(node);
+
+        for (ExpressionList *l = f->arguments;
+             l != NULL;
+             l = l->precedingExpressions)
+            children.push_back(l->expression);
+        for (i = children.size(); i > 0; i--)
+            items.push_back(Flatten(children[i - 1]));
+        n = Add(kFunctionCall, f->valueType, AddList(items), items.size(), 0);
+        nodes[n].value.function = f->function;
+        return n;
+    }
+
+    case kIntegerToReal:
+        n = Flatten(static_cast<IntegerToReal *>(node)->value);
+        return Add(kIntegerToReal, kRealType, n, 0, 0);
+
+    case kTruncateReal:
+        n = Flatten(static_cast<TruncateReal *>(node)->value);
+        return Add(kTruncateReal, kIntegerType, n, 0, 0);
+
+    case kUnaryMinus:
+        n = Flatten(static_cast<UnaryMinus *>(node)->right);
+        return Add(kUnaryMinus, static_cast<UnaryMinus *>(node)->valueType,
+                   n, 0, 0);
+
+    case kNot:
+        n = Flatten(static_cast<Not *>(node)->right);
+        return Add(kNot, NULL, n, 0, 0);
+
+    case kIntegerConstant:
+        n = Add(kIntegerConstant, kIntegerType, 0, 0, 0);
+        nodes[n].value.integer = static_cast<IntegerConstant *>(node)->value;
+        return n;
+
+    case kRealConstant:
+        n = Add(kRealConstant, kRealType, 0, 0, 0);
+        nodes[n].value.real = static_cast<RealConstant *>(node)->value;
+        return n;
+
+    case kBooleanConstant:
+        n = Add(kBooleanConstant, NULL, 0, 0, 0);
+        nodes[n].value.integer = static_cast<BooleanConstant *>(node)->value;
+        return n;
+
+    case kIdentifier:
+        n = Add(kIdentifier, static_cast<Identifier *>(node)->valueType,
+                0, 0, 0);
+        nodes[n].value.variable = static_cast<Identifier *>(node)->id;
+        return n;
+
+    case kArrayReference:
+        m = Flatten(static_cast<ArrayReference *>(node)->index);
+        n = Add(kArrayReference, static_cast<ArrayReference *>(node)->valueType,
+                m, 0, 0);
+        nodes[n].value.variable = static_cast<ArrayReference *>(node)->id;
+        return n;
+
+    case kPlus:
+    case kMinus:
+    case kTimes:
+    case kDivide:
+    case kPower:
+        n = Flatten(static_cast<BinaryOperation *>(node)->left);
+        m = Flatten(static_cast<BinaryOperation *>(node)->right);
+        return Add((ASTNodeType)node->kind,
+                   static_cast<BinaryOperation *>(node)->valueType, n, m, 0);
+
+    case kLessThan:
+    case kGreaterThan:
+    case kGreaterThanOrEqual:
+    case kLessThanOrEqual:
+    case kEqual:
+    case kNotEqual:
+        n = Flatten(static_cast<BinaryRelation *>(node)->left);
+        m = Flatten(static_cast<BinaryRelation *>(node)->right);
+        return Add((ASTNodeType)node->kind, NULL, n, m, 0);
+
+    case kAnd:
+    case kOr:
+        n = Flatten(static_cast<BinaryCondition *>(node)->left);
+        m = Flatten(static_cast<BinaryCondition *>(node)->right);
+        return Add((ASTNodeType)node->kind, NULL, n, m, 0);
+
+    default:
+        std::cerr << "Bug: can't flatten a "
+                  << ASTNodeName((ASTNodeType)node->kind) << " on its own.\n";
+        abort();
+    }
+}
+
+
+/*
+ * FlatAST::print
+ *
+ * Print the node at index n and its children, one node per line,
+ * indented by depth.
+ */
+
+void FlatAST::print(std::ostream& o, unsigned int n, int depth)
+{
+    FlatNode        *node;
+    unsigned int     i;
+
+    o << std::setw(2 * depth) << "";
+    if (n == FLAT_NONE)
+    {
+        o << "(none)\n";
+        return;
+    }
+
+    node = &nodes[n];
+    o << kindNames[node->kind];
+    switch (node->kind)
+    {
+    case kStatementList:
+    case kIfStatement:
+        o << " (" << node->b << ")";
+        break;
+    case kFunctionCall:
+        o << " (" << ShortSymbols << node->value.function << LongSymbols << ")";
+        break;
+    case kIdentifier:
+    case kArrayReference:
+        o << " (" << ShortSymbols << node->value.variable << LongSymbols << ")";
+        break;
+    case kIntegerConstant:
+        o << " (" << node->value.integer << ")";
+        break;
+    case kRealConstant:
+        o << " (" << node->value.real << ")";
+        break;
+    case kBooleanConstant:
+        o << " (" << (node->value.integer ? "TRUE" : "FALSE") << ")";
+        break;
+    }
+    if (node->type != NULL)
+        o << " [" << ShortSymbols << node->type << LongSymbols << "]";
+    o << '\n';
+
+    switch (node->kind)
+    {
+    case kStatementList:
+    case kFunctionCall:
+        for (i = 0; i < node->b; i++)
+            print(o, lists[node->a + i], depth + 1);
+        break;
+
+    case kIfStatement:
+        for (i = 0; i < 2 * node->b; i++)
+            print(o, lists[node->a + i], depth + 1);
+        if (node->c != FLAT_NONE)
+            print(o, node->c, depth + 1);
+        break;
+
+    case kIntegerConstant:
+    case kRealConstant:
+    case kBooleanConstant:
+    case kIdentifier:
+        break;
+
+    case kCallStatement:
+    case kReturnStatement:
+    case kIntegerToReal:
+    case kTruncateReal:
+    case kUnaryMinus:
+    case kNot:
+    case kArrayReference:
+        print(o, node->a, depth + 1);
+        break;
+
+    default:
+        print(o, node->a, depth + 1);
+        print(o, node->b, depth + 1);
+        break;
+    }
+}
+
+std::ostream& operator<<(std::ostream& o, FlatAST *tree)
+{
+    if (tree == NULL)
+        o << (void*)tree;
+    else
+        tree->print(o, tree->root, 2);
+    return o;
+}
+
+
 std::ostream& operator<<(std::ostream& o, ASTNode *node)
 {
     if (node == NULL)
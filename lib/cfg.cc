@@ -0,0 +1,521 @@
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <map>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cfg.hh>
+
+
+std::vector<ControlFlowGraph::Summary> ControlFlowGraph::summaries;
+
+
+ControlFlowGraph::ControlFlowGraph(FunctionInformation *fn) :
+    function(fn),
+    quads(fn->GetQuads()),
+    edges(0)
+{
+    if (quads == NULL)
+        return;
+
+    FindBlocks();
+    FindEdges();
+    Order();
+    FindDominators();
+    FindLoops();
+}
+
+
+/*
+ * ControlFlowGraph::FindBlocks
+ *
+ * Split the quads into basic blocks. A block starts at the first quad,
+ * at a label that doesn't follow another label, and after every jump
+ * and return.
+ */
+
+void ControlFlowGraph::FindBlocks(void)
+{
+    long        i;
+    tQuadType   opcode;
+    bool        leader;
+
+    blockOf.assign(quads->Limit(), -1);
+
+    leader = true;
+    for (i = quads->First(); i >= 0; i = quads->Next(i))
+    {
+        opcode = quads->Opcode(i);
+        if (leader ||
+            (opcode == clabel && quads->Opcode(blocks.back().last) != clabel))
+            blocks.push_back(BasicBlock(i));
+
+        blocks.back().last = i;
+        blocks.back().size += 1;
+        blockOf[i] = blocks.size() - 1;
+
+        leader = opcode == jump || opcode == jtrue || opcode == jfalse ||
+            opcode == creturn;
+    }
+}
+
+
+void ControlFlowGraph::AddEdge(int from, int to)
+{
+    if (std::find(blocks[from].successors.begin(),
+                  blocks[from].successors.end(), to) !=
+        blocks[from].successors.end())
+        return;
+
+    blocks[from].successors.push_back(to);
+    blocks[to].predecessors.push_back(from);
+    edges += 1;
+}
+
+/*
+ * ControlFlowGraph::FindEdges
+ *
+ * Connect each block to the blocks its last quad can go to. Jumps go
+ * to the block holding their label, conditional jumps and every other
+ * quad except a return also fall through to the next block.
+ */
+
+void ControlFlowGraph::FindEdges(void)
+{
+    std::map<long, int>  labels;
+    Quad                 last;
+    long                 i;
+    int                  b;
+
+    for (b = 0; b < (int)blocks.size(); b++)
+        for (i = blocks[b].first;
+             i >= 0 && blockOf[i] == b && quads->Opcode(i) == clabel;
+             i = quads->Next(i))
+            labels[(*quads)[i].int1] = b;
+
+    for (b = 0; b < (int)blocks.size(); b++)
+    {
+        last = (*quads)[blocks[b].last];
+        if (last.opcode == jump || last.opcode == jtrue ||
+            last.opcode == jfalse)
+        {
+            if (labels.count(last.int1) == 0)
+            {
+                std::cerr << "Bug: jump to undefined label " << last.int1
+                          << " in " << function->id << '\n';
+                abort();
+            }
+            AddEdge(b, labels[last.int1]);
+        }
+
+        if (last.opcode != jump && last.opcode != creturn &&
+            b + 1 < (int)blocks.size())
+            AddEdge(b, b + 1);
+    }
+}
+
+/*
+ * ControlFlowGraph::Order
+ *
+ * Number the blocks that can be reached from the entry in reverse
+ * postorder. The search keeps its own stack, so long chains of blocks
+ * don't use up the C++ stack.
+ */
+
+void ControlFlowGraph::Order(void)
+{
+    std::vector<int>     stack;
+    std::vector<size_t>  next(blocks.size(), 0);
+    std::vector<char>    seen(blocks.size(), 0);
+    int                  b, s;
+    size_t               k;
+
+    orderOf.assign(blocks.size(), -1);
+    if (blocks.empty())
+        return;
+
+    stack.push_back(0);
+    seen[0] = 1;
+    while (!stack.empty())
+    {
+        b = stack.back();
+        if (next[b] < blocks[b].successors.size())
+        {
+            s = blocks[b].successors[next[b]++];
+            if (!seen[s])
+            {
+                seen[s] = 1;
+                stack.push_back(s);
+            }
+        }
+        else
+        {
+            order.push_back(b);
+            stack.pop_back();
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    for (k = 0; k < order.size(); k++)
+        orderOf[order[k]] = k;
+}
+
+
+/*
+ * ControlFlowGraph::FindDominators
+ *
+ * Find the immediate dominator of every reachable block by iterating
+ * over the blocks in reverse postorder until nothing changes, as in
+ * Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+ * While this runs the entry is its own dominator. The dominance
+ * frontiers are found the same way, by walking up the dominator tree
+ * from the predecessors of each join.
+ */
+
+int ControlFlowGraph::Intersect(int a, int b)
+{
+    while (a != b)
+    {
+        while (orderOf[a] > orderOf[b])
+            a = blocks[a].dominator;
+        while (orderOf[b] > orderOf[a])
+            b = blocks[b].dominator;
+    }
+    return a;
+}
+
+void ControlFlowGraph::FindDominators(void)
+{
+    size_t      k, p;
+    int         b, d, pred;
+    bool        changed;
+
+    if (blocks.empty())
+        return;
+
+    blocks[0].dominator = 0;
+    do
+    {
+        changed = false;
+        for (k = 1; k < order.size(); k++)
+        {
+            b = order[k];
+            d = -1;
+            for (p = 0; p < blocks[b].predecessors.size(); p++)
+            {
+                pred = blocks[b].predecessors[p];
+                if (blocks[pred].dominator < 0)
+                    continue;
+                d = d < 0 ? pred : Intersect(pred, d);
+            }
+            if (d != blocks[b].dominator)
+            {
+                blocks[b].dominator = d;
+                changed = true;
+            }
+        }
+    } while (changed);
+    blocks[0].dominator = -1;
+
+    for (k = 1; k < order.size(); k++)
+        blocks[blocks[order[k]].dominator].dominates.push_back(order[k]);
+
+    for (k = 0; k < order.size(); k++)
+    {
+        b = order[k];
+        for (p = 0; p < blocks[b].predecessors.size(); p++)
+        {
+            for (pred = blocks[b].predecessors[p];
+                 pred >= 0 && pred != blocks[b].dominator && Reachable(pred);
+                 pred = blocks[pred].dominator)
+            {
+                if (blocks[pred].frontier.empty() ||
+                    blocks[pred].frontier.back() != b)
+                    blocks[pred].frontier.push_back(b);
+            }
+        }
+    }
+
+    NumberDominatorTree();
+}
+
+
+/*
+ * ControlFlowGraph::NumberDominatorTree, ControlFlowGraph::Dominates
+ *
+ * Number the blocks of the dominator tree in the order a depth-first
+ * walk enters and leaves them. A dominates b exactly when b is
+ * entered after and left before a, so Dominates doesn't have to walk
+ * up the tree.
+ */
+
+void ControlFlowGraph::NumberDominatorTree(void)
+{
+    std::vector<int>     stack;
+    std::vector<size_t>  next(blocks.size(), 0);
+    int                  b, count;
+
+    treeEnter.assign(blocks.size(), -1);
+    treeLeave.assign(blocks.size(), -1);
+    if (blocks.empty())
+        return;
+
+    count = 0;
+    stack.push_back(0);
+    treeEnter[0] = count++;
+    while (!stack.empty())
+    {
+        b = stack.back();
+        if (next[b] < blocks[b].dominates.size())
+        {
+            b = blocks[b].dominates[next[b]++];
+            treeEnter[b] = count++;
+            stack.push_back(b);
+        }
+        else
+        {
+            treeLeave[b] = count++;
+            stack.pop_back();
+        }
+    }
+}
+
+bool ControlFlowGraph::Dominates(int a, int b)
+{
+    return Reachable(a) && Reachable(b) &&
+        treeEnter[a] <= treeEnter[b] && treeLeave[b] <= treeLeave[a];
+}
+
+
+/*
+ * ControlFlowGraph::FindLoops
+ *
+ * An edge to a block that dominates its source is a back edge, and
+ * its target is the header of a natural loop. Only edges that go
+ * backwards in reverse postorder can be back edges. The body of the
+ * loop is found by walking backwards from the latches until the
+ * header, marking the blocks with the loop they were found for. The
+ * loops are then sorted by size, largest first, so that a loop comes
+ * before the loops nested in it, and each block is given the
+ * innermost loop it is in.
+ */
+
+static bool LargerLoop(const Loop& a, const Loop& b)
+{
+    return a.blocks.size() > b.blocks.size();
+}
+
+void ControlFlowGraph::FindLoops(void)
+{
+    std::map<int, int>   headers;
+    std::vector<int>     inside(blocks.size(), -1);
+    std::vector<int>     work;
+    size_t               k, s, l;
+    int                  b, h, p;
+
+    for (k = 0; k < order.size(); k++)
+    {
+        b = order[k];
+        for (s = 0; s < blocks[b].successors.size(); s++)
+        {
+            h = blocks[b].successors[s];
+            if (orderOf[h] > orderOf[b] || !Dominates(h, b))
+                continue;
+            if (headers.count(h) == 0)
+            {
+                headers[h] = loops.size();
+                loops.push_back(Loop(h));
+            }
+            loops[headers[h]].latches.push_back(b);
+        }
+    }
+
+    for (l = 0; l < loops.size(); l++)
+    {
+        inside[loops[l].header] = l;
+        loops[l].blocks.push_back(loops[l].header);
+        work = loops[l].latches;
+        while (!work.empty())
+        {
+            b = work.back();
+            work.pop_back();
+            if (inside[b] == (int)l)
+                continue;
+            inside[b] = l;
+            loops[l].blocks.push_back(b);
+            for (s = 0; s < blocks[b].predecessors.size(); s++)
+            {
+                p = blocks[b].predecessors[s];
+                if (inside[p] != (int)l && Reachable(p))
+                    work.push_back(p);
+            }
+        }
+        std::sort(loops[l].blocks.begin(), loops[l].blocks.end());
+    }
+
+    std::stable_sort(loops.begin(), loops.end(), LargerLoop);
+    for (l = 0; l < loops.size(); l++)
+    {
+        loops[l].parent = blocks[loops[l].header].loop;
+        if (loops[l].parent >= 0)
+            loops[l].depth = loops[loops[l].parent].depth + 1;
+        for (k = 0; k < loops[l].blocks.size(); k++)
+        {
+            b = loops[l].blocks[k];
+            blocks[b].loop = l;
+            blocks[b].loopDepth = loops[l].depth;
+        }
+    }
+}
+
+bool ControlFlowGraph::InLoop(int b, int l)
+{
+    return std::binary_search(loops[l].blocks.begin(),
+                              loops[l].blocks.end(), b);
+}
+
+int ControlFlowGraph::LoopDepth(void)
+{
+    size_t      l;
+    int         depth;
+
+    depth = 0;
+    for (l = 0; l < loops.size(); l++)
+        depth = std::max(depth, loops[l].depth);
+    return depth;
+}
+
+
+/*
+ * ControlFlowGraph::PrintDot
+ *
+ * Print the graph for dot. Each block is a box listing its quads, and
+ * back edges are dashed. Loop headers are drawn with a double border
+ * and show the depth of the loop.
+ */
+
+void ControlFlowGraph::PrintDot(std::ostream& o)
+{
+    std::ostringstream   text;
+    std::string          line;
+    Quad                 q;
+    long                 i;
+    size_t               k, s;
+    int                  b, t;
+
+    o << "digraph \"" << function->id << "\" {\n";
+    o << "    node [shape=box, fontname=\"Courier\"];\n";
+
+    for (b = 0; b < (int)blocks.size(); b++)
+    {
+        text.str("");
+        text << ShortSymbols;
+        for (i = blocks[b].first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            text << q << "\\l";
+            if (i == blocks[b].last)
+                break;
+        }
+        text << LongSymbols;
+
+        line.clear();
+        for (k = 0; k < text.str().size(); k++)
+        {
+            if (text.str()[k] == '"')
+                line += '\\';
+            line += text.str()[k];
+        }
+
+        o << "    B" << b << " [label=\"B" << b;
+        if (blocks[b].loop >= 0 && loops[blocks[b].loop].header == b)
+            o << "  loop depth " << blocks[b].loopDepth;
+        if (!Reachable(b))
+            o << "  unreachable";
+        o << "\\l" << line << "\"";
+        if (blocks[b].loop >= 0 && loops[blocks[b].loop].header == b)
+            o << ", peripheries=2";
+        o << "];\n";
+    }
+
+    for (b = 0; b < (int)blocks.size(); b++)
+    {
+        for (s = 0; s < blocks[b].successors.size(); s++)
+        {
+            t = blocks[b].successors[s];
+            o << "    B" << b << " -> B" << t;
+            if (Dominates(t, b))
+                o << " [style=dashed]";
+            o << ";\n";
+        }
+    }
+
+    o << "}\n";
+}
+
+
+/*
+ * ControlFlowGraph::Record, ControlFlowGraph::Report
+ *
+ * Record remembers the size of the graph for the report. Report
+ * prints the totals for every graph recorded, and lists the functions
+ * that have loops together with how deeply they nest.
+ */
+
+void ControlFlowGraph::Record(void)
+{
+    Summary     summary;
+
+    summary.function = function;
+    summary.blocks = blocks.size();
+    summary.edges = edges;
+    summary.loops = loops.size();
+    summary.depth = LoopDepth();
+    summaries.push_back(summary);
+}
+
+void ControlFlowGraph::Report(std::ostream& o)
+{
+    unsigned long   totalBlocks, totalEdges, totalLoops;
+    size_t          k;
+    int             depth;
+
+    totalBlocks = totalEdges = totalLoops = 0;
+    depth = 0;
+    for (k = 0; k < summaries.size(); k++)
+    {
+        totalBlocks += summaries[k].blocks;
+        totalEdges += summaries[k].edges;
+        totalLoops += summaries[k].loops;
+        depth = std::max(depth, summaries[k].depth);
+    }
+
+    o << "Control-flow report\n";
+    o << "Functions:           " << summaries.size() << '\n';
+    o << "Basic blocks:        " << totalBlocks << '\n';
+    o << "Edges:               " << totalEdges << '\n';
+    o << "Loops:               " << totalLoops << '\n';
+    o << "Deepest loop:        " << depth << '\n';
+
+    if (totalLoops == 0)
+        return;
+
+    o << std::setw(20) << "function"
+      << std::setw(10) << "blocks"
+      << std::setw(10) << "edges"
+      << std::setw(10) << "loops"
+      << std::setw(10) << "depth" << '\n';
+    for (k = 0; k < summaries.size(); k++)
+    {
+        if (summaries[k].loops == 0)
+            continue;
+        o << std::setw(20) << summaries[k].function->id
+          << std::setw(10) << summaries[k].blocks
+          << std::setw(10) << summaries[k].edges
+          << std::setw(10) << summaries[k].loops
+          << std::setw(10) << summaries[k].depth << '\n';
+    }
+}
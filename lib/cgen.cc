@@ -0,0 +1,644 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <ctype.h>
+#include <iostream>
+#include <sstream>
+
+#include <ast.hh>
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cgen.hh>
+
+
+//
+// Everything the generated code needs apart from the functions
+// themselves. The arithmetic macros go through unsigned long so that
+// overflow wraps instead of being undefined.
+//
+
+static const char *prelude =
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <math.h>\n"
+    "\n"
+    "typedef union { long i; double r; } komp_word;\n"
+    "\n"
+    "#define KOMP_ADDRESS(p) ((long)((intptr_t)(p) / (intptr_t)sizeof(komp_word)))\n"
+    "#define KOMP_WORD(a)    (*(komp_word *)((intptr_t)(a) * (intptr_t)sizeof(komp_word)))\n"
+    "#define KOMP_ADD(a, b)  ((long)((unsigned long)(a) + (unsigned long)(b)))\n"
+    "#define KOMP_SUB(a, b)  ((long)((unsigned long)(a) - (unsigned long)(b)))\n"
+    "#define KOMP_MUL(a, b)  ((long)((unsigned long)(a) * (unsigned long)(b)))\n"
+    "#define KOMP_SHL(a, n)  ((long)((unsigned long)(a) << (n)))\n"
+    "#define KOMP_SHR(a, n)  ((long)((unsigned long)(a) >> (n)))\n"
+    "#define KOMP_MULH(a, b) ((long)(((__int128)(a) * (b)) >> 64))\n"
+    "\n"
+    "static void komp_error(const char *message)\n"
+    "{\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"Runtime error: %s\\n\", message);\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "static inline long komp_idiv(long a, long b)\n"
+    "{\n"
+    "    if (b == 0)\n"
+    "        komp_error(\"integer division by zero\");\n"
+    "    return b == -1 ? KOMP_SUB(0, a) : a / b;\n"
+    "}\n"
+    "\n"
+    "static inline long komp_ipow(long x, long y)\n"
+    "{\n"
+    "    long result = 1;\n"
+    "\n"
+    "    if (y < 0)\n"
+    "        return x == 1 ? 1 : x == -1 ? (y & 1 ? -1 : 1) : 0;\n"
+    "    while (y > 0)\n"
+    "    {\n"
+    "        if (y & 1)\n"
+    "            result = KOMP_MUL(result, x);\n"
+    "        x = KOMP_MUL(x, x);\n"
+    "        y >>= 1;\n"
+    "    }\n"
+    "    return result;\n"
+    "}\n"
+    "\n"
+    "static inline long komp_putint(long x)\n"
+    "{\n"
+    "    printf(\"%ld\\n\", x);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static inline long komp_putreal(double x)\n"
+    "{\n"
+    "    if (isnan(x))\n"
+    "        printf(\"nan\\n\");\n"
+    "    else\n"
+    "        printf(\"%g\\n\", x);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static inline long komp_getint(void)\n"
+    "{\n"
+    "    long x;\n"
+    "\n"
+    "    return scanf(\"%ld\", &x) == 1 ? x : 0;\n"
+    "}\n"
+    "\n"
+    "static inline double komp_getreal(void)\n"
+    "{\n"
+    "    double x;\n"
+    "\n"
+    "    return scanf(\"%lf\", &x) == 1 ? x : 0.0;\n"
+    "}\n";
+
+
+static bool IsArray(VariableInformation *var)
+{
+    return var->type != NULL && var->type->elementType != NULL;
+}
+
+static bool ReturnsArray(FunctionInformation *info)
+{
+    return info->GetReturnType() != NULL &&
+           info->GetReturnType()->elementType != NULL;
+}
+
+static std::string Identifier(const string& id)
+{
+    std::ostringstream  s;
+    std::string         name;
+    unsigned            i;
+
+    s << id;
+    name = s.str();
+    for (i = 0; i < name.size(); i++)
+        if (!isalnum((unsigned char)name[i]))
+            name[i] = '_';
+
+    return name;
+}
+
+
+CGenerator::~CGenerator()
+{
+    std::map<FunctionInformation *, CFunction *>::iterator  i;
+
+    for (i = functions.begin(); i != functions.end(); ++i)
+        delete i->second;
+}
+
+
+/*
+ * CGenerator::Function
+ *
+ * Find the CFunction for a FunctionInformation, creating it the
+ * first time. C names are built from the chain of enclosing
+ * functions, separated by double underscores.
+ */
+
+CFunction *CGenerator::Function(FunctionInformation *info)
+{
+    VariableInformation *var;
+    CFunction           *fn;
+
+    if (functions.count(info))
+        return functions[info];
+
+    fn = new CFunction(info,
+                       info->GetParent() ? Function(info->GetParent())
+                                         : (CFunction *)NULL);
+    functions[info] = fn;
+
+    if (fn->parent == NULL)
+        fn->name = "komp_main";
+    else
+        fn->name = fn->parent->name + "__" + Identifier(info->id);
+
+    for (var = info->GetLastParam(); var; var = var->prev)
+        fn->parameters.insert(fn->parameters.begin(), var);
+    for (var = info->GetLastLocal(); var; var = var->prev)
+        fn->locals.insert(fn->locals.begin(), var);
+    fn->members.insert(fn->parameters.begin(), fn->parameters.end());
+    fn->members.insert(fn->locals.begin(), fn->locals.end());
+
+    order.push_back(fn);
+    return fn;
+}
+
+
+/*
+ * CGenerator::Owner
+ *
+ * Find the function that owns a variable and how many environment
+ * pointers away it is.
+ */
+
+CFunction *CGenerator::Owner(CFunction *fn, VariableInformation *var,
+                             int& depth)
+{
+    depth = 0;
+    while (fn != NULL)
+    {
+        if (var->table == fn->info->GetSymbolTable())
+            return fn;
+        fn = fn->parent;
+        depth += 1;
+    }
+
+    std::cerr << "Bug: variable " << var->id << " has no owner.\n";
+    abort();
+}
+
+
+/*
+ * CGenerator::Name
+ * CGenerator::Declare
+ *
+ * Name returns the C name of a variable: frame members are prefixed
+ * with v_ and temporary number n becomes tn. Declare returns a
+ * declaration of name with the variable's type.
+ */
+
+std::string CGenerator::Name(VariableInformation *var)
+{
+    std::ostringstream  s;
+
+    if (var->temporary != 0)
+        s << 't' << var->temporary;
+    else
+        s << "v_" << Identifier(var->id);
+    return s.str();
+}
+
+std::string CGenerator::Declare(VariableInformation *var,
+                                const std::string& name)
+{
+    std::ostringstream  s;
+
+    if (IsArray(var))
+        s << "komp_word " << name << '[' << var->type->arrayDimensions << ']';
+    else if (var->type == kRealType)
+        s << "double " << name;
+    else
+        s << "long " << name;
+
+    return s.str();
+}
+
+
+/*
+ * CGenerator::Ref
+ *
+ * Return a C expression for a variable as seen from fn.
+ */
+
+std::string CGenerator::Ref(CFunction *fn, VariableInformation *var)
+{
+    std::string  frame;
+    CFunction   *owner;
+    int          depth;
+
+    owner = Owner(fn, var, depth);
+    if (depth == 0)
+        return owner->members.count(var) ? "f." + Name(var) : Name(var);
+
+    frame = "f.up";
+    while (--depth > 0)
+        frame += "->up";
+    return frame + "->" + Name(var);
+}
+
+
+/*
+ * CGenerator::Link
+ *
+ * Return the environment pointer to pass when fn calls callee: a
+ * pointer to the frame of callee's parent.
+ */
+
+std::string CGenerator::Link(CFunction *fn, CFunction *callee)
+{
+    std::string  frame;
+    CFunction   *up;
+
+    if (callee->parent == fn)
+        return "&f";
+
+    frame = "f.up";
+    for (up = fn->parent; up != NULL && up != callee->parent; up = up->parent)
+        frame += "->up";
+    return frame;
+}
+
+
+std::string CGenerator::Prototype(CFunction *fn)
+{
+    std::ostringstream  s;
+    TypeInformation    *type = fn->info->GetReturnType();
+    unsigned            i;
+
+    if (fn->parent == NULL)
+    {
+        s << "static long " << fn->name << "(void)";
+        return s.str();
+    }
+
+    if (type != NULL && type->elementType != NULL)
+        s << "static void ";
+    else if (type == kRealType)
+        s << "static double ";
+    else
+        s << "static long ";
+
+    s << fn->name << "(struct " << fn->parent->name << "_frame *up";
+    if (ReturnsArray(fn->info))
+        s << ", komp_word *result";
+    for (i = 0; i < fn->parameters.size(); i++)
+    {
+        if (IsArray(fn->parameters[i]))
+            s << ", const komp_word *a_";
+        else
+            s << ", " << (fn->parameters[i]->type == kRealType ? "double"
+                                                               : "long")
+              << " a_";
+        s << Identifier(fn->parameters[i]->id);
+    }
+    s << ')';
+
+    return s.str();
+}
+
+
+/*
+ * CGenerator::Generate
+ *
+ * Generate the body of one function. Quads become one statement each;
+ * the declarations of temporaries and argument slots are collected on
+ * the way and printed first.
+ */
+
+static const char *BinaryOperator(tQuadType op)
+{
+    switch (op)
+    {
+    case radd: return " + ";
+    case rsub: return " - ";
+    case rmul: return " * ";
+    case rdiv: return " / ";
+    case igt:
+    case rgt:  return " > ";
+    case ilt:
+    case rlt:  return " < ";
+    case ieq:
+    case req:  return " == ";
+    case ile:
+    case rle:  return " <= ";
+    case ige:
+    case rge:  return " >= ";
+    case ine:
+    case rne:  return " != ";
+    case iand: return " && ";
+    case ior:  return " || ";
+    default:   return NULL;
+    }
+}
+
+void CGenerator::Generate(CFunction *fn)
+{
+    std::ostringstream                  body, argument;
+    std::vector<std::string>            declarations;
+    std::vector<std::string>            pending;
+    std::set<VariableInformation *>     declared;
+    VariableInformation                *a, *b, *c, *vars[3];
+    FunctionInformation                *info;
+    QuadsListIterator                  *iter;
+    CFunction                          *callee;
+    Quad                               *quad;
+    std::string                         args, link;
+    char                                real[64];
+    int                                 depth, i, n;
+    unsigned                            k;
+
+    iter = new QuadsListIterator(fn->info->GetQuads());
+    while (fn->info->GetQuads() != NULL && (quad = iter->Next()) != NULL)
+    {
+        vars[0] = a = quad->sym1 ? quad->sym1->SymbolAsVariable() : NULL;
+        vars[1] = b = quad->sym2 ? quad->sym2->SymbolAsVariable() : NULL;
+        vars[2] = c = quad->sym3 ? quad->sym3->SymbolAsVariable() : NULL;
+
+        for (i = 0; i < 3; i++)
+            if (vars[i] != NULL &&
+                Owner(fn, vars[i], depth) == fn &&
+                depth == 0 &&
+                fn->members.count(vars[i]) == 0 &&
+                declared.count(vars[i]) == 0)
+            {
+                declared.insert(vars[i]);
+                declarations.push_back(Declare(vars[i], Name(vars[i])) +
+                                       (IsArray(vars[i]) ? " = {{0}}"
+                                                         : " = 0"));
+            }
+
+        switch (quad->opcode)
+        {
+        case iconst:
+            body << "    " << Ref(fn, c) << " = ";
+            if (quad->int1 == LONG_MIN)
+                body << "(-9223372036854775807L - 1)";
+            else
+                body << quad->int1 << 'L';
+            body << ";\n";
+            break;
+        case rconst:
+            snprintf(real, sizeof(real), "%a", quad->real1);
+            body << "    " << Ref(fn, c) << " = " << real << ";\n";
+            break;
+        case iaddr:
+            body << "    " << Ref(fn, c)
+                 << " = KOMP_ADDRESS(" << Ref(fn, a) << ");\n";
+            break;
+        case itor:
+            body << "    " << Ref(fn, c) << " = (double)" << Ref(fn, a) << ";\n";
+            break;
+        case rtrunc:
+            body << "    " << Ref(fn, c) << " = (long)" << Ref(fn, a) << ";\n";
+            break;
+        case ineg:
+            body << "    " << Ref(fn, c) << " = KOMP_SUB(0, " << Ref(fn, a) << ");\n";
+            break;
+        case rneg:
+            body << "    " << Ref(fn, c) << " = -" << Ref(fn, a) << ";\n";
+            break;
+        case ishl:
+        case ishr:
+        case imulh:
+            body << "    " << Ref(fn, c) << " = "
+                 << (quad->opcode == ishl ? "KOMP_SHL(" :
+                     quad->opcode == ishr ? "KOMP_SHR(" : "KOMP_MULH(")
+                 << Ref(fn, a) << ", " << quad->int2 << "L);\n";
+            break;
+        case isar:
+            body << "    " << Ref(fn, c) << " = " << Ref(fn, a)
+                 << " >> " << quad->int2 << ";\n";
+            break;
+
+        case iadd:
+        case isub:
+        case imul:
+            body << "    " << Ref(fn, c) << " = "
+                 << (quad->opcode == iadd ? "KOMP_ADD(" :
+                     quad->opcode == isub ? "KOMP_SUB(" : "KOMP_MUL(")
+                 << Ref(fn, a) << ", " << Ref(fn, b) << ");\n";
+            break;
+        case idiv:
+        case ipow:
+        case rpow:
+            body << "    " << Ref(fn, c) << " = "
+                 << (quad->opcode == idiv ? "komp_idiv(" :
+                     quad->opcode == ipow ? "komp_ipow(" : "pow(")
+                 << Ref(fn, a) << ", " << Ref(fn, b) << ");\n";
+            break;
+        case radd: case rsub: case rmul: case rdiv:
+        case igt:  case ilt:  case ieq:
+        case ile:  case ige:  case ine:
+        case rgt:  case rlt:  case req:
+        case rle:  case rge:  case rne:
+        case iand: case ior:
+            body << "    " << Ref(fn, c) << " = " << Ref(fn, a)
+                 << BinaryOperator(quad->opcode) << Ref(fn, b) << ";\n";
+            break;
+        case inot:
+            body << "    " << Ref(fn, c) << " = !" << Ref(fn, a) << ";\n";
+            break;
+
+        case jtrue:
+            body << "    if (" << Ref(fn, b) << ") goto L"
+                 << quad->int1 << ";\n";
+            break;
+        case jfalse:
+            body << "    if (!" << Ref(fn, b) << ") goto L"
+                 << quad->int1 << ";\n";
+            break;
+        case jump:
+            body << "    goto L" << quad->int1 << ";\n";
+            break;
+        case clabel:
+            body << "L" << quad->int1 << ":;\n";
+            break;
+
+        case istore:
+        case rstore:
+            body << "    KOMP_WORD(" << Ref(fn, c) << ")."
+                 << (quad->opcode == istore ? 'i' : 'r')
+                 << " = " << Ref(fn, a) << ";\n";
+            break;
+        case iload:
+        case rload:
+            body << "    " << Ref(fn, c) << " = KOMP_WORD(" << Ref(fn, a)
+                 << ")." << (quad->opcode == iload ? 'i' : 'r') << ";\n";
+            break;
+
+        case creturn:
+            if (IsArray(c))
+                body << "    memcpy(result, " << Ref(fn, c) << ", sizeof(komp_word) * "
+                     << c->type->arrayDimensions << ");\n"
+                     << "    return;\n";
+            else
+                body << "    return " << Ref(fn, c) << ";\n";
+            break;
+
+        case param:
+            argument.str("");
+            argument << 'p' << declarations.size();
+            pending.push_back(argument.str());
+            if (IsArray(a))
+                declarations.push_back("const komp_word *" + argument.str() +
+                                       " = 0");
+            else
+                declarations.push_back(Declare(a, argument.str()) + " = 0");
+            body << "    " << argument.str() << " = " << Ref(fn, a) << ";\n";
+            break;
+
+        case call:
+            info = quad->sym1->SymbolAsFunction();
+            if (info == kIPrintFunction || info == kFPrintFunction)
+            {
+                body << "    " << Ref(fn, c) << " = "
+                     << (info == kIPrintFunction ? "komp_putint("
+                                                 : "komp_putreal(")
+                     << pending.back() << ");\n";
+                pending.pop_back();
+                break;
+            }
+            if (info == kIReadFunction || info == kFReadFunction)
+            {
+                body << "    " << Ref(fn, c) << " = "
+                     << (info == kIReadFunction ? "komp_getint();\n"
+                                                : "komp_getreal();\n");
+                break;
+            }
+
+            callee = Function(info);
+            n = callee->parameters.size();
+            args = Link(fn, callee);
+            if (ReturnsArray(info))
+                args += ", " + Ref(fn, c);
+            for (k = pending.size() - n; k < pending.size(); k++)
+                args += ", " + pending[k];
+            pending.resize(pending.size() - n);
+
+            body << "    ";
+            if (!ReturnsArray(info))
+                body << Ref(fn, c) << " = ";
+            body << callee->name << '(' << args << ");\n";
+            break;
+
+        case iassign:
+        case rassign:
+            body << "    " << Ref(fn, c) << " = " << Ref(fn, a) << ";\n";
+            break;
+        case aassign:
+            body << "    memcpy(" << Ref(fn, c) << ", " << Ref(fn, a)
+                 << ", sizeof(komp_word) * " << quad->int2 << ");\n";
+            break;
+
+        case nop:
+            break;
+        case hcf:
+        default:
+            body << "    komp_error(\"hcf instruction executed\");\n";
+            break;
+        }
+    }
+    delete iter;
+
+    o << '\n' << Prototype(fn) << "\n{\n";
+    o << "    struct " << fn->name << "_frame f;\n";
+    for (k = 0; k < declarations.size(); k++)
+        o << "    " << declarations[k] << ";\n";
+    o << '\n';
+    o << "    memset(&f, 0, sizeof(f));\n";
+    if (fn->parent != NULL)
+        o << "    f.up = up;\n";
+    for (k = 0; k < fn->parameters.size(); k++)
+    {
+        a = fn->parameters[k];
+        if (IsArray(a))
+            o << "    memcpy(f." << Name(a) << ", a_" << Identifier(a->id)
+              << ", sizeof(f." << Name(a) << "));\n";
+        else
+            o << "    f." << Name(a) << " = a_" << Identifier(a->id) << ";\n";
+    }
+    o << '\n' << body.str() << '\n';
+
+    if (ReturnsArray(fn->info))
+        o << "    return;\n";
+    else
+        o << "    return 0;\n";
+    o << "}\n";
+}
+
+
+/*
+ * CGenerator::Generate
+ *
+ * Generate the whole translation unit: the prelude, the frame
+ * structs, prototypes for every function, the functions and main.
+ */
+
+void CGenerator::Generate(FunctionInformation *program)
+{
+    CFunction  *fn;
+    unsigned    i, j;
+
+    Function(program);
+    for (i = 0; i < order.size(); i++)
+    {
+        QuadsListIterator   iter(order[i]->info->GetQuads());
+        Quad               *quad;
+
+        while (order[i]->info->GetQuads() != NULL &&
+               (quad = iter.Next()) != NULL)
+            if (quad->opcode == call &&
+                quad->sym1->SymbolAsFunction()->GetQuads() != NULL)
+                Function(quad->sym1->SymbolAsFunction());
+    }
+
+    o << prelude;
+
+    o << '\n';
+    for (i = 0; i < order.size(); i++)
+        o << "struct " << order[i]->name << "_frame;\n";
+
+    for (i = 0; i < order.size(); i++)
+    {
+        fn = order[i];
+        o << "\nstruct " << fn->name << "_frame\n{\n";
+        if (fn->parent != NULL)
+            o << "    struct " << fn->parent->name << "_frame *up;\n";
+        else
+            o << "    void *up;\n";
+        for (j = 0; j < fn->parameters.size(); j++)
+            o << "    " << Declare(fn->parameters[j], Name(fn->parameters[j]))
+              << ";\n";
+        for (j = 0; j < fn->locals.size(); j++)
+            o << "    " << Declare(fn->locals[j], Name(fn->locals[j]))
+              << ";\n";
+        o << "};\n";
+    }
+
+    o << '\n';
+    for (i = 0; i < order.size(); i++)
+        o << Prototype(order[i]) << ";\n";
+
+    for (i = 0; i < order.size(); i++)
+        Generate(order[i]);
+
+    o << "\nint main(void)\n{\n"
+      << "    " << order[0]->name << "();\n"
+      << "    return 0;\n"
+      << "}\n";
+}
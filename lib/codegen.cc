@@ -1,5 +1,7 @@
 #include <iostream>
 #include <iomanip>
+#include <cstdlib>
+#include <cstring>
 
 #include <ast.hh>
 #include <symtab.hh>
@@ -8,750 +10,911 @@
 
 long QuadsList::labelCounter;
 
-#define USEQ { QuadsList *xyzzy = &q; xyzzy=xyzzy; }
-
 
 /*
- * ASTNode::GenerateCodeAndJump
+ * FlatAST::GenerateCode
  *
- * GenerateCodeAndJump is supposed to generate quads for part of the
- * parse tree, but ensure that all exits from the code end up at a
- * particular label. This is easy to do for most parts of the parse
- * tree: just generate the code in the usual manner, then jump to the
- * label.
+ * Generate quads for the whole function body. The tree is walked by
+ * switching on the kind of each node; statement lists, if branches
+ * and argument lists are walked in order through the list array.
  */
 
-
-VariableInformation *ASTNode::GenerateCodeAndJump(QuadsList& q,
-                                                  long label)
+void FlatAST::GenerateCode(QuadsList& q)
 {
-    VariableInformation *info;
-
-    info = this->GenerateCode(q);
-    q += new Quad(jump, label,
-                  (SymbolInformation *)NULL, (SymbolInformation *)NULL);
-
-    return info;
+    GenerateCode(q, root);
 }
 
-void GenerateConditionalStatements(QuadsList& q, Condition* condition, StatementList* statements, long endLabel) {
-  long endStatementsLabel = q.NextLabel();
-  VariableInformation* cond = condition->GenerateCode(q);
+VariableInformation *FlatAST::GenerateCode(QuadsList& q, unsigned int n)
+{
+    FlatNode                           *node;
+    VariableInformation                *info, *result;
+    VariableInformation                *base, *address, *offset;
+    std::vector<VariableInformation *>  params;
+    long                                label, endLabel;
+    unsigned int                        i;
+
+    if (n == FLAT_NONE)
+        return NULL;
+
+    node = &nodes[n];
+    switch (node->kind)
+    {
+    case kStatementList:
+        for (i = 0; i < node->b; i++)
+            GenerateCode(q, lists[node->a + i]);
+        return NULL;
+
+    //
+    // If statements test each branch's condition in turn. A branch
+    // whose condition is false jumps to the next test; one whose
+    // condition is true runs its body and jumps past the rest.
+    //
+
+    case kIfStatement:
+        endLabel = q.NextLabel();
+        for (i = 0; i < node->b; i++)
+        {
+            label = q.NextLabel();
+            GenerateCondition(q, lists[node->a + 2 * i], NO_LABEL, label);
+            GenerateCode(q, lists[node->a + 2 * i + 1]);
+            q += Quad(jump, endLabel, NULL, NULL);
+            q += Quad(clabel, label, NULL, NULL);
+        }
+        GenerateCode(q, node->c);
+        q += Quad(clabel, endLabel, NULL, NULL);
+        return NULL;
+
+    //
+    // While statements are rotated: the condition is tested once on
+    // the way in, jumping to label "exit" if it is false, and then
+    // again after the body, jumping back to label "body" if it is
+    // true. An iteration takes one jump instead of two.
+    //
+
+    case kWhileStatement:
+        label = q.NextLabel();
+        endLabel = q.NextLabel();
+        GenerateCondition(q, node->a, NO_LABEL, endLabel);
+        q += Quad(clabel, label, NULL, NULL);
+        GenerateCode(q, node->b);
+        GenerateCondition(q, node->a, label, NO_LABEL);
+        q += Quad(clabel, endLabel, NULL, NULL);
+        return NULL;
+
+    //
+    // Assignments generate code for the value first, then let
+    // GenerateAssignment store it in the target.
+    //
+
+    case kAssignment:
+        info = GenerateCode(q, node->b);
+        GenerateAssignment(q, node->a, info);
+        return NULL;
+
+    case kCallStatement:
+        return GenerateCode(q, node->a);
+
+    case kReturnStatement:
+        info = GenerateCode(q, node->a);
+        if (info == NULL || info->type != currentFunction->GetReturnType())
+        {
+            std::cerr << "Bug: you forgot to typecheck return statements.\n";
+            abort();
+        }
+        q += Quad(creturn,
+                  static_cast<SymbolInformation*>(NULL),
+                  static_cast<SymbolInformation*>(NULL),
+                  info);
+        return NULL;
+
+    //
+    // Function calls push the arguments in order, checking each
+    // against the corresponding parameter, then call the function.
+    //
+
+    case kFunctionCall:
+        for (info = node->value.function->GetLastParam();
+             info != NULL;
+             info = info->prev)
+            params.push_back(info);
+        if (params.size() != node->b)
+        {
+            std::cerr << "Bug: type checking of function params isn't good enough.\n";
+            abort();
+        }
+        for (i = 0; i < node->b; i++)
+        {
+            info = GenerateCode(q, lists[node->a + i]);
+            if (nodes[lists[node->a + i]].type != params[node->b - 1 - i]->type)
+            {
+                std::cerr << "Bug: type checking of function params isn't good enough.\n";
+                abort();
+            }
+            q += Quad(param,
+                      info,
+                      static_cast<SymbolInformation*>(NULL),
+                      static_cast<SymbolInformation*>(NULL));
+        }
+        result = currentFunction->TemporaryVariable(node->value.function->GetReturnType());
+        q += Quad(call,
+                  node->value.function,
+                  static_cast<SymbolInformation*>(NULL),
+                  result);
+        return result;
+
+    //
+    // Constants are loaded into a temporary with iconst or rconst.
+    //
+
+    case kIntegerConstant:
+    case kBooleanConstant:
+        result = currentFunction->TemporaryVariable(kIntegerType);
+        q += Quad(iconst, node->value.integer, NULL, result);
+        return result;
+
+    case kRealConstant:
+        result = currentFunction->TemporaryVariable(kRealType);
+        q += Quad(rconst, node->value.real, NULL, result);
+        return result;
+
+    //
+    // Identifiers need no code at all; the variable is the result.
+    //
+
+    case kIdentifier:
+        return node->value.variable;
+
+    //
+    // Arrays are stored in memory, and the variable holds the address
+    // of the first element. Elements are loaded from the base address
+    // plus the index.
+    //
+
+    case kArrayReference:
+        base = currentFunction->TemporaryVariable(kIntegerType);
+        address = currentFunction->TemporaryVariable(kIntegerType);
+        result = currentFunction->TemporaryVariable(node->value.variable->type->elementType);
+        offset = GenerateCode(q, node->a);
+
+        q += Quad(iaddr, node->value.variable, (SymbolInformation *)NULL, base);
+        q += Quad(iadd, base, offset, address);
+        if (result->type == kIntegerType)
+            q += Quad(iload, address, (SymbolInformation *)NULL, result);
+        else if (result->type == kRealType)
+            q += Quad(rload, address, (SymbolInformation *)NULL, result);
+        return result;
+
+    case kIntegerToReal:
+        if (nodes[node->a].type != kIntegerType)
+        {
+            std::cerr << "Bug: you're trying to convert a non-integer to a real.\n";
+        }
+        result = currentFunction->TemporaryVariable(kRealType);
+        info = GenerateCode(q, node->a);
+        q += Quad(itor, info, static_cast<SymbolInformation*>(NULL), result);
+        return result;
+
+    case kTruncateReal:
+        if (nodes[node->a].type != kRealType)
+        {
+            std::cerr << "Bug: you're trying to truncate a non-real.\n";
+        }
+        result = currentFunction->TemporaryVariable(kIntegerType);
+        info = GenerateCode(q, node->a);
+        q += Quad(rtrunc, info, static_cast<SymbolInformation*>(NULL), result);
+        return result;
+
+    case kPlus:
+        return GenerateBinary(q, n, radd, iadd, NULL);
+    case kMinus:
+        return GenerateBinary(q, n, rsub, isub, NULL);
+    case kTimes:
+        return GenerateBinary(q, n, rmul, imul, NULL);
+    case kDivide:
+        return GenerateBinary(q, n, rdiv, idiv, NULL);
+    case kPower:
+        return GenerateBinary(q, n, rpow, ipow, NULL);
+
+    case kUnaryMinus:
+        info = GenerateCode(q, node->a);
+        result = currentFunction->TemporaryVariable(info->type);
+
+        if (info->type == kIntegerType)
+            q += Quad(ineg, info, static_cast<SymbolInformation*>(NULL), result);
+        else if (info->type == kRealType)
+            q += Quad(rneg, info, static_cast<SymbolInformation*>(NULL), result);
+        else
+        {
+            std::cerr << "Bug: unary minus of a non-numeric type.\n";
+            abort();
+        }
+        return result;
+
+    //
+    // Relations use the same code as the binary operators, with one
+    // comparison quad each.
+    //
+
+    case kLessThan:
+        return GenerateBinary(q, n, rlt, ilt, kIntegerType);
+    case kGreaterThan:
+        return GenerateBinary(q, n, rgt, igt, kIntegerType);
+    case kEqual:
+        return GenerateBinary(q, n, req, ieq, kIntegerType);
+    case kLessThanOrEqual:
+        return GenerateBinary(q, n, rle, ile, kIntegerType);
+    case kGreaterThanOrEqual:
+        return GenerateBinary(q, n, rge, ige, kIntegerType);
+    case kNotEqual:
+        return GenerateBinary(q, n, rne, ine, kIntegerType);
+
+    //
+    // If and while statements compile their conditions to jumps with
+    // GenerateCondition. Only a condition used as a value ends up
+    // here, and then the logical connectives evaluate both operands.
+    //
+
+    case kAnd:
+        return GenerateBinary(q, n, hcf, iand, kIntegerType);
+    case kOr:
+        return GenerateBinary(q, n, hcf, ior, kIntegerType);
+
+    case kNot:
+        info = GenerateCode(q, node->a);
+        if (info->type != kIntegerType)
+        {
+            std::cerr << "Bug: not operator applied to a non-integer.\n";
+            abort();
+        }
+        result = currentFunction->TemporaryVariable(kIntegerType);
+        q += Quad(inot, info, static_cast<SymbolInformation*>(NULL), result);
+        return result;
 
-  q += new Quad(jfalse, endStatementsLabel, cond, NULL);
-  statements->GenerateCode(q);
-  q += new Quad(jump, endLabel, NULL, NULL);
-  q += new Quad(clabel, endStatementsLabel, NULL, NULL);
+    default:
+        std::cerr << "Bug: can't generate code for a "
+                  << ASTNodeName((ASTNodeType)node->kind) << ".\n";
+        abort();
+    }
 }
 
 
-
-/* ElseIfStatement::GenerateCodeAndJump
+/*
+ * FlatAST::GenerateCondition
  *
- * Write the function that generates code for the elseif branches of
- * an if statement. There are a couple of things to watch out for.
- * The conditions must be tested in the correct order, or the program
- * might misbehave. Once a condition tests true, do not test any more
- * conditions (that's why we use GenerateCodeAndJump for this type
- * of statement.)
+ * Generate jump code for the condition at index n: control goes to
+ * trueLabel if the condition holds and to falseLabel if it does not.
+ * Either label, but not both, may be NO_LABEL, in which case control
+ * falls through to the code that follows instead of jumping. And and
+ * or skip their right operand as soon as the left one decides the
+ * result, and not just swaps the targets, so no truth values are
+ * computed except by the comparisons themselves. Each comparison is
+ * a single quad that the jump after it tests directly.
  */
 
-VariableInformation *ElseIfList::GenerateCodeAndJump(QuadsList &q,
-                                                     long endLabel)
+void FlatAST::GenerateCondition(QuadsList& q, unsigned int n,
+                                long trueLabel, long falseLabel)
 {
-  /* --- Your code here --- */
-  if(preceding != NULL) {
-    preceding->GenerateCodeAndJump(q, endLabel);
-  }
-
-  GenerateConditionalStatements(q, condition, body, endLabel);
-  /* --- End your code --- */
-
-  return NULL;
-}
+    FlatNode            *node;
+    VariableInformation *info;
+    long                 label;
 
+    node = &nodes[n];
+    switch (node->kind)
+    {
+    case kAnd:
+        if (falseLabel == NO_LABEL)
+        {
+            label = q.NextLabel();
+            GenerateCondition(q, node->a, NO_LABEL, label);
+            GenerateCondition(q, node->b, trueLabel, NO_LABEL);
+            q += Quad(clabel, label, NULL, NULL);
+        }
+        else
+        {
+            GenerateCondition(q, node->a, NO_LABEL, falseLabel);
+            GenerateCondition(q, node->b, trueLabel, falseLabel);
+        }
+        break;
 
-/*
- * ArrayReference::GenerateAssignment
- *
- * Generate assignment code for an array reference. See the comment
- * before Assignment::GenerateCode for more information.
- */
+    case kOr:
+        if (trueLabel == NO_LABEL)
+        {
+            label = q.NextLabel();
+            GenerateCondition(q, node->a, label, NO_LABEL);
+            GenerateCondition(q, node->b, NO_LABEL, falseLabel);
+            q += Quad(clabel, label, NULL, NULL);
+        }
+        else
+        {
+            GenerateCondition(q, node->a, trueLabel, NO_LABEL);
+            GenerateCondition(q, node->b, trueLabel, falseLabel);
+        }
+        break;
 
-void ArrayReference::GenerateAssignment(QuadsList& q,
-                                        VariableInformation *val)
-{
-  /* --- Your code here --- */
-  if(id->type->elementType == kIntegerType) {
-    q += new Quad(iassign, val, NULL, id);
-  } else if(id->type->elementType == kRealType) {
-    q += new Quad(rassign, val, NULL, id);
-  }
-  /* --- End your code --- */
-}
+    case kNot:
+        GenerateCondition(q, node->a, falseLabel, trueLabel);
+        break;
 
-/*
- * Identifier::GenerateAssignment
- *
- * Generate assignment code for an identifier. See the comment
- * before Assignment::GenerateCode for more information.
- */
+    case kBooleanConstant:
+        label = node->value.integer ? trueLabel : falseLabel;
+        if (label != NO_LABEL)
+            q += Quad(jump, label, NULL, NULL);
+        break;
 
-void Identifier::GenerateAssignment(QuadsList& q, VariableInformation *val)
-{
-    if (val->type == NULL || id->type == NULL)
-    {
-        std::cerr << "Bug: you created an untyped variable.\n";
-        abort();
-    }
-    if (id->type == kIntegerType)
-    {
-        q += new Quad(iassign,
-		      dynamic_cast<SymbolInformation*>(val),
-		      static_cast<SymbolInformation*>(NULL),
-		      dynamic_cast<SymbolInformation*>(id));
-    }
-    else if (id->type == kRealType)
-    {
-        q += new Quad(rassign,
-		      dynamic_cast<SymbolInformation*>(val),
-		      static_cast<SymbolInformation*>(NULL),
-		      dynamic_cast<SymbolInformation*>(id));
-    }
-    else if (id->type == val->type)
-    {
-        q += new Quad(aassign, val, val->type->arrayDimensions, id);
+    default:
+        info = GenerateCode(q, n);
+        if (trueLabel == NO_LABEL)
+        {
+            q += Quad(jfalse, falseLabel, info, NULL);
+        }
+        else
+        {
+            q += Quad(jtrue, trueLabel, info, NULL);
+            if (falseLabel != NO_LABEL)
+                q += Quad(jump, falseLabel, NULL, NULL);
+        }
+        break;
     }
 }
 
 
 /*
- * StatementList::GenerateCode
+ * FlatAST::GenerateBinary
  *
- * Generate code for a list of statements. Make sure the code comes
- * out in the right order.
+ * Generate code for the binary operator or relation at index n. The
+ * arguments are the following:
  *
- * Note: The impelementation here is absolutely ridiculous since it
- * uses stack space proportional to the number of statements in the
- * list. A more sensible definition would simply iterate down the
- * list. This code is an example of what happens when someone with a
- * degree in computer science is allowed to write code without regard
- * for efficiency...
+ * q        The QuadsList onto which the generated code is placed.
+ * n        The operator node. Its children must have the same type.
+ * realop   The quad to generate for the operator if the arguments
+ *          are of type real.
+ * intop    The quad to generate for the operator if the arguments
+ *          are of type integer.
+ * type     If not NULL, this is the type of the result. This is
+ *          used for relations, where the type of the result is
+ *          always integer, even if the operands are real. If this
+ *          parameter is NULL, then the type of the result is the
+ *          same as the type of the operands.
  */
 
-VariableInformation *StatementList::GenerateCode(QuadsList &q)
+VariableInformation *FlatAST::GenerateBinary(QuadsList& q,
+                                             unsigned int n,
+                                             tQuadType realop,
+                                             tQuadType intop,
+                                             TypeInformation *type)
 {
-    if (precedingStatements != NULL)
+    VariableInformation *leftInfo, *rightInfo, *result = NULL;
+
+    leftInfo = GenerateCode(q, nodes[n].a);
+    rightInfo = GenerateCode(q, nodes[n].b);
+
+    if (leftInfo->type == kIntegerType && rightInfo->type == kIntegerType)
+    {
+        result = currentFunction->TemporaryVariable(type == NULL ? kIntegerType : type);
+        q += Quad(intop, leftInfo, rightInfo, result);
+    }
+    else if (leftInfo->type == kRealType && rightInfo->type == kRealType)
     {
-        precedingStatements->GenerateCode(q);
+        result = currentFunction->TemporaryVariable(type == NULL ? kRealType : type);
+        q += Quad(realop, leftInfo, rightInfo, result);
     }
-    return statement->GenerateCode(q);
+
+    return result;
 }
 
 
 /*
- * IfStatement::GenerateCode
+ * FlatAST::GenerateAssignment
  *
- * If statements, particularly those with elseif branches are actually
- * quite involved. They tend to use a lot of jumps. For the elseif
- * branches you'll probably want to use the GenerateCodeAndJump method
- * of ElseIfStatement (which you're also supposed to write.)
+ * Generate code to store val in the target at index n, which is an
+ * identifier or an array reference.
  */
 
-VariableInformation *IfStatement::GenerateCode(QuadsList& q)
+void FlatAST::GenerateAssignment(QuadsList& q, unsigned int n,
+                                 VariableInformation *val)
 {
-  /* --- Your code here ---*/
-  long endIfLabel = q.NextLabel();
-  GenerateConditionalStatements(q, condition, thenStatements, endIfLabel);
+    FlatNode            *node;
+    VariableInformation *id, *base, *address, *offset;
 
-  if(elseIfList != NULL) {
-    elseIfList->GenerateCodeAndJump(q, endIfLabel);
-  }
+    node = &nodes[n];
+    id = node->value.variable;
 
-  if(elseStatements != NULL) {
-    elseStatements->GenerateCode(q);
-  }
+    if (node->kind == kArrayReference)
+    {
+        base = currentFunction->TemporaryVariable(kIntegerType);
+        address = currentFunction->TemporaryVariable(kIntegerType);
+        offset = GenerateCode(q, node->a);
 
-  q += new Quad(clabel, endIfLabel, NULL, NULL);
+        q += Quad(iaddr, id, (SymbolInformation *)NULL, base);
+        q += Quad(iadd, base, offset, address);
 
-  /* --- End your code --- */
-  return NULL;;
+        if (id->type->elementType == kIntegerType)
+            q += Quad(istore, val, (SymbolInformation *)NULL, address);
+        else if (id->type->elementType == kRealType)
+            q += Quad(rstore, val, (SymbolInformation *)NULL, address);
+    }
+    else if (node->kind == kIdentifier)
+    {
+        if (val->type == NULL || id->type == NULL)
+        {
+            std::cerr << "Bug: you created an untyped variable.\n";
+            abort();
+        }
+        if (id->type == kIntegerType)
+            q += Quad(iassign, val, static_cast<SymbolInformation*>(NULL), id);
+        else if (id->type == kRealType)
+            q += Quad(rassign, val, static_cast<SymbolInformation*>(NULL), id);
+        else if (id->type == val->type)
+            q += Quad(aassign, val, val->type->arrayDimensions, id);
+    }
+    else
+    {
+        std::cerr << "Bug: assignment to a "
+                  << ASTNodeName((ASTNodeType)node->kind) << ".\n";
+        abort();
+    }
 }
 
 
+/* ======================================================================
+ * Quads and Quads Lists
+ */
+
 /*
- * ElseIfList::GenerateCode
+ * QuadsList::Link
+ * QuadsList::Unlink
  *
- * You might figure out a way to write IfStatement::GenerateCode
- * without relying on ElseIfStatement::GenerateCodeAndJump. If so,
- * this method is where you should generate the code for the elseif
- * part. Just remove the error message and call to abort.
+ * Link inserts the chain of quads from first to last after the quad
+ * at index after, or at the head of the list if after is -1. Unlink
+ * removes the chain from first to last from the list.
  */
 
-VariableInformation *ElseIfList::GenerateCode(QuadsList& q)
+void QuadsList::Link(long first, long last, long after)
 {
-  USEQ;
-  /* --- Your code here --- */
-  /* --- End your code --- */
+    long    before;
 
-  return NULL;
-}
+    before = after < 0 ? head : next[after];
 
+    prev[first] = after;
+    next[last] = before;
+    if (after < 0)
+        head = first;
+    else
+        next[after] = first;
+    if (before < 0)
+        tail = last;
+    else
+        prev[before] = last;
+}
 
-/*
- * WhileStatement::GenerateCode
- *
- * Generate code for a while statement. This is pretty easy.
- * Insert a label "entry", generate code for the condition, jump to
- * label "exit" if the condition is false, insert the body and jump
- * back to "entry". Finally insert the label "exit".
- */
-
-VariableInformation *WhileStatement::GenerateCode(QuadsList &q)
+void QuadsList::Unlink(long first, long last)
 {
-    long                 loopLabel, endLabel;
-    VariableInformation *info;
-
-    loopLabel = q.NextLabel();
-    endLabel = q.NextLabel();
-    q += new Quad(clabel, loopLabel, NULL, NULL);
-    info = condition->GenerateCode(q);
-    q += new Quad(jfalse, endLabel, info, NULL);
-    body->GenerateCodeAndJump(q, loopLabel);
-    q += new Quad(clabel, endLabel, NULL, NULL);
+    if (prev[first] < 0)
+        head = next[last];
+    else
+        next[prev[first]] = next[last];
+    if (next[last] < 0)
+        tail = prev[first];
+    else
+        prev[next[last]] = prev[first];
 
-    return NULL;
+    prev[first] = -1;
+    next[last] = -1;
 }
 
 
 /*
- * IntegerConstant::GenerateCode
- * RealConstant::GenerateCode
- * BooleanConstant::GenerateCode
+ * QuadsList::Append
+ * QuadsList::InsertAfter
+ * QuadsList::InsertBefore
  *
- * Simply uses the iconst/rconst quads to load the constant (which is
- * stored in the parse tree into a temporary register.
+ * Add a quad to the list and return its index.
  */
 
-VariableInformation *IntegerConstant::GenerateCode(QuadsList& q)
+long QuadsList::Append(const Quad& q)
 {
-    VariableInformation *info =
-        currentFunction->TemporaryVariable(kIntegerType);
-
-    q += new Quad(iconst, value, NULL, info);
-    return info;
+    return InsertAfter(tail, q);
 }
 
-VariableInformation *RealConstant::GenerateCode(QuadsList& q)
+long QuadsList::InsertAfter(long after, const Quad& q)
 {
-    VariableInformation *info =
-        currentFunction->TemporaryVariable(kRealType);
+    long    index = quads.size();
+
+    quads.push_back(Pack(q));
+    next.push_back(-1);
+    prev.push_back(-1);
+    Link(index, index, after);
+    count += 1;
 
-    q += new Quad(rconst, value, NULL, info);
-    return info;
+    return index;
 }
 
-VariableInformation *BooleanConstant::GenerateCode(QuadsList& q)
+long QuadsList::InsertBefore(long before, const Quad& q)
 {
-    VariableInformation *info =
-        currentFunction->TemporaryVariable(kIntegerType);
-
-    q += new Quad(iconst, value ? 1L : 0L, NULL, info);
-    return info;
+    return InsertAfter(before < 0 ? tail : prev[before], q);
 }
 
 
 /*
- * ArrayReference::GenerateCode
+ * QuadsList::Replace
  *
- * Arrays are stored in memory, but the address to the first element
- * in the array is stored in a variable (the id instance variable in
- * the ArrayReference object.) Since we don't have a quad to do this
- * for us, you'll have to use lower-level operations. Hint: the size
- * field in the TypeInformation class will come in handy.
+ * Replace the quad at an index, keeping its place in the list.
  */
 
-VariableInformation *ArrayReference::GenerateCode(QuadsList& q)
+void QuadsList::Replace(long index, const Quad& q)
 {
-  /* --- Your code here --- */
-  VariableInformation* base =
-    currentFunction->TemporaryVariable(kIntegerType);
-  VariableInformation* address =
-    currentFunction->TemporaryVariable(kIntegerType);
-  VariableInformation* variable =
-    currentFunction->TemporaryVariable(id->type->elementType);
-  VariableInformation* offset = index->GenerateCode(q);
-
-
-  q += new Quad(iaddr, id, NULL, base);
-  q += new Quad(iadd, base, offset, address);
-
-  if(variable->type == kIntegerType) {
-    q += new Quad(iload, address, NULL, variable);
-  } else if(variable->type == kRealType) {
-    q += new Quad(rload, address, NULL, variable);
-  }
-
-  return variable;
-  /* --- End your code --- */
+    quads[index] = Pack(q);
 }
 
+
 /*
- * Identifier::GenerateCode
+ * QuadsList::Remove
  *
- * Generate code to get the value of an identifier. Actually, we don't
- * need to generate any code at all. We just return the identifier.
+ * Unlink a quad. Its index is never reused.
  */
 
-VariableInformation *Identifier::GenerateCode(QuadsList& q)
+void QuadsList::Remove(long index)
 {
-    USEQ;
-
-    return id;
+    Unlink(index, index);
+    count -= 1;
 }
 
+
 /*
- * ReturnStatement::GenerateCode
+ * QuadsList::Move
  *
- * Generate code for a return statement. This is really
- * straightforward.
+ * Move the run of quads from first to last, inclusive, so that it
+ * follows the quad at index after (or starts the list if after is
+ * -1). after must not be inside the run.
  */
 
-VariableInformation *ReturnStatement::GenerateCode(QuadsList &q)
+void QuadsList::Move(long first, long last, long after)
 {
-    VariableInformation     *info;
+    Unlink(first, last);
+    Link(first, last, after);
+}
 
-    info = value->GenerateCode(q);
-    if (info->type != currentFunction->GetReturnType())
-    {
-        std::cerr << "Bug: you forgot to typecheck return statements.\n";
-        abort();
-    }
 
-    q += new Quad(creturn,
-		  static_cast<SymbolInformation*>(NULL),
-		  static_cast<SymbolInformation*>(NULL),
-		  dynamic_cast<SymbolInformation*>(info));
+//
+// Operand layout of each quad type: s for a symbol, i for an integer
+// constant, r for a real constant, l for a label and - for nothing.
+//
 
-    return NULL;
-}
+static const char *quadLayout[] =
+{
+    "i-s",      // iconst
+    "r-s",      // rconst
+    "s-s",      // iaddr
+    "s-s",      // itor
+    "s-s",      // rtrunc
+    "sss",      // iadd
+    "sss",      // isub
+    "sss",      // imul
+    "sss",      // idiv
+    "sss",      // ipow
+    "sss",      // radd
+    "sss",      // rsub
+    "sss",      // rmul
+    "sss",      // rdiv
+    "sss",      // rpow
+    "s-s",      // ineg
+    "s-s",      // rneg
+    "sis",      // ishl
+    "sis",      // isar
+    "sis",      // ishr
+    "sis",      // imulh
+    "sss",      // igt
+    "sss",      // ilt
+    "sss",      // ieq
+    "sss",      // rgt
+    "sss",      // rlt
+    "sss",      // req
+    "sss",      // ile
+    "sss",      // ige
+    "sss",      // ine
+    "sss",      // rle
+    "sss",      // rge
+    "sss",      // rne
+    "sss",      // iand
+    "sss",      // ior
+    "s-s",      // inot
+    "ls-",      // jtrue
+    "ls-",      // jfalse
+    "l--",      // jump
+    "l--",      // clabel
+    "s-s",      // istore
+    "s-s",      // iload
+    "s-s",      // rstore
+    "s-s",      // rload
+    "--s",      // creturn
+    "s--",      // param
+    "s-s",      // call
+    "s-s",      // iassign
+    "s-s",      // rassign
+    "sis",      // aassign
+    "---",      // hcf
+    "---",      // nop
+};
 
 
 /*
- * ExpressionList::GenerateCode
+ * QuadsList::Enter
  *
- * Whoa! If you call this, you're doing something very wrong!
- * Expression lists are currently only used in the parameter
- * list of a function call, but we might want to use them in
- * other places too, such as in an initializer for an array.
+ * Find or add an operand in the table for its tag and return the
+ * tagged operand that refers to it.
  */
 
-VariableInformation *ExpressionList::GenerateCode(QuadsList& q)
+unsigned int QuadsList::Enter(tOperandTag tag,
+                              SymbolInformation *sym,
+                              long i,
+                              double r)
 {
-    USEQ;
-
-    std::cerr << "Bug: can't generate code for an ExpressionList.\n";
-    abort();
-}
+    std::pair<int, long>    key;
+    unsigned int            index;
 
-void ExpressionList::GenerateParameterList(QuadsList &q,
-                                           VariableInformation *lastParam)
-{
-    VariableInformation *info;
-
-    if (lastParam == NULL ||
-        (lastParam->prev != NULL && precedingExpressions == NULL))
+    key.first = tag;
+    switch (tag)
     {
-        std::cerr << "Bug: type checking of function params isn't good enough.\n";
-        abort();
+    case qsymbol:
+        key.second = (long)sym;
+        break;
+    case qreal:
+        memcpy(&key.second, &r, sizeof(long));
+        break;
+    default:
+        key.second = i;
+        break;
     }
 
-    if (precedingExpressions)
-        precedingExpressions->GenerateParameterList(q, lastParam->prev);
-
-    info = expression->GenerateCode(q);
+    std::map<std::pair<int, long>, unsigned int>::iterator found =
+        entries.find(key);
+    if (found != entries.end())
+        return found->second;
 
-
-    if (expression->valueType == lastParam->type)
+    switch (tag)
     {
-        q += new Quad(param,
-		      dynamic_cast<SymbolInformation*>(info),
-		      static_cast<SymbolInformation*>(NULL),
-		      static_cast<SymbolInformation*>(NULL));
+    case qsymbol:
+        index = symbols.size();
+        symbols.push_back(sym);
+        break;
+    case qinteger:
+        index = integers.size();
+        integers.push_back(i);
+        break;
+    case qreal:
+        index = reals.size();
+        reals.push_back(r);
+        break;
+    case qlabel:
+        index = labels.size();
+        labels.push_back(i);
+        break;
+    default:
+        std::cerr << "Bug: operand without a table\n";
+        abort();
     }
-    else
+
+    if (index > QUAD_INDEX_MASK)
     {
-        std::cerr << "Bug: type checking of function params isn't good enough.\n";
+        std::cerr << "Bug: too many operands in a function\n";
         abort();
     }
-}
-
-
 
+    return entries[key] = ((unsigned int)tag << QUAD_TAG_SHIFT) | index;
+}
 
 
 /*
- * Assignment::GenerateCode
+ * QuadsList::Pack
+ * QuadsList::Unpack
  *
- * Assignments are kind of strange. Normally code generation is done
- * by first generating code for all the children of a node, then
- * adding some code for the node itself. In an assignment we need to
- * do things a little differently. First we generate code for the
- * value, then, since we need to generate very different code
- * depending on what the LValue is, we let the GenerateAssignment
- * method in the LeftValue subclasses generate the actual assignment
- * code.
+ * Convert between the unpacked and the packed form of a quad, using
+ * quadLayout to tell which fields of the unpacked quad are in use.
  */
 
-VariableInformation *Assignment::GenerateCode(QuadsList& q)
+PackedQuad QuadsList::Pack(const Quad& q)
 {
-    VariableInformation     *valueInfo;
-
-    valueInfo = value->GenerateCode(q);
-    target->GenerateAssignment(q, valueInfo);
-
-    return NULL;
-}
+    PackedQuad               p;
+    const char              *layout;
+    SymbolInformation       *sym[3] = { q.sym1, q.sym2, q.sym3 };
+    long                     ints[3] = { q.int1, q.int2, q.int3 };
+    double                   reals[3] = { q.real1, q.real2, q.real3 };
 
-/*
- * IntegerToReal::GenerateCode
- * TruncateReal::GenerateCode
- *
- * This is so straightforward...
- */
+    layout = quadLayout[q.opcode];
+    p.opcode = q.opcode;
 
-VariableInformation *IntegerToReal::GenerateCode(QuadsList& q)
-{
-    VariableInformation *info, *valueInfo;
-
-    if (value->valueType != kIntegerType)
+    for (int n = 0; n < 3; n++)
     {
-        std::cerr << "Bug: you're trying to convert a non-integer to a real.\n";
+        switch (layout[n])
+        {
+        case 's':
+            if (sym[n] == NULL)
+                p.operands[n] = (unsigned int)qnone << QUAD_TAG_SHIFT;
+            else if (sym[n]->tag == kVariableInformation &&
+                     ((VariableInformation *)sym[n])->temporary != 0 &&
+                     ((VariableInformation *)sym[n])->temporary <= QUAD_INDEX_MASK)
+                p.operands[n] = ((unsigned int)qtemporary << QUAD_TAG_SHIFT) |
+                    ((VariableInformation *)sym[n])->temporary;
+            else
+                p.operands[n] = Enter(qsymbol, sym[n], 0, 0.0);
+            break;
+        case 'i':
+            p.operands[n] = Enter(qinteger, NULL, ints[n], 0.0);
+            break;
+        case 'r':
+            p.operands[n] = Enter(qreal, NULL, 0, reals[n]);
+            break;
+        case 'l':
+            p.operands[n] = Enter(qlabel, NULL, ints[n], 0.0);
+            break;
+        default:
+            p.operands[n] = (unsigned int)qnone << QUAD_TAG_SHIFT;
+            break;
+        }
     }
 
-    info = currentFunction->TemporaryVariable(kRealType);
-    valueInfo = value->GenerateCode(q);
-    q += new Quad(itor,
-		  dynamic_cast<SymbolInformation*>(valueInfo),
-		  static_cast<SymbolInformation*>(NULL),
-		  dynamic_cast<SymbolInformation*>(info));
-
-    return info;
+    return p;
 }
 
-VariableInformation *TruncateReal::GenerateCode(QuadsList& q)
+void QuadsList::Unpack(unsigned int operand, Quad& q, int n)
 {
-    VariableInformation *info, *valueInfo;
+    SymbolInformation      **sym[3] = { &q.sym1, &q.sym2, &q.sym3 };
+    long                    *ints[3] = { &q.int1, &q.int2, &q.int3 };
+    double                  *reals[3] = { &q.real1, &q.real2, &q.real3 };
+    unsigned int             index = operand & QUAD_INDEX_MASK;
 
-    if (value->valueType != kRealType)
+    switch (operand >> QUAD_TAG_SHIFT)
     {
-        std::cerr << "Bug: you're trying to truncate a non-real.\n";
+    case qsymbol:
+        *sym[n] = symbols[index];
+        break;
+    case qinteger:
+        *ints[n] = integers[index];
+        break;
+    case qreal:
+        *reals[n] = this->reals[index];
+        break;
+    case qlabel:
+        *ints[n] = labels[index];
+        break;
+    case qtemporary:
+        *sym[n] = function->GetTemporary(index);
+        break;
+    default:
+        break;
     }
-
-    info = currentFunction->TemporaryVariable(kIntegerType);
-    valueInfo = value->GenerateCode(q);
-    q += new Quad(rtrunc,
-		  dynamic_cast<SymbolInformation*>(valueInfo),
-		  static_cast<SymbolInformation*>(NULL),
-		  dynamic_cast<SymbolInformation*>(info));
-
-    return info;
-}
-
-/*
- *
- * This function is used to generate code for all kinds of binary
- * operators and relations. The arguments to the function are the
- * following:
- *
- * q        The QuadsList onto which the generated code is placed.
- * realop   The quad to generate for the operator if the arguments
- *          are of type real.
- * intop    The quad to generate for the operator if the arguments
- *          are of type integer.
- * left     The AST for the left-hand side of the operator. The
- *          value type of this AST must be the same as that of the
- *          AST for the right-hand side.
- * right    The AST for the right-hand side of the operator. The
- *          value type of this AST must be the same as that of the
- *          AST for the left-hand side.
- * node     The operator node itself. You probably won't need this
- *          unless you want to print an error message.
- * type     If not NULL, this is the type of the result. This is
- *          used for relations, where the type of the result is
- *          always integer, even if the operands are real. If this
- *          parameter is NULL, then the type of the result is the
- *          same as the type of the operands (the parser needs to
- *          make sure that the operands have the same type.)
- *
- * See the GenerateCode methods for the binary operators for
- * examples of how this function is used.
- *
- */
-
-static VariableInformation *BinaryGenerateCode(QuadsList& q,
-                                               tQuadType realop,
-                                               tQuadType intop,
-                                               ASTNode *left,
-                                               ASTNode *right,
-                                               ASTNode *node,
-                                               TypeInformation *type = NULL)
-{
-  VariableInformation *leftInfo, *rightInfo, *result = NULL;
-  /* --- Your code here --- */
-  leftInfo = left->GenerateCode(q);
-  rightInfo = right->GenerateCode(q);
-
-  if(leftInfo->type == kIntegerType && rightInfo->type == kIntegerType) {
-    result = currentFunction->TemporaryVariable((type == NULL) ? kIntegerType : type);
-    q += new Quad(intop, leftInfo, rightInfo, result);
-  } else if(leftInfo->type == kRealType && rightInfo->type == kRealType) {
-    result = currentFunction->TemporaryVariable((type == NULL) ? kRealType : type);
-    q += new Quad(realop, leftInfo, rightInfo, result);
-  }
-  /* --- End your code --- */
-
-  return result;
-}
-
-/*
- * Plus::GenerateCode
- * Minus::GenerateCode
- * Divide::GenerateCode
- * Times::GenerateCode
- * Power::GenerateCode
- *
- * All these are very similar, so they share a common function defined
- * in this file.
- */
-
-VariableInformation *Plus::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, radd, iadd, left, right, this);
-}
-
-VariableInformation *Minus::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, rsub, isub, left, right, this);
-}
-
-VariableInformation *Times::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, rmul, imul, left, right, this);
-}
-
-VariableInformation *Divide::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, rdiv, idiv, left, right, this);
-}
-
-VariableInformation *Power::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, rpow, ipow, left, right, this);
 }
 
-/*
- * UnaryMinus::GenerateCode
- *
- * Generate code for the value expression, then subtract it from 0
- */
-
-VariableInformation *UnaryMinus::GenerateCode(QuadsList& q)
+Quad QuadsList::Unpack(const PackedQuad& p)
 {
-    VariableInformation *info, *result, *constInfo;
+    Quad    q;
 
-    info = right->GenerateCode(q);
-    result = currentFunction->TemporaryVariable(info->type);
-    constInfo = currentFunction->TemporaryVariable(info->type);
+    q.opcode = (tQuadType)p.opcode;
 
-    if (info->type == kIntegerType)
-    {
-        q += new Quad(iconst, 0L, (SymbolInformation*)NULL, constInfo);
-        q += new Quad(isub, constInfo, info, result);
-    }
-    else if (info->type == kRealType)
-    {
-        q += new Quad(rconst, 0.0, NULL, constInfo);
-        q += new Quad(rsub, constInfo, info, result);
-    }
-    else
-    {
-        std::cerr << "Bug: unary minus of a non-numeric type.\n";
-        abort();
-    }
+    Unpack(p.operands[0], q, 0);
+    Unpack(p.operands[1], q, 1);
+    Unpack(p.operands[2], q, 2);
 
-    return result;
+    return q;
 }
 
 
 /*
- * LessThan::GenerateCode
- * LessThanOrEqual::GenerateCode
- * GreaterThan::GenerateCode
- * GreaterThanOrEqual::GenerateCode
- * Equal::GenerateCode
- * NotEqual::GenerateCode
+ * QuadsList::Bytes
  *
- * To generate code for these relations, we'll use the BinaryGenerateCode
- * function defined for binary operations. We'll also add some more
- * quads for some of the operations.
+ * Return the number of bytes used by the quads, their order and the
+ * operand tables.
  */
 
-VariableInformation *LessThan::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, rlt, ilt, left, right, this, kIntegerType);
-}
-
-VariableInformation *GreaterThan::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, rgt, igt, left, right, this, kIntegerType);
-}
-
-VariableInformation *Equal::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, req, ieq, left, right, this, kIntegerType);
-}
-
-
-VariableInformation *LessThanOrEqual::GenerateCode(QuadsList& q)
-{
-    VariableInformation     *r0, *r1;
-
-    r0 = BinaryGenerateCode(q, rlt, ilt, left, right, this, kIntegerType);
-    r1 = BinaryGenerateCode(q, req, ieq, left, right, this, kIntegerType);
-    q += new Quad(ior, r0, r1, r1);
-
-    return r1;
-}
-
-VariableInformation *GreaterThanOrEqual::GenerateCode(QuadsList& q)
+long QuadsList::Bytes(void)
 {
-    VariableInformation     *r0, *r1;
-
-    r0 = BinaryGenerateCode(q, rgt, igt, left, right, this, kIntegerType);
-    r1 = BinaryGenerateCode(q, req, ieq, left, right, this, kIntegerType);
-    q += new Quad(ior, r0, r1, r1);
-
-    return r1;
-}
-
-VariableInformation *NotEqual::GenerateCode(QuadsList& q)
-{
-    VariableInformation *r0;
-
-    r0 = BinaryGenerateCode(q, req, ieq, left, right, this, kIntegerType);
-    q += new Quad(inot,
-		  dynamic_cast<SymbolInformation*>(r0),
-		  static_cast<SymbolInformation*>(NULL),
-		  dynamic_cast<SymbolInformation*>(r0));
-    return r0;
+    return quads.capacity() * sizeof(PackedQuad) +
+        (next.capacity() + prev.capacity()) * sizeof(int) +
+        symbols.capacity() * sizeof(SymbolInformation *) +
+        integers.capacity() * sizeof(long) +
+        reals.capacity() * sizeof(double) +
+        labels.capacity() * sizeof(long);
 }
 
 
 /*
- * And::GenerateCode
- * Or::GenerateCode
- * Not::Generatecode
+ * Quad::Definition
+ * Quad::Uses
  *
- * The current versions of these functions do not short-circuit the
- * logical connectives and and or. Rewrite them so that the test
- * is aborted as soon as the result is known (for or, as soon as one
- * of the conditions evaluates to true, and for and as soon as one
- * condition evaluates to false.)
+ * Definition returns the variable that the quad assigns, or NULL if
+ * it doesn't assign one. Uses stores the variables whose values the
+ * quad reads in uses, which must have room for two, and returns how
+ * many there are. iaddr counts as using the array whose address it
+ * takes. Memory and the variables a called function may change are
+ * not included.
  */
 
-
-VariableInformation *And::GenerateCode(QuadsList& q)
-{
-    return BinaryGenerateCode(q, hcf, iand, left, right, this, kIntegerType);
-}
-
-VariableInformation *Or::GenerateCode(QuadsList& q)
+VariableInformation *Quad::Definition(void)
 {
-    return BinaryGenerateCode(q, hcf, ior, left, right, this, kIntegerType);
+    switch (opcode)
+    {
+    case jtrue: case jfalse: case jump: case clabel:
+    case istore: case rstore: case creturn: case param:
+    case hcf: case nop:
+        return NULL;
+    default:
+        return sym3 ? sym3->SymbolAsVariable() : NULL;
+    }
 }
 
-VariableInformation *Not::GenerateCode(QuadsList& q)
+int Quad::Uses(VariableInformation **uses)
 {
-    VariableInformation *info, *result;
+    int         n = 0;
 
-    info = right->GenerateCode(q);
-    if (info->type != kIntegerType)
+    switch (opcode)
     {
-        std::cerr << "Bug: not operator applied to a non-integer.\n";
-        abort();
+    case iconst: case rconst: case call:
+    case jump: case clabel: case hcf: case nop:
+        break;
+    case jtrue: case jfalse:
+        uses[n++] = sym2->SymbolAsVariable();
+        break;
+    case creturn:
+        uses[n++] = sym3->SymbolAsVariable();
+        break;
+    case istore: case rstore:
+        uses[n++] = sym1->SymbolAsVariable();
+        uses[n++] = sym3->SymbolAsVariable();
+        break;
+    default:
+        if (sym1 != NULL)
+            uses[n++] = sym1->SymbolAsVariable();
+        if (sym2 != NULL)
+            uses[n++] = sym2->SymbolAsVariable();
+        break;
     }
 
-    result = currentFunction->TemporaryVariable(kIntegerType);
-    q += new Quad(inot,
-		  dynamic_cast<SymbolInformation*>(info),
-		  static_cast<SymbolInformation*>(NULL),
-		  dynamic_cast<SymbolInformation*>(result));
-
-    return result;
+    return n;
 }
 
 /*
- * CallStatement::GenerateCode
- * FunctionCall::GenerateCode
+ * Quad::Pure
  *
- * Generate code for the parameter list by iterating over the
- * actual arguments, then generate the function call itself.
- */
-
-VariableInformation *CallStatement::GenerateCode(QuadsList &q)
-{
-    return call->GenerateCode(q);
-}
-
-VariableInformation *FunctionCall::GenerateCode(QuadsList& q)
-{
-    VariableInformation *info;
-
-    if (arguments)
-        arguments->GenerateParameterList(q, function->GetLastParam());
-    info = currentFunction->TemporaryVariable(function->GetReturnType());
-    q += new Quad(call,
-		  dynamic_cast<SymbolInformation*>(function),
-		  static_cast<SymbolInformation*>(NULL),
-		  dynamic_cast<SymbolInformation*>(info));
-
-    return info;
-}
-
-
-/* ======================================================================
- * Quads and Quads Lists
+ * Returns true if all the quad does is compute its result from its
+ * operands: it can't fail, doesn't touch memory and doesn't jump or
+ * call anything. A pure quad whose result isn't needed can go, and
+ * one whose operands haven't changed gives the same result again.
+ * Integer division is not pure, since it fails on zero, and loads
+ * are not, since they check their address.
  */
 
-QuadsList& QuadsList::operator+=(Quad *q)
+bool Quad::Pure(void)
 {
-    if (head == NULL)
-    {
-        head = new QuadsListElement(q, NULL);
-        tail = head;
-    }
-    else
+    switch (opcode)
     {
-        tail->next = new QuadsListElement(q, NULL);
-        tail = tail->next;
+    case iconst: case rconst: case iaddr: case itor: case rtrunc:
+    case iadd: case isub: case imul: case ipow:
+    case radd: case rsub: case rmul: case rdiv: case rpow:
+    case ineg: case rneg:
+    case ishl: case isar: case ishr: case imulh:
+    case igt: case ilt: case ieq: case ile: case ige: case ine:
+    case rgt: case rlt: case req: case rle: case rge: case rne:
+    case iand: case ior: case inot:
+    case iassign: case rassign:
+        return true;
+    default:
+        return false;
     }
-
-    return *this;
 }
 
+
 std::ostream& QuadsList::print(std::ostream& o)
 {
-    QuadsListElement        *elem;
+    long        i;
+    Quad        q;
 
     o << "    QuadsList @ " << (void *)this << "\n";
     o << ShortSymbols;
 
-    elem = head;
-    while (elem)
+    for (i = head; i >= 0; i = next[i])
     {
-        o << elem->data << '\n';
-        elem = elem->next;
+        q = Unpack(quads[i]);
+        o << q << '\n';
     }
 
     o << LongSymbols;
@@ -853,6 +1016,42 @@ std::ostream& Quad::print(std::ostream& o)
           << std::setw(8) << sym2
           << std::setw(8) << sym3;
         break;
+    case ineg:
+        o << std::setw(8) << "ineg    "
+          << std::setw(8) << sym1
+          << std::setw(8) << "-"
+          << std::setw(8) << sym3;
+        break;
+    case rneg:
+        o << std::setw(8) << "rneg    "
+          << std::setw(8) << sym1
+          << std::setw(8) << "-"
+          << std::setw(8) << sym3;
+        break;
+    case ishl:
+        o << std::setw(8) << "ishl    "
+          << std::setw(8) << sym1
+          << std::setw(8) << int2
+          << std::setw(8) << sym3;
+        break;
+    case isar:
+        o << std::setw(8) << "isar    "
+          << std::setw(8) << sym1
+          << std::setw(8) << int2
+          << std::setw(8) << sym3;
+        break;
+    case ishr:
+        o << std::setw(8) << "ishr    "
+          << std::setw(8) << sym1
+          << std::setw(8) << int2
+          << std::setw(8) << sym3;
+        break;
+    case imulh:
+        o << std::setw(8) << "imulh   "
+          << std::setw(8) << sym1
+          << std::setw(8) << int2
+          << std::setw(8) << sym3;
+        break;
     case igt:
         o << std::setw(8) << "igt     "
           << std::setw(8) << sym1
@@ -889,6 +1088,42 @@ std::ostream& Quad::print(std::ostream& o)
           << std::setw(8) << sym2
           << std::setw(8) << sym3;
         break;
+    case ile:
+        o << std::setw(8) << "ile     "
+          << std::setw(8) << sym1
+          << std::setw(8) << sym2
+          << std::setw(8) << sym3;
+        break;
+    case ige:
+        o << std::setw(8) << "ige     "
+          << std::setw(8) << sym1
+          << std::setw(8) << sym2
+          << std::setw(8) << sym3;
+        break;
+    case ine:
+        o << std::setw(8) << "ine     "
+          << std::setw(8) << sym1
+          << std::setw(8) << sym2
+          << std::setw(8) << sym3;
+        break;
+    case rle:
+        o << std::setw(8) << "rle     "
+          << std::setw(8) << sym1
+          << std::setw(8) << sym2
+          << std::setw(8) << sym3;
+        break;
+    case rge:
+        o << std::setw(8) << "rge     "
+          << std::setw(8) << sym1
+          << std::setw(8) << sym2
+          << std::setw(8) << sym3;
+        break;
+    case rne:
+        o << std::setw(8) << "rne     "
+          << std::setw(8) << sym1
+          << std::setw(8) << sym2
+          << std::setw(8) << sym3;
+        break;
     case iand:
         o << std::setw(8) << "iand    "
           << std::setw(8) << sym1
@@ -988,7 +1223,7 @@ std::ostream& Quad::print(std::ostream& o)
     case aassign:
         o << std::setw(8) << "aassign "
           << std::setw(8) << sym1
-          << std::setw(8) << int1
+          << std::setw(8) << int2
           << std::setw(8) << sym3;
         break;
     case hcf:
@@ -1004,7 +1239,7 @@ std::ostream& Quad::print(std::ostream& o)
           << std::setw(8) << "-";
         break;
     default:
-        o << "unknown (" << opcode << ")";
+        o << "unknown (" << (int)opcode << ")";
         break;
     }
 
@@ -0,0 +1,585 @@
+#include <iostream>
+#include <algorithm>
+#include <deque>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cfg.hh>
+#include <dataflow.hh>
+
+
+unsigned long DataflowAnalysis::solved;
+unsigned long DataflowAnalysis::visits;
+unsigned long DataflowAnalysis::words;
+
+
+/*
+ * BitSet methods
+ *
+ * Union and Intersect return true if the set changed. Transfer sets
+ * this set to gen | (x - kill) and returns true if that changed it.
+ * Next returns the first member at or after i, or -1. Union and
+ * Subtract only look at as many words as the other set has.
+ */
+
+void BitSet::Clear(void)
+{
+    size_t      w;
+
+    for (w = 0; w < words.size(); w++)
+        words[w] = 0;
+}
+
+void BitSet::Fill(void)
+{
+    size_t      w;
+
+    for (w = 0; w < words.size(); w++)
+        words[w] = ~(uint64_t)0;
+    if (bits % 64 != 0)
+        words.back() = ((uint64_t)1 << (bits % 64)) - 1;
+}
+
+void BitSet::Resize(size_t n)
+{
+    words.resize((n + 63) / 64, 0);
+    bits = n;
+    if (bits % 64 != 0)
+        words.back() &= ((uint64_t)1 << (bits % 64)) - 1;
+}
+
+bool BitSet::Union(const BitSet& s)
+{
+    uint64_t    changed = 0, w0;
+    size_t      w;
+
+    for (w = 0; w < s.words.size(); w++)
+    {
+        w0 = words[w] | s.words[w];
+        changed |= w0 ^ words[w];
+        words[w] = w0;
+    }
+    return changed != 0;
+}
+
+bool BitSet::Intersect(const BitSet& s)
+{
+    uint64_t    changed = 0, w0;
+    size_t      w;
+
+    for (w = 0; w < words.size(); w++)
+    {
+        w0 = words[w] & s.words[w];
+        changed |= w0 ^ words[w];
+        words[w] = w0;
+    }
+    return changed != 0;
+}
+
+void BitSet::Subtract(const BitSet& s)
+{
+    size_t      w;
+
+    for (w = 0; w < s.words.size() && w < words.size(); w++)
+        words[w] &= ~s.words[w];
+}
+
+bool BitSet::Transfer(const BitSet& x, const BitSet& gen, const BitSet& kill)
+{
+    uint64_t    changed = 0, w0;
+    size_t      w;
+
+    for (w = 0; w < words.size(); w++)
+    {
+        w0 = gen.words[w] | (x.words[w] & ~kill.words[w]);
+        changed |= w0 ^ words[w];
+        words[w] = w0;
+    }
+    return changed != 0;
+}
+
+bool BitSet::Empty(void) const
+{
+    uint64_t    any = 0;
+    size_t      w;
+
+    for (w = 0; w < words.size(); w++)
+        any |= words[w];
+    return any == 0;
+}
+
+size_t BitSet::Count(void) const
+{
+    size_t      w, n;
+
+    n = 0;
+    for (w = 0; w < words.size(); w++)
+        n += __builtin_popcountll(words[w]);
+    return n;
+}
+
+long BitSet::Next(long i) const
+{
+    size_t      w;
+    uint64_t    rest;
+
+    if (i < 0)
+        i = 0;
+    if ((size_t)i >= bits)
+        return -1;
+
+    w = i / 64;
+    rest = words[w] & (~(uint64_t)0 << (i % 64));
+    while (rest == 0)
+    {
+        if (++w == words.size())
+            return -1;
+        rest = words[w];
+    }
+    return w * 64 + __builtin_ctzll(rest);
+}
+
+
+/*
+ * VariableNumbering methods
+ */
+
+VariableNumbering::VariableNumbering(ControlFlowGraph *g) :
+    function(g->Function()),
+    temporaries(g->Function()->GetTemporaryCount() + 1, -1)
+{
+    QuadsList                           *quads = g->Quads();
+    std::vector<VariableInformation *>   others;
+    std::vector<VariableInformation *>   temporary(temporaries.size(), NULL);
+    std::vector<int>                     definedIn(temporaries.size(), -1);
+    std::vector<char>                    exposed(temporaries.size(), 0);
+    VariableInformation                 *uses[3];
+    VariableInformation                 *v;
+    Quad                                 q;
+    long                                 i;
+    int                                  b, k, n, t;
+
+    //
+    // Find the variables the quads use, and the temporaries that are
+    // read in a block before they are assigned there.
+    //
+
+    for (b = 0; b < g->Blocks(); b++)
+    {
+        for (i = g->Block(b).first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            n = q.Uses(uses);
+            uses[n++] = q.Definition();
+            for (k = 0; k < n; k++)
+            {
+                if ((v = uses[k]) == NULL)
+                    continue;
+                if ((t = v->temporary) <= 0)
+                {
+                    if (numbers.find(v) == numbers.end())
+                    {
+                        numbers[v] = -1;
+                        others.push_back(v);
+                    }
+                    continue;
+                }
+                if (t >= (int)temporaries.size())
+                {
+                    definedIn.resize(t + 1, -1);
+                    exposed.resize(t + 1, 0);
+                    temporary.resize(t + 1, NULL);
+                    temporaries.resize(t + 1, -1);
+                }
+                temporary[t] = v;
+                if (k == n - 1)
+                    definedIn[t] = b;
+                else if (definedIn[t] != b)
+                    exposed[t] = 1;
+            }
+            if (i == g->Block(b).last)
+                break;
+        }
+    }
+
+    for (t = 1; t < (int)temporaries.size(); t++)
+        if (exposed[t])
+        {
+            temporaries[t] = variables.size();
+            variables.push_back(temporary[t]);
+            local.push_back(1);
+        }
+    for (v = function->GetLastParam(); v != NULL; v = v->prev)
+        if (numbers.find(v) != numbers.end())
+            Add(v);
+    for (v = function->GetLastLocal(); v != NULL; v = v->prev)
+        if (numbers.find(v) != numbers.end())
+            Add(v);
+    for (k = 0; k < (int)others.size(); k++)
+        if (numbers[others[k]] < 0)
+        {
+            Add(others[k]);
+            local.back() = 0;
+        }
+
+    globals = variables.size();
+    for (t = 1; t < (int)temporaries.size(); t++)
+        if (temporary[t] != NULL && !exposed[t])
+        {
+            temporaries[t] = variables.size();
+            variables.push_back(temporary[t]);
+            local.push_back(1);
+        }
+
+    named = BitSet(globals);
+    outer = BitSet(globals);
+    none = BitSet(globals);
+    for (n = 0; n < globals; n++)
+    {
+        if (IsTemporary(n))
+            continue;
+        named.Set(n);
+        if (!local[n])
+            outer.Set(n);
+    }
+}
+
+void VariableNumbering::Add(VariableInformation *v)
+{
+    numbers[v] = variables.size();
+    variables.push_back(v);
+    local.push_back(1);
+}
+
+const BitSet& VariableNumbering::Visible(Quad& q)
+{
+    FunctionInformation *callee, *f;
+
+    callee = q.sym1->SymbolAsFunction();
+    if (callee == NULL || callee->GetParent() == NULL)
+        return none;
+
+    for (f = callee->GetParent(); f != NULL; f = f->GetParent())
+        if (f == function)
+            return named;
+    return outer;
+}
+
+int VariableNumbering::Number(VariableInformation *v)
+{
+    std::map<VariableInformation *, int>::iterator   i;
+
+    if (v->temporary > 0)
+        return v->temporary < (int)temporaries.size() ?
+            temporaries[v->temporary] : -1;
+
+    i = numbers.find(v);
+    return i == numbers.end() ? -1 : i->second;
+}
+
+
+/*
+ * DataflowAnalysis methods
+ */
+
+DataflowAnalysis::DataflowAnalysis(ControlFlowGraph *g, bool b, bool m) :
+    graph(g),
+    backward(b),
+    meetAll(m)
+{
+}
+
+void DataflowAnalysis::Allocate(size_t bits)
+{
+    size_t      blocks = graph->Blocks();
+
+    gen.assign(blocks, BitSet(bits));
+    kill.assign(blocks, BitSet(bits));
+    in.assign(blocks, BitSet(bits));
+    out.assign(blocks, BitSet(bits));
+    boundary = BitSet(bits);
+
+    words += 4 * blocks * ((bits + 63) / 64);
+}
+
+void DataflowAnalysis::Solve(void)
+{
+    const std::vector<int>&  order = graph->ReversePostorder();
+    std::deque<int>          work;
+    std::vector<char>        queued(graph->Blocks(), 0);
+    std::vector<int>        *sources, *targets;
+    BitSet                  *meet, *result;
+    size_t                   k;
+    int                      b, s;
+    bool                     first;
+
+    solved += 1;
+
+    for (k = 0; k < order.size(); k++)
+    {
+        b = backward ? order[order.size() - 1 - k] : order[k];
+        work.push_back(b);
+        queued[b] = 1;
+        if (meetAll)
+            (backward ? in[b] : out[b]).Fill();
+    }
+
+    while (!work.empty())
+    {
+        b = work.front();
+        work.pop_front();
+        queued[b] = 0;
+        visits += 1;
+
+        if (backward)
+        {
+            sources = &graph->Block(b).successors;
+            targets = &graph->Block(b).predecessors;
+            meet = &out[b];
+            result = &in[b];
+        }
+        else
+        {
+            sources = &graph->Block(b).predecessors;
+            targets = &graph->Block(b).successors;
+            meet = &in[b];
+            result = &out[b];
+        }
+
+        first = true;
+        if ((backward && sources->empty()) || (!backward && b == 0))
+        {
+            *meet = boundary;
+            first = false;
+        }
+        for (k = 0; k < sources->size(); k++)
+        {
+            s = (*sources)[k];
+            if (!graph->Reachable(s))
+                continue;
+            if (first)
+                *meet = backward ? in[s] : out[s];
+            else if (meetAll)
+                meet->Intersect(backward ? in[s] : out[s]);
+            else
+                meet->Union(backward ? in[s] : out[s]);
+            first = false;
+        }
+
+        if (!result->Transfer(*meet, gen[b], kill[b]))
+            continue;
+
+        for (k = 0; k < targets->size(); k++)
+        {
+            s = (*targets)[k];
+            if (graph->Reachable(s) && !queued[s])
+            {
+                work.push_back(s);
+                queued[s] = 1;
+            }
+        }
+    }
+}
+
+void DataflowAnalysis::Report(std::ostream& o)
+{
+    o << "Dataflow report\n";
+    o << "Analyses solved:     " << solved << '\n';
+    o << "Block visits:        " << visits << '\n';
+    o << "Set words:           " << words << '\n';
+}
+
+
+/*
+ * Liveness methods
+ */
+
+Liveness::Liveness(ControlFlowGraph *g) :
+    DataflowAnalysis(g, true, false),
+    numbering(g)
+{
+    int         n;
+
+    Allocate(numbering.Globals());
+    for (n = 0; n < numbering.Globals(); n++)
+        if (!numbering.IsLocal(n))
+            boundary.Set(n);
+
+    Update();
+}
+
+void Liveness::Update(void)
+{
+    QuadsList   *quads = graph->Quads();
+    Quad         q;
+    long         i;
+    int          b, n;
+
+    //
+    // Walking a block backwards, a definition kills the variable and
+    // hides it from the uses below, and a use makes it live.
+    //
+
+    for (b = 0; b < graph->Blocks(); b++)
+    {
+        gen[b].Clear();
+        kill[b].Clear();
+        in[b].Clear();
+        out[b].Clear();
+        for (i = graph->Block(b).last; ; i = quads->Previous(i))
+        {
+            q = (*quads)[i];
+            Step(q, gen[b]);
+            n = q.Definition() ? numbering.Number(q.Definition()) : -1;
+            if (n >= 0 && n < numbering.Globals())
+                kill[b].Set(n);
+            if (i == graph->Block(b).first)
+                break;
+        }
+    }
+
+    Solve();
+}
+
+void Liveness::Step(Quad& q, BitSet& live)
+{
+    VariableInformation *uses[2];
+    int                  i, n, v;
+
+    v = q.Definition() ? numbering.Number(q.Definition()) : -1;
+    if (v >= 0 && v < (int)live.Size())
+        live.Reset(v);
+
+    if (q.opcode == call)
+        live.Union(numbering.Visible(q));
+
+    n = q.Uses(uses);
+    for (i = 0; i < n; i++)
+        if (uses[i] != NULL && (v = numbering.Number(uses[i])) >= 0 &&
+            v < (int)live.Size())
+            live.Set(v);
+}
+
+
+/*
+ * ReachingDefinitions methods
+ */
+
+ReachingDefinitions::ReachingDefinitions(ControlFlowGraph *g) :
+    DataflowAnalysis(g, false, false),
+    numbering(g)
+{
+    QuadsList           *quads = g->Quads();
+    std::vector<long>    others;
+    Quad                 q;
+    long                 i;
+    int                  b, d, v, globals;
+
+    //
+    // Number the definitions, those of global variables and the calls
+    // first, and find the assignments to each variable.
+    //
+
+    definitionOf.assign(quads != NULL ? quads->Limit() : 0, -1);
+    for (b = 0; b < g->Blocks(); b++)
+    {
+        for (i = g->Block(b).first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            v = q.Definition() ? numbering.Number(q.Definition()) : -1;
+            if (q.opcode == call || (v >= 0 && v < numbering.Globals()))
+                definitions.push_back(i);
+            else if (v >= 0)
+                others.push_back(i);
+            if (i == g->Block(b).last)
+                break;
+        }
+    }
+    globals = definitions.size();
+    definitions.insert(definitions.end(), others.begin(), others.end());
+
+    assignments.resize(numbering.Size());
+    replaces.assign(numbering.Globals(), BitSet(globals));
+    for (d = 0; d < (int)definitions.size(); d++)
+    {
+        q = (*quads)[definitions[d]];
+        definitionOf[definitions[d]] = d;
+        v = q.Definition() ? numbering.Number(q.Definition()) : -1;
+        assigns.push_back(v);
+        if (q.opcode == call)
+            calls.push_back(d);
+        if (v < 0)
+            continue;
+        assignments[v].push_back(d);
+        if (v < numbering.Globals())
+            replaces[v].Set(d);
+    }
+
+    //
+    // A definition replaces the definitions of its variable that come
+    // before it in the block, but not the calls that may have changed
+    // it, since a call defines its result as well.
+    //
+
+    Allocate(globals);
+    for (b = 0; b < g->Blocks(); b++)
+    {
+        for (i = g->Block(b).first; ; i = quads->Next(i))
+        {
+            Step(i, gen[b]);
+            d = definitionOf[i];
+            if (d >= 0 && assigns[d] >= 0 && assigns[d] < numbering.Globals())
+                kill[b].Union(replaces[assigns[d]]);
+            if (i == g->Block(b).last)
+                break;
+        }
+    }
+
+    Solve();
+}
+
+void ReachingDefinitions::DefinitionsOf(int v, std::vector<int>& list)
+{
+    std::vector<int>     visible;
+    size_t               k;
+
+    for (k = 0; k < calls.size(); k++)
+    {
+        Quad q = (*graph->Quads())[definitions[calls[k]]];
+        if (numbering.Visible(q).Test(v))
+            visible.push_back(calls[k]);
+    }
+
+    list.resize(assignments[v].size() + visible.size());
+    std::merge(assignments[v].begin(), assignments[v].end(),
+               visible.begin(), visible.end(), list.begin());
+}
+
+void ReachingDefinitions::Step(long i, BitSet& reaching)
+{
+    int         d = definitionOf[i];
+    int         v;
+    size_t      k;
+
+    if (d < 0)
+        return;
+    if ((v = assigns[d]) >= 0 && v < numbering.Globals())
+        reaching.Subtract(replaces[v]);
+    else if (v >= 0)
+        for (k = 0; k < assignments[v].size(); k++)
+            if (assignments[v][k] < (int)reaching.Size())
+                reaching.Reset(assignments[v][k]);
+    if (d < (int)reaching.Size())
+        reaching.Set(d);
+}
+
+void ReachingDefinitions::Reaching(long i, BitSet& reaching)
+{
+    QuadsList   *quads = graph->Quads();
+    long         j;
+
+    reaching = In(graph->BlockOf(i));
+    reaching.Resize(definitions.size());
+    for (j = graph->Block(graph->BlockOf(i)).first; j != i; j = quads->Next(j))
+        Step(j, reaching);
+}
@@ -0,0 +1,436 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+
+#include <ast.hh>
+#include <symtab.hh>
+#include <codegen.hh>
+#include <vm.hh>
+
+
+unsigned long FlatAST::constantsFolded;
+unsigned long FlatAST::identitiesApplied;
+unsigned long FlatAST::nodesRemoved;
+
+
+//
+// Integer arithmetic wraps around, just like it does at run time.
+//
+
+static long WrapAdd(long a, long b) { return (long)((unsigned long)a + (unsigned long)b); }
+static long WrapSub(long a, long b) { return (long)((unsigned long)a - (unsigned long)b); }
+static long WrapMul(long a, long b) { return (long)((unsigned long)a * (unsigned long)b); }
+
+static bool IsInteger(const FlatNode& n, long value)
+{
+    return n.kind == kIntegerConstant && n.value.integer == value;
+}
+
+static bool IsReal(const FlatNode& n, double value)
+{
+    return n.kind == kRealConstant && n.value.real == value;
+}
+
+static bool IsOne(const FlatNode& n)
+{
+    return IsInteger(n, 1) || IsReal(n, 1.0);
+}
+
+static bool IsConstant(const FlatNode& n)
+{
+    return n.kind == kIntegerConstant || n.kind == kRealConstant;
+}
+
+
+/*
+ * FlatAST::MakeInteger, FlatAST::MakeReal, FlatAST::MakeBoolean
+ *
+ * Turn node n into an integer, real or boolean constant, dropping its
+ * operands.
+ */
+
+void FlatAST::MakeInteger(unsigned int n, long value)
+{
+    nodes[n].kind = kIntegerConstant;
+    nodes[n].type = kIntegerType;
+    nodes[n].a = nodes[n].b = nodes[n].c = 0;
+    nodes[n].value.integer = value;
+}
+
+void FlatAST::MakeReal(unsigned int n, double value)
+{
+    nodes[n].kind = kRealConstant;
+    nodes[n].type = kRealType;
+    nodes[n].a = nodes[n].b = nodes[n].c = 0;
+    nodes[n].value.real = value;
+}
+
+void FlatAST::MakeBoolean(unsigned int n, bool value)
+{
+    nodes[n].kind = kBooleanConstant;
+    nodes[n].type = NULL;
+    nodes[n].a = nodes[n].b = nodes[n].c = 0;
+    nodes[n].value.integer = value;
+}
+
+
+/*
+ * FlatAST::FoldConstant
+ *
+ * Evaluate node n if all its operands are constants. Returns false,
+ * leaving the node alone, if they aren't or if the result can't be
+ * computed here: integer division by zero has to fail at run time,
+ * and real results that aren't finite have no constant to load them
+ * with in every backend.
+ */
+
+bool FlatAST::FoldConstant(unsigned int n)
+{
+    FlatNode    *node = &nodes[n];
+    FlatNode    *left, *right;
+    long         i, j;
+    double       x, y, r;
+    int          order;
+
+    left = node->a != FLAT_NONE ? &nodes[node->a] : NULL;
+    right = node->b != FLAT_NONE ? &nodes[node->b] : NULL;
+
+    switch (node->kind)
+    {
+    case kIntegerToReal:
+        if (left->kind != kIntegerConstant)
+            return false;
+        MakeReal(n, (double)left->value.integer);
+        return true;
+
+    case kTruncateReal:
+        if (left->kind != kRealConstant ||
+            !(left->value.real > -9.2e18 && left->value.real < 9.2e18))
+            return false;
+        MakeInteger(n, (long)left->value.real);
+        return true;
+
+    case kUnaryMinus:
+        if (left->kind == kIntegerConstant)
+            MakeInteger(n, WrapSub(0, left->value.integer));
+        else if (left->kind == kRealConstant)
+            MakeReal(n, -left->value.real);
+        else
+            return false;
+        return true;
+
+    case kNot:
+        if (left->kind != kBooleanConstant)
+            return false;
+        MakeBoolean(n, !left->value.integer);
+        return true;
+
+    case kPlus:
+    case kMinus:
+    case kTimes:
+    case kDivide:
+    case kPower:
+        if (!IsConstant(*left) || left->kind != right->kind)
+            return false;
+        if (left->kind == kIntegerConstant)
+        {
+            i = left->value.integer;
+            j = right->value.integer;
+            switch (node->kind)
+            {
+            case kPlus:   i = WrapAdd(i, j); break;
+            case kMinus:  i = WrapSub(i, j); break;
+            case kTimes:  i = WrapMul(i, j); break;
+            case kPower:  i = IntegerPower(i, j); break;
+            default:
+                if (j == 0)
+                    return false;
+                i = j == -1 ? WrapSub(0, i) : i / j;
+                break;
+            }
+            MakeInteger(n, i);
+        }
+        else
+        {
+            x = left->value.real;
+            y = right->value.real;
+            switch (node->kind)
+            {
+            case kPlus:   r = x + y; break;
+            case kMinus:  r = x - y; break;
+            case kTimes:  r = x * y; break;
+            case kDivide: r = x / y; break;
+            default:      r = pow(x, y); break;
+            }
+            if (!std::isfinite(r))
+                return false;
+            MakeReal(n, r);
+        }
+        return true;
+
+    case kLessThan:
+    case kGreaterThan:
+    case kLessThanOrEqual:
+    case kGreaterThanOrEqual:
+    case kEqual:
+    case kNotEqual:
+        if (!IsConstant(*left) || left->kind != right->kind)
+            return false;
+        if (left->kind == kIntegerConstant)
+            order = (left->value.integer > right->value.integer) -
+                    (left->value.integer < right->value.integer);
+        else
+            order = (left->value.real > right->value.real) -
+                    (left->value.real < right->value.real);
+        switch (node->kind)
+        {
+        case kLessThan:           MakeBoolean(n, order < 0);  break;
+        case kGreaterThan:        MakeBoolean(n, order > 0);  break;
+        case kLessThanOrEqual:    MakeBoolean(n, order <= 0); break;
+        case kGreaterThanOrEqual: MakeBoolean(n, order >= 0); break;
+        case kEqual:              MakeBoolean(n, order == 0); break;
+        default:                  MakeBoolean(n, order != 0); break;
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+/*
+ * FlatAST::Simplify
+ *
+ * Apply an identity to node n, whose operands are not all constants.
+ * Returns the node that n should become a copy of, n itself if it was
+ * rewritten in place, or FLAT_NONE if no identity applies. Operands
+ * are only ever dropped if they are pure, and identities that don't
+ * hold exactly for reals (x + 0.0 when x is -0.0, x * 0.0 when x is
+ * infinite) are only applied to integers.
+ */
+
+unsigned int FlatAST::Simplify(unsigned int n, const std::vector<char>& pure)
+{
+    FlatNode    *node = &nodes[n];
+    FlatNode    *left, *right;
+    bool         integer;
+
+    left = node->a != FLAT_NONE ? &nodes[node->a] : NULL;
+    right = node->b != FLAT_NONE ? &nodes[node->b] : NULL;
+    integer = node->type == kIntegerType;
+
+    switch (node->kind)
+    {
+    case kPlus:
+        if (IsInteger(*right, 0))
+            return node->a;
+        if (IsInteger(*left, 0))
+            return node->b;
+        return FLAT_NONE;
+
+    case kMinus:
+        if (IsInteger(*right, 0) ||
+            (IsReal(*right, 0.0) && !std::signbit(right->value.real)))
+            return node->a;
+        if (IsInteger(*left, 0))
+        {
+            node->kind = kUnaryMinus;
+            node->a = node->b;
+            node->b = 0;
+            return n;
+        }
+        return FLAT_NONE;
+
+    case kTimes:
+        if (IsOne(*right))
+            return node->a;
+        if (IsOne(*left))
+            return node->b;
+        if (integer && IsInteger(*right, 0) && pure[node->a])
+            return node->b;
+        if (integer && IsInteger(*left, 0) && pure[node->b])
+            return node->a;
+        if (IsInteger(*right, -1) || IsReal(*right, -1.0))
+        {
+            node->kind = kUnaryMinus;
+            node->b = 0;
+            return n;
+        }
+        return FLAT_NONE;
+
+    case kDivide:
+        if (IsOne(*right))
+            return node->a;
+        return FLAT_NONE;
+
+    case kPower:
+        if (IsOne(*right))
+            return node->a;
+        if ((IsInteger(*right, 0) || IsReal(*right, 0.0)) && pure[node->a])
+        {
+            if (integer)
+                MakeInteger(n, 1);
+            else
+                MakeReal(n, 1.0);
+            return n;
+        }
+        return FLAT_NONE;
+
+    case kUnaryMinus:
+    case kNot:
+        if (left->kind == node->kind)
+            return left->a;
+        return FLAT_NONE;
+
+    //
+    // And and or never evaluate their right operand once the left one
+    // has decided the result, so a constant on the left can always be
+    // folded. A constant on the right can only drop a pure left side.
+    //
+
+    case kAnd:
+        if (left->kind == kBooleanConstant)
+            return left->value.integer ? node->b : node->a;
+        if (right->kind == kBooleanConstant)
+        {
+            if (right->value.integer)
+                return node->a;
+            if (pure[node->a])
+                return node->b;
+        }
+        return FLAT_NONE;
+
+    case kOr:
+        if (left->kind == kBooleanConstant)
+            return left->value.integer ? node->a : node->b;
+        if (right->kind == kBooleanConstant)
+        {
+            if (!right->value.integer)
+                return node->a;
+            if (pure[node->a])
+                return node->b;
+        }
+        return FLAT_NONE;
+
+    default:
+        return FLAT_NONE;
+    }
+}
+
+
+/*
+ * FlatAST::Fold
+ *
+ * Fold constant expressions and apply simple identities, rewriting
+ * nodes in place. Children are stored before their parents, so one
+ * pass over the nodes in order sees every operand already folded.
+ *
+ * A node is pure if evaluating it can have no effect and can't fail:
+ * it contains no function calls, no array references, which check
+ * their index, and no integer divisions except by nonzero constants.
+ * The size of every subtree is kept too, so that the nodes that are
+ * no longer reachable after a rewrite can be counted as removed.
+ */
+
+void FlatAST::Fold(void)
+{
+    std::vector<unsigned int>    size(nodes.size(), 1);
+    std::vector<char>            pure(nodes.size(), 1);
+    FlatNode                    *node;
+    unsigned int                 n, m, i, before;
+
+    for (n = 0; n < nodes.size(); n++)
+    {
+        node = &nodes[n];
+        switch (node->kind)
+        {
+        case kIntegerConstant:
+        case kRealConstant:
+        case kBooleanConstant:
+        case kIdentifier:
+            continue;
+
+        case kFunctionCall:
+            pure[n] = 0;
+            for (i = 0; i < node->b; i++)
+                size[n] += size[lists[node->a + i]];
+            continue;
+
+        case kArrayReference:
+            pure[n] = 0;
+            size[n] += size[node->a];
+            continue;
+
+        case kIntegerToReal:
+        case kTruncateReal:
+        case kUnaryMinus:
+        case kNot:
+            pure[n] = pure[node->a];
+            size[n] += size[node->a];
+            break;
+
+        case kPlus:
+        case kMinus:
+        case kTimes:
+        case kDivide:
+        case kPower:
+        case kLessThan:
+        case kGreaterThan:
+        case kLessThanOrEqual:
+        case kGreaterThanOrEqual:
+        case kEqual:
+        case kNotEqual:
+        case kAnd:
+        case kOr:
+            pure[n] = pure[node->a] && pure[node->b];
+            if (node->kind == kDivide && node->type == kIntegerType &&
+                (nodes[node->b].kind != kIntegerConstant ||
+                 nodes[node->b].value.integer == 0))
+                pure[n] = 0;
+            size[n] += size[node->a] + size[node->b];
+            break;
+
+        default:
+            continue;
+        }
+
+        before = size[n];
+        if (FoldConstant(n))
+        {
+            constantsFolded += 1;
+            pure[n] = 1;
+            size[n] = 1;
+        }
+        else if ((m = Simplify(n, pure)) != FLAT_NONE)
+        {
+            identitiesApplied += 1;
+            if (m != n)
+            {
+                nodes[n] = nodes[m];
+                pure[n] = pure[m];
+                size[n] = size[m];
+            }
+            else if (nodes[n].kind == kUnaryMinus)
+                size[n] = 1 + size[nodes[n].a];
+            else
+                size[n] = 1;
+        }
+        nodesRemoved += before - size[n];
+    }
+}
+
+
+/*
+ * FlatAST::Report
+ *
+ * Print how much Fold has done in all functions so far.
+ */
+
+void FlatAST::Report(std::ostream& o)
+{
+    o << "Folding report\n";
+    o << "Constants folded:    " << constantsFolded << '\n';
+    o << "Identities applied:  " << identitiesApplied << '\n';
+    o << "Nodes removed:       " << nodesRemoved << '\n';
+}
@@ -0,0 +1,944 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include <ast.hh>
+#include <symtab.hh>
+#include <codegen.hh>
+#include <vm.hh>
+#include <jit.hh>
+
+
+//
+// Register numbers as used in ModRM bytes. The XMM registers use the
+// same numbers.
+//
+
+enum
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8,  R9,  R10, R11, R12, R13, R14, R15
+};
+
+#define XMM0    0
+#define XMM1    1
+
+//
+// Condition codes for jcc and setcc. JMP is an unconditional jump.
+//
+
+#define CC_B    0x2
+#define CC_AE   0x3
+#define CC_E    0x4
+#define CC_NE   0x5
+#define CC_BE   0x6
+#define CC_A    0x7
+#define CC_P    0xA
+#define CC_NP   0xB
+#define CC_L    0xC
+#define CC_GE   0xD
+#define CC_LE   0xE
+#define CC_G    0xF
+#define JMP     -1
+
+//
+// Jump targets that aren't instructions: the epilogue and the
+// run-time error stubs at the end of every function.
+//
+
+#define EPILOGUE        -1
+#define LOAD_ERROR      -2
+#define STORE_ERROR     -3
+#define DIVIDE_ERROR    -4
+#define STUBS           4
+
+
+//
+// Built-in functions. Arguments are popped off the argument stack in
+// the VMState, just like the interpreter does.
+//
+
+static long JITPutInteger(VMState *state)
+{
+    state->arguments -= 1;
+    std::cout << state->arguments->i << '\n';
+    return 0;
+}
+
+static long JITPutReal(VMState *state)
+{
+    state->arguments -= 1;
+    PutReal(state->arguments->r);
+    return 0;
+}
+
+static long JITGetInteger(void)
+{
+    long    x;
+
+    if (!(std::cin >> x))
+        x = 0;
+    return x;
+}
+
+static double JITGetReal(void)
+{
+    double  x;
+
+    if (!(std::cin >> x))
+        x = 0.0;
+    return x;
+}
+
+static double JITPower(double x, double y)
+{
+    return pow(x, y);
+}
+
+//
+// The condition code that an integer comparison sets its result from.
+//
+
+static int IntegerCondition(int opcode)
+{
+    switch (opcode)
+    {
+    case vm_igt: case vm_igt_ic: return CC_G;
+    case vm_ilt: case vm_ilt_ic: return CC_L;
+    case vm_ile: case vm_ile_ic: return CC_LE;
+    case vm_ige: case vm_ige_ic: return CC_GE;
+    case vm_ine: case vm_ine_ic: return CC_NE;
+    default:                     return CC_E;
+    }
+}
+
+
+JITCompiler::JITCompiler() :
+    failed(false)
+{
+}
+
+JITCompiler::~JITCompiler()
+{
+    unsigned    i;
+
+    for (i = 0; i < regions.size(); i++)
+        munmap(regions[i].first, regions[i].second);
+}
+
+
+/*
+ * Instruction encoding
+ *
+ * Operand emits an instruction with a memory operand [base + disp]
+ * or [base + index * 8 + disp], and Direct one with two register
+ * operands. Opcodes larger than a byte are two-byte opcodes, such as
+ * 0x0FAF for imul. prefix is 0, 0x66 or 0xF2 and wide sets REX.W.
+ * Memory operands always use a 32-bit displacement.
+ */
+
+void JITCompiler::Byte(int b)
+{
+    code.push_back((unsigned char)b);
+}
+
+void JITCompiler::Long(long x)
+{
+    Byte(x);
+    Byte(x >> 8);
+    Byte(x >> 16);
+    Byte(x >> 24);
+}
+
+void JITCompiler::Quad(long x)
+{
+    Long(x);
+    Long(x >> 32);
+}
+
+void JITCompiler::Operand(int prefix, bool wide, int opcode,
+                          int reg, int base, int index, long disp)
+{
+    int     rex;
+
+    rex = (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) |
+          ((index >= 0 && (index & 8)) ? 2 : 0) | ((base & 8) ? 1 : 0);
+
+    if (prefix)
+        Byte(prefix);
+    if (rex)
+        Byte(0x40 | rex);
+    if (opcode > 0xFF)
+        Byte(opcode >> 8);
+    Byte(opcode & 0xFF);
+
+    if (index >= 0)
+    {
+        Byte(0x84 | (reg & 7) << 3);
+        Byte(0xC0 | (index & 7) << 3 | (base & 7));
+    }
+    else if ((base & 7) == RSP)
+    {
+        Byte(0x84 | (reg & 7) << 3);
+        Byte(0x24);
+    }
+    else
+        Byte(0x80 | (reg & 7) << 3 | (base & 7));
+    Long(disp);
+}
+
+void JITCompiler::Direct(int prefix, bool wide, int opcode, int reg, int rm)
+{
+    int     rex;
+
+    rex = (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+
+    if (prefix)
+        Byte(prefix);
+    if (rex)
+        Byte(0x40 | rex);
+    if (opcode > 0xFF)
+        Byte(opcode >> 8);
+    Byte(opcode & 0xFF);
+    Byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void JITCompiler::Move(int reg, long value)
+{
+    if (value == (int)value)
+    {
+        Direct(0, true, 0xC7, 0, reg);
+        Long(value);
+    }
+    else
+    {
+        Byte(0x48 | ((reg & 8) ? 1 : 0));
+        Byte(0xB8 + (reg & 7));
+        Quad(value);
+    }
+}
+
+void JITCompiler::Call(const void *function)
+{
+    Move(RAX, (long)function);
+    Direct(0, false, 0xFF, 2, RAX);
+}
+
+void JITCompiler::Jump(int cc, int target)
+{
+    if (cc == JMP)
+        Byte(0xE9);
+    else
+    {
+        Byte(0x0F);
+        Byte(0x80 | cc);
+    }
+    fixups.push_back(std::make_pair((long)code.size(), target));
+    Long(0);
+}
+
+void JITCompiler::Push(int reg)
+{
+    if (reg & 8)
+        Byte(0x41);
+    Byte(0x50 + (reg & 7));
+}
+
+void JITCompiler::Pop(int reg)
+{
+    if (reg & 8)
+        Byte(0x41);
+    Byte(0x58 + (reg & 7));
+}
+
+
+/*
+ * Frame access
+ *
+ * VM registers live in the frame's register banks, so every operand
+ * is a load from or a store to [rbx + 8n] or [r12 + 8n]. Up leaves
+ * the frame depth static links up in rax.
+ */
+
+void JITCompiler::LoadInteger(int reg, int slot)
+{
+    Operand(0, true, 0x8B, reg, RBX, -1, 8L * slot);
+}
+
+void JITCompiler::StoreInteger(int reg, int slot)
+{
+    Operand(0, true, 0x89, reg, RBX, -1, 8L * slot);
+}
+
+void JITCompiler::LoadReal(int reg, int slot)
+{
+    Operand(0xF2, false, 0x0F10, reg, R12, -1, 8L * slot);
+}
+
+void JITCompiler::StoreReal(int reg, int slot)
+{
+    Operand(0xF2, false, 0x0F11, reg, R12, -1, 8L * slot);
+}
+
+void JITCompiler::Up(int depth)
+{
+    Direct(0, true, 0x8B, RAX, R13);
+    while (depth-- > 0)
+        Operand(0, true, 0x8B, RAX, RAX, -1, offsetof(VMFrame, staticLink));
+}
+
+/*
+ * Check that the word address in rcx is inside the memory in use,
+ * jumping to the given error stub if it isn't. Negative addresses
+ * are caught by the unsigned comparison.
+ */
+
+void JITCompiler::Check(int stub)
+{
+    Operand(0, true, 0x3B, RCX, R15, -1, offsetof(VMState, memoryTop));
+    Jump(CC_AE, stub);
+}
+
+/*
+ * Store the condition cc as 0 or 1 in integer register slot.
+ */
+
+void JITCompiler::Boolean(int cc, int slot)
+{
+    Direct(0, false, 0x0F90 | cc, 0, RAX);
+    Direct(0, false, 0x0FB6, RAX, RAX);
+    StoreInteger(RAX, slot);
+}
+
+
+/*
+ * JITCompiler::Translate
+ *
+ * Append the machine code for one function to the code buffer. Each
+ * VM instruction is translated on its own; nothing is kept in
+ * machine registers between instructions.
+ */
+
+void JITCompiler::Translate(VMFunction *fn)
+{
+    static const char  *messages[STUBS - 1] =
+    {
+        "load outside of memory",
+        "store outside of memory",
+        "integer division by zero"
+    };
+
+    TypeInformation    *type;
+    long                stubs[STUBS];
+    long                bits, target, rel, skip, done;
+    int                 i, base, op, cc;
+    bool                array, swap;
+
+    offsets.assign(fn->code.size() + 1, 0);
+    array = fn->info->GetReturnType() != NULL &&
+            fn->info->GetReturnType()->elementType != NULL;
+
+    Push(RBP);
+    Push(RBX);
+    Push(R12);
+    Push(R13);
+    Push(R14);
+    Push(R15);
+    Direct(0, true, 0x81, 5, RSP);
+    Long(8);
+    Direct(0, true, 0x8B, R14, RDI);
+    Direct(0, true, 0x8B, R13, RSI);
+    Direct(0, true, 0x8B, R15, RDX);
+    Operand(0, true, 0x8B, RBX, R13, -1, offsetof(VMFrame, integerRegisters));
+    Operand(0, true, 0x8B, R12, R13, -1, offsetof(VMFrame, realRegisters));
+    Operand(0, true, 0x8B, RBP, R15, -1, offsetof(VMState, memory));
+
+    for (i = 0; i < (int)fn->code.size(); i++)
+    {
+        VMInstruction& I = fn->code[i];
+
+        offsets[i] = code.size();
+        switch (I.opcode)
+        {
+        case vm_iconst:
+            Move(RAX, I.imm.i);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_rconst:
+            memcpy(&bits, &I.imm.r, sizeof(bits));
+            Move(RAX, bits);
+            Operand(0, true, 0x89, RAX, R12, -1, 8L * I.c);
+            break;
+        case vm_iaddr:
+        case vm_iaddrup:
+            if (I.opcode == vm_iaddr)
+                Direct(0, true, 0x8B, RAX, R13);
+            else
+                Up(I.b);
+            Operand(0, true, 0x8B, RAX, RAX, -1, offsetof(VMFrame, memoryBase));
+            Direct(0, true, 0x81, 0, RAX);
+            Long(I.a);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_itor:
+            LoadInteger(RAX, I.a);
+            Direct(0xF2, true, 0x0F2A, XMM0, RAX);
+            StoreReal(XMM0, I.c);
+            break;
+        case vm_rtrunc:
+            LoadReal(XMM0, I.a);
+            Direct(0xF2, true, 0x0F2C, RAX, XMM0);
+            StoreInteger(RAX, I.c);
+            break;
+
+        case vm_iadd:
+        case vm_isub:
+        case vm_imul:
+            op = I.opcode == vm_iadd ? 0x03 : I.opcode == vm_isub ? 0x2B : 0x0FAF;
+            LoadInteger(RAX, I.a);
+            Operand(0, true, op, RAX, RBX, -1, 8L * I.b);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_idiv:
+            LoadInteger(RCX, I.b);
+            Direct(0, true, 0x85, RCX, RCX);
+            Jump(CC_E, DIVIDE_ERROR);
+            LoadInteger(RAX, I.a);
+            // Dividing by -1 negates, so LONG_MIN / -1 wraps instead
+            // of trapping. Both short jumps are patched once the code
+            // they skip has been emitted.
+            Direct(0, true, 0x83, 7, RCX);
+            Byte(0xFF);
+            Byte(0x75);
+            Byte(0);
+            skip = code.size();
+            Direct(0, true, 0xF7, 3, RAX);
+            Byte(0xEB);
+            Byte(0);
+            done = code.size();
+            code[skip - 1] = done - skip;
+            Byte(0x48);
+            Byte(0x99);
+            Direct(0, true, 0xF7, 7, RCX);
+            code[done - 1] = code.size() - done;
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_ipow:
+            LoadInteger(RDI, I.a);
+            LoadInteger(RSI, I.b);
+            Call((const void *)IntegerPower);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_radd:
+        case vm_rsub:
+        case vm_rmul:
+        case vm_rdiv:
+            op = I.opcode == vm_radd ? 0x0F58 : I.opcode == vm_rsub ? 0x0F5C :
+                 I.opcode == vm_rmul ? 0x0F59 : 0x0F5E;
+            LoadReal(XMM0, I.a);
+            Operand(0xF2, false, op, XMM0, R12, -1, 8L * I.b);
+            StoreReal(XMM0, I.c);
+            break;
+        case vm_rpow:
+            LoadReal(XMM0, I.a);
+            LoadReal(XMM1, I.b);
+            Call((const void *)JITPower);
+            StoreReal(XMM0, I.c);
+            break;
+        case vm_ineg:
+            LoadInteger(RAX, I.a);
+            Direct(0, true, 0xF7, 3, RAX);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_rneg:
+            Operand(0, true, 0x8B, RAX, R12, -1, 8L * I.a);
+            Move(RCX, (long)(1UL << 63));
+            Direct(0, true, 0x33, RAX, RCX);
+            Operand(0, true, 0x89, RAX, R12, -1, 8L * I.c);
+            break;
+        case vm_ishl:
+        case vm_isar:
+        case vm_ishr:
+            op = I.opcode == vm_ishl ? 4 : I.opcode == vm_isar ? 7 : 5;
+            LoadInteger(RAX, I.a);
+            Direct(0, true, 0xC1, op, RAX);
+            Byte(I.imm.i);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_imulh:
+            LoadInteger(RAX, I.a);
+            Move(RCX, I.imm.i);
+            Direct(0, true, 0xF7, 5, RCX);
+            StoreInteger(RDX, I.c);
+            break;
+
+        case vm_igt:
+        case vm_ilt:
+        case vm_ieq:
+        case vm_ile:
+        case vm_ige:
+        case vm_ine:
+            LoadInteger(RAX, I.a);
+            Operand(0, true, 0x3B, RAX, RBX, -1, 8L * I.b);
+            Boolean(IntegerCondition(I.opcode), I.c);
+            break;
+        case vm_rgt:
+        case vm_rlt:
+        case vm_rge:
+        case vm_rle:
+            swap = I.opcode == vm_rlt || I.opcode == vm_rle;
+            LoadReal(XMM0, swap ? I.b : I.a);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1,
+                    8L * (swap ? I.a : I.b));
+            Boolean(I.opcode == vm_rgt || I.opcode == vm_rlt ? CC_A : CC_AE,
+                    I.c);
+            break;
+        case vm_req:
+            LoadReal(XMM0, I.a);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1, 8L * I.b);
+            Direct(0, false, 0x0F90 | CC_E, 0, RAX);
+            Direct(0, false, 0x0F90 | CC_NP, 0, RCX);
+            Direct(0, false, 0x20, RCX, RAX);
+            Direct(0, false, 0x0FB6, RAX, RAX);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_rne:
+            LoadReal(XMM0, I.a);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1, 8L * I.b);
+            Direct(0, false, 0x0F90 | CC_NE, 0, RAX);
+            Direct(0, false, 0x0F90 | CC_P, 0, RCX);
+            Direct(0, false, 0x08, RCX, RAX);
+            Direct(0, false, 0x0FB6, RAX, RAX);
+            StoreInteger(RAX, I.c);
+            break;
+
+        case vm_iand:
+        case vm_ior:
+            LoadInteger(RAX, I.a);
+            Direct(0, true, 0x85, RAX, RAX);
+            Direct(0, false, 0x0F90 | CC_NE, 0, RAX);
+            LoadInteger(RCX, I.b);
+            Direct(0, true, 0x85, RCX, RCX);
+            Direct(0, false, 0x0F90 | CC_NE, 0, RCX);
+            Direct(0, false, I.opcode == vm_iand ? 0x20 : 0x08, RCX, RAX);
+            Direct(0, false, 0x0FB6, RAX, RAX);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_inot:
+            LoadInteger(RAX, I.a);
+            Direct(0, true, 0x85, RAX, RAX);
+            Boolean(CC_E, I.c);
+            break;
+
+        case vm_jtrue:
+        case vm_jfalse:
+            LoadInteger(RAX, I.a);
+            Direct(0, true, 0x85, RAX, RAX);
+            Jump(I.opcode == vm_jtrue ? CC_NE : CC_E, I.b);
+            break;
+        case vm_jump:
+            Jump(JMP, I.b);
+            break;
+
+        case vm_istore:
+        case vm_rstore:
+            LoadInteger(RCX, I.c);
+            Check(STORE_ERROR);
+            Operand(0, true, 0x8B, RAX, I.opcode == vm_istore ? RBX : R12,
+                    -1, 8L * I.a);
+            Operand(0, true, 0x89, RAX, RBP, RCX, 0);
+            break;
+        case vm_iload:
+        case vm_rload:
+            LoadInteger(RCX, I.a);
+            Check(LOAD_ERROR);
+            Operand(0, true, 0x8B, RAX, RBP, RCX, 0);
+            Operand(0, true, 0x89, RAX, I.opcode == vm_iload ? RBX : R12,
+                    -1, 8L * I.c);
+            break;
+
+        case vm_iupload:
+        case vm_rupload:
+            base = I.opcode == vm_iupload ? RBX : R12;
+            Up(I.b);
+            Operand(0, true, 0x8B, RAX, RAX, -1,
+                    base == RBX ? offsetof(VMFrame, integerRegisters)
+                                : offsetof(VMFrame, realRegisters));
+            Operand(0, true, 0x8B, RAX, RAX, -1, 8L * I.a);
+            Operand(0, true, 0x89, RAX, base, -1, 8L * I.c);
+            break;
+        case vm_iupstore:
+        case vm_rupstore:
+            base = I.opcode == vm_iupstore ? RBX : R12;
+            Up(I.b);
+            Operand(0, true, 0x8B, RAX, RAX, -1,
+                    base == RBX ? offsetof(VMFrame, integerRegisters)
+                                : offsetof(VMFrame, realRegisters));
+            Operand(0, true, 0x8B, RCX, base, -1, 8L * I.a);
+            Operand(0, true, 0x89, RCX, RAX, -1, 8L * I.c);
+            break;
+
+        case vm_ireturn:
+        case vm_areturn:
+            LoadInteger(RAX, I.a);
+            Jump(JMP, EPILOGUE);
+            break;
+        case vm_rreturn:
+            LoadReal(XMM0, I.a);
+            Jump(JMP, EPILOGUE);
+            break;
+        case vm_return:
+            Move(RAX, array ? -1 : 0);
+            Direct(0x66, false, 0x0FEF, XMM0, XMM0);
+            Jump(JMP, EPILOGUE);
+            break;
+
+        case vm_iparam:
+        case vm_rparam:
+        case vm_aparam:
+            Operand(0, true, 0x8B, RAX, I.opcode == vm_rparam ? R12 : RBX,
+                    -1, 8L * I.a);
+            Operand(0, true, 0x8B, RCX, R15, -1, offsetof(VMState, arguments));
+            Operand(0, true, 0x89, RAX, RCX, -1, 0);
+            Direct(0, true, 0x81, 0, RCX);
+            Long(sizeof(VMWord));
+            Operand(0, true, 0x89, RCX, R15, -1, offsetof(VMState, arguments));
+            break;
+        case vm_call:
+            Direct(0, true, 0x8B, RDI, R14);
+            Direct(0, true, 0x8B, RSI, R13);
+            Move(RDX, (long)&I);
+            type = I.imm.f->info->GetReturnType();
+            if (type != NULL && type->elementType != NULL)
+            {
+                Call((const void *)VirtualMachine::NativeCall);
+                break;
+            }
+
+            // Other callees are called directly, once the frame is
+            // pushed. The start of the callee's memory is kept in the
+            // spare slot at the bottom of this function's stack frame,
+            // so that the memory stack can be popped afterwards.
+            Call((const void *)VirtualMachine::NativeFrame);
+            Operand(0, true, 0x8B, RCX, RAX, -1, offsetof(VMFrame, memoryBase));
+            Operand(0, true, 0x89, RCX, RSP, -1, 0);
+            Direct(0, true, 0x8B, RDI, R14);
+            Direct(0, true, 0x8B, RSI, RAX);
+            Direct(0, true, 0x8B, RDX, R15);
+            if (I.imm.f->native != NULL)
+                Call(I.imm.f->native);
+            else
+            {
+                Byte(0xE8);
+                callees.push_back(std::make_pair((long)code.size(), I.imm.f));
+                Long(0);
+            }
+            if (type == kRealType)
+                StoreReal(XMM0, I.c);
+            else if (type == kIntegerType)
+                StoreInteger(RAX, I.c);
+            Operand(0, true, 0x8B, RCX, RSP, -1, 0);
+            Operand(0, true, 0x89, RCX, R15, -1, offsetof(VMState, memoryTop));
+            break;
+
+        case vm_putint:
+        case vm_putreal:
+            Direct(0, true, 0x8B, RDI, R15);
+            Call(I.opcode == vm_putint ? (const void *)JITPutInteger
+                                       : (const void *)JITPutReal);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_getint:
+            Call((const void *)JITGetInteger);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_getreal:
+            Call((const void *)JITGetReal);
+            StoreReal(XMM0, I.c);
+            break;
+
+        case vm_imove:
+        case vm_rmove:
+            base = I.opcode == vm_imove ? RBX : R12;
+            Operand(0, true, 0x8B, RAX, base, -1, 8L * I.a);
+            Operand(0, true, 0x89, RAX, base, -1, 8L * I.c);
+            break;
+        case vm_acopy:
+            LoadInteger(RDI, I.c);
+            Operand(0, true, 0x8D, RDI, RBP, RDI, 0);
+            LoadInteger(RSI, I.a);
+            Operand(0, true, 0x8D, RSI, RBP, RSI, 0);
+            Move(RDX, sizeof(VMWord) * I.b);
+            Call((const void *)memmove);
+            break;
+
+        case vm_iadd_ic:
+        case vm_isub_ic:
+        case vm_imul_ic:
+            op = I.opcode == vm_iadd_ic ? 0x03 :
+                 I.opcode == vm_isub_ic ? 0x2B : 0x0FAF;
+            LoadInteger(RAX, I.a);
+            Move(RCX, I.imm.i);
+            Direct(0, true, op, RAX, RCX);
+            StoreInteger(RAX, I.c);
+            break;
+        case vm_ilt_ic:
+        case vm_igt_ic:
+        case vm_ieq_ic:
+        case vm_ile_ic:
+        case vm_ige_ic:
+        case vm_ine_ic:
+            LoadInteger(RAX, I.a);
+            Move(RCX, I.imm.i);
+            Direct(0, true, 0x3B, RAX, RCX);
+            Boolean(IntegerCondition(I.opcode), I.c);
+            break;
+
+        case vm_jlt_ii: case vm_jge_ii: case vm_jgt_ii:
+        case vm_jle_ii: case vm_jeq_ii: case vm_jne_ii:
+        case vm_jlt_ic: case vm_jge_ic: case vm_jgt_ic:
+        case vm_jle_ic: case vm_jeq_ic: case vm_jne_ic:
+            LoadInteger(RAX, I.a);
+            if (I.opcode >= vm_jlt_ic)
+            {
+                Move(RCX, I.imm.i);
+                Direct(0, true, 0x3B, RAX, RCX);
+            }
+            else
+                Operand(0, true, 0x3B, RAX, RBX, -1, 8L * I.b);
+            switch ((I.opcode - vm_jlt_ii) % 12)
+            {
+            case 0:  cc = CC_L;  break;
+            case 1:  cc = CC_GE; break;
+            case 2:  cc = CC_G;  break;
+            case 3:  cc = CC_LE; break;
+            case 4:  cc = CC_E;  break;
+            default: cc = CC_NE; break;
+            }
+            Jump(cc, I.c);
+            break;
+
+        case vm_jlt_rr:
+        case vm_jge_rr:
+            LoadReal(XMM0, I.b);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1, 8L * I.a);
+            Jump(I.opcode == vm_jlt_rr ? CC_A : CC_BE, I.c);
+            break;
+        case vm_jgt_rr:
+        case vm_jle_rr:
+            LoadReal(XMM0, I.a);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1, 8L * I.b);
+            Jump(I.opcode == vm_jgt_rr ? CC_A : CC_BE, I.c);
+            break;
+        case vm_jeq_rr:
+            LoadReal(XMM0, I.a);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1, 8L * I.b);
+            Jump(CC_P, i + 1);
+            Jump(CC_E, I.c);
+            break;
+        case vm_jne_rr:
+            LoadReal(XMM0, I.a);
+            Operand(0x66, false, 0x0F2E, XMM0, R12, -1, 8L * I.b);
+            Jump(CC_P, I.c);
+            Jump(CC_NE, I.c);
+            break;
+
+        case vm_iaddr_ix:
+        case vm_iload_ix:
+        case vm_rload_ix:
+        case vm_istore_ix:
+        case vm_rstore_ix:
+            Operand(0, true, 0x8B, RCX, R13, -1, offsetof(VMFrame, memoryBase));
+            Operand(0, true, 0x03, RCX, RBX, -1, 8L * I.b);
+            Direct(0, true, 0x81, 0, RCX);
+            Long(I.opcode >= vm_istore_ix ? I.c : I.a);
+
+            if (I.opcode == vm_iaddr_ix)
+                StoreInteger(RCX, I.c);
+            else if (I.opcode == vm_iload_ix || I.opcode == vm_rload_ix)
+            {
+                Check(LOAD_ERROR);
+                Operand(0, true, 0x8B, RAX, RBP, RCX, 0);
+                Operand(0, true, 0x89, RAX,
+                        I.opcode == vm_iload_ix ? RBX : R12, -1, 8L * I.c);
+            }
+            else
+            {
+                Check(STORE_ERROR);
+                Operand(0, true, 0x8B, RAX,
+                        I.opcode == vm_istore_ix ? RBX : R12, -1, 8L * I.a);
+                Operand(0, true, 0x89, RAX, RBP, RCX, 0);
+            }
+            break;
+
+        case vm_hcf:
+            Move(RDI, (long)"hcf instruction executed");
+            Call((const void *)RuntimeError);
+            break;
+
+        default:
+            std::cerr << "Bug: JIT can't translate instruction "
+                      << I.opcode << ".\n";
+            abort();
+        }
+    }
+    offsets[fn->code.size()] = code.size();
+
+    //
+    // The epilogue and the error stubs
+    //
+
+    stubs[-EPILOGUE - 1] = code.size();
+    Direct(0, true, 0x81, 0, RSP);
+    Long(8);
+    Pop(R15);
+    Pop(R14);
+    Pop(R13);
+    Pop(R12);
+    Pop(RBX);
+    Pop(RBP);
+    Byte(0xC3);
+
+    for (i = 1; i < STUBS; i++)
+    {
+        stubs[i] = code.size();
+        Move(RDI, (long)messages[i - 1]);
+        Call((const void *)RuntimeError);
+    }
+
+    for (i = 0; i < (int)fixups.size(); i++)
+    {
+        target = fixups[i].second >= 0 ? offsets[fixups[i].second]
+                                        : stubs[-fixups[i].second - 1];
+        rel = target - (fixups[i].first + 4);
+        code[fixups[i].first]     = rel;
+        code[fixups[i].first + 1] = rel >> 8;
+        code[fixups[i].first + 2] = rel >> 16;
+        code[fixups[i].first + 3] = rel >> 24;
+    }
+    fixups.clear();
+}
+
+
+/*
+ * JITCompiler::Compile
+ *
+ * Compile a function and every function it can reach through calls
+ * that hasn't been compiled yet, and set their native entry points.
+ * Returns false if executable memory couldn't be had, in which case
+ * the JIT gives up for good.
+ */
+
+bool JITCompiler::Compile(VMFunction *fn)
+{
+    std::vector<VMFunction *>   work;
+    std::vector<long>           entries;
+    VMFunction                 *callee;
+    unsigned char              *region;
+    long                        size, page, rel;
+    unsigned                    i, j;
+
+    if (failed)
+        return false;
+
+    work.push_back(fn);
+    for (i = 0; i < work.size(); i++)
+        for (j = 0; j < work[i]->code.size(); j++)
+        {
+            if (work[i]->code[j].opcode != vm_call)
+                continue;
+            callee = work[i]->code[j].imm.f;
+            if (callee->native == NULL &&
+                std::find(work.begin(), work.end(), callee) == work.end())
+                work.push_back(callee);
+        }
+
+    code.clear();
+    for (i = 0; i < work.size(); i++)
+    {
+        entries.push_back(code.size());
+        Translate(work[i]);
+    }
+    entries.push_back(code.size());
+
+    for (i = 0; i < callees.size(); i++)
+    {
+        j = std::find(work.begin(), work.end(), callees[i].second) -
+            work.begin();
+        rel = entries[j] - (callees[i].first + 4);
+        code[callees[i].first]     = rel;
+        code[callees[i].first + 1] = rel >> 8;
+        code[callees[i].first + 2] = rel >> 16;
+        code[callees[i].first + 3] = rel >> 24;
+    }
+    callees.clear();
+
+    page = sysconf(_SC_PAGESIZE);
+    size = (code.size() + page - 1) / page * page;
+    region = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        failed = true;
+        return false;
+    }
+
+    memcpy(region, &code[0], code.size());
+    if (mprotect(region, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(region, size);
+        failed = true;
+        return false;
+    }
+    regions.push_back(std::make_pair((void *)region, size));
+
+    for (i = 0; i < work.size(); i++)
+    {
+        JITFunction     f;
+
+        f.function = work[i];
+        f.calls = work[i]->calls;
+        f.size = entries[i + 1] - entries[i];
+        compiled.push_back(f);
+        work[i]->native = region + entries[i];
+    }
+
+    return true;
+}
+
+
+/*
+ * JITCompiler::Report
+ *
+ * Print the functions that were compiled, how many times the
+ * interpreter had called them first, and the size of their code.
+ */
+
+void JITCompiler::Report(std::ostream& o)
+{
+    long        total;
+    unsigned    i;
+
+    total = 0;
+    o << "JIT report\n";
+    o << std::setw(20) << "function"
+      << std::setw(10) << "calls"
+      << std::setw(10) << "bytes" << '\n';
+
+    for (i = 0; i < compiled.size(); i++)
+    {
+        o << std::setw(20) << compiled[i].function->info->id
+          << std::setw(10) << compiled[i].calls
+          << std::setw(10) << compiled[i].size << '\n';
+        total += compiled[i].size;
+    }
+
+    o << "Native code: " << total << " bytes in "
+      << compiled.size() << " functions\n";
+}
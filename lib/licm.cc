@@ -0,0 +1,446 @@
+#include <iostream>
+#include <iomanip>
+#include <set>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <optimize.hh>
+#include <cfg.hh>
+#include <dataflow.hh>
+#include <ssa.hh>
+
+
+std::vector<LoopInvariantCodeMotion::Summary> LoopInvariantCodeMotion::summaries;
+
+
+LoopInvariantCodeMotion::LoopInvariantCodeMotion(FunctionInformation *fn) :
+    function(fn),
+    quads(fn->GetQuads()),
+    graph(NULL),
+    definitions(NULL),
+    liveness(NULL)
+{
+}
+
+
+/*
+ * LoopInvariantCodeMotion::Collect
+ *
+ * Make a member for every quad in a block that belongs to a loop,
+ * with the definitions that reach each of its operands. The members
+ * of a block are kept together, from blockMembers[b] up to the first
+ * member of the next block.
+ */
+
+void LoopInvariantCodeMotion::Collect(void)
+{
+    VariableNumbering&       numbering = definitions->Numbering();
+    std::vector<int>         reach;
+    BitSet                   reaching;
+    VariableInformation     *uses[2];
+    VariableInformation     *v;
+    Quad                     q;
+    long                     i;
+    size_t                   k;
+    int                      b, n, o;
+
+    members.clear();
+    blockMembers.assign(graph->Blocks() + 1, 0);
+    for (b = 0; b < graph->Blocks(); b++)
+    {
+        blockMembers[b] = members.size();
+        if (graph->Block(b).loop < 0)
+            continue;
+
+        reaching = definitions->In(b);
+        reaching.Resize(definitions->Definitions());
+        for (i = graph->Block(b).first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            members.push_back(Member());
+            Member& m = members.back();
+            m.quad = i;
+            m.block = b;
+            m.definition = definitions->DefinitionOf(i);
+            v = q.Definition();
+            m.variable = v != NULL ? numbering.Number(v) : -1;
+            m.operands = q.Uses(uses);
+            m.copy = false;
+            for (o = 0; o < m.operands; o++)
+            {
+                if (uses[o] == NULL || (n = numbering.Number(uses[o])) < 0)
+                    continue;
+                definitions->DefinitionsOf(n, reach);
+                for (k = 0; k < reach.size(); k++)
+                    if (reaching.Test(reach[k]))
+                        m.reaching[o].push_back(reach[k]);
+            }
+            definitions->Step(i, reaching);
+            if (i == graph->Block(b).last)
+                break;
+        }
+    }
+    blockMembers[graph->Blocks()] = members.size();
+}
+
+
+/*
+ * LoopInvariantCodeMotion::Preheader
+ *
+ * Make the place just before the header of loop l its preheader, by
+ * sending the jumps from outside the loop to one of the header's
+ * labels to a new label there instead. The jumps around the loop
+ * still go to the header. Returns the quad to insert hoisted quads
+ * before.
+ */
+
+long LoopInvariantCodeMotion::Preheader(int l)
+{
+    BasicBlock&      header = graph->Block(graph->LoopAt(l).header);
+    std::set<long>   labels;
+    Quad             q;
+    long             i, label;
+    size_t           k;
+    int              b;
+
+    for (i = header.first; i >= 0 && quads->Opcode(i) == clabel;
+         i = quads->Next(i))
+        labels.insert((*quads)[i].int1);
+
+    label = -1;
+    for (k = 0; k < header.predecessors.size(); k++)
+    {
+        b = header.predecessors[k];
+        if (graph->InLoop(b, l))
+            continue;
+
+        i = graph->Block(b).last;
+        q = (*quads)[i];
+        if ((q.opcode != jump && q.opcode != jtrue && q.opcode != jfalse) ||
+            labels.count(q.int1) == 0)
+            continue;
+
+        if (label < 0)
+        {
+            label = quads->NextLabel();
+            quads->InsertBefore(header.first,
+                                Quad(clabel, label, NULL, NULL));
+        }
+        q.int1 = label;
+        quads->Replace(i, q);
+    }
+
+    return header.first;
+}
+
+
+/*
+ * LoopInvariantCodeMotion::Hoist
+ *
+ * Find the invariant quads of loop l and move them to its preheader,
+ * in an order where each comes after the ones it uses. The members of
+ * the loop are those of its blocks and the constants copied out of
+ * the loops inside it. Returns how many quads were hoisted.
+ */
+
+int LoopInvariantCodeMotion::Hoist(int l)
+{
+    Loop&                    loop = graph->LoopAt(l);
+    BasicBlock&              header = graph->Block(loop.header);
+    VariableNumbering&       numbering = definitions->Numbering();
+    std::vector<size_t>      list;
+    std::vector<size_t>      order;
+    std::vector<int>         exits;
+    std::vector<int>         reach;
+    SymbolInformation      **operands[2];
+    VariableInformation     *v, *t;
+    Quad                     q;
+    Summary                  summary;
+    Member                   c;
+    long                     before;
+    size_t                   k, j, s, x;
+    int                      b, d, o, count;
+    bool                     changed, invariant;
+
+    summary.function = function;
+    summary.label = quads->Opcode(header.first) == clabel ?
+        (*quads)[header.first].int1 : -1;
+    summary.depth = loop.depth;
+    summary.hoisted = 0;
+    summaries.push_back(summary);
+
+    b = loop.header - 1;
+    if (summary.label < 0 ||
+        (b >= 0 && graph->InLoop(b, l) &&
+         quads->Opcode(graph->Block(b).last) != jump &&
+         quads->Opcode(graph->Block(b).last) != creturn))
+        return 0;
+
+    for (k = 0; k < loop.blocks.size(); k++)
+    {
+        b = loop.blocks[k];
+        for (x = blockMembers[b]; x < blockMembers[b + 1]; x++)
+            list.push_back(x);
+
+        for (j = 0; j < graph->Block(b).successors.size(); j++)
+            if (!graph->InLoop(graph->Block(b).successors[j], l))
+                break;
+        if (graph->Block(b).successors.empty() ||
+            j < graph->Block(b).successors.size())
+            exits.push_back(b);
+    }
+    list.insert(list.end(), copies[l].begin(), copies[l].end());
+
+    for (k = 0; k < list.size(); k++)
+        if (members[list[k]].definition >= 0)
+            inside[members[list[k]].definition] = 1;
+
+    do
+    {
+        changed = false;
+        for (k = 0; k < list.size(); k++)
+        {
+            Member& m = members[list[k]];
+            if (m.definition < 0 || hoisted[m.definition] ||
+                !(*quads)[m.quad].Pure())
+                continue;
+            if (!m.copy && (m.variable < 0 ||
+                            liveness->In(loop.header).Test(m.variable)))
+                continue;
+
+            invariant = true;
+            for (o = 0; o < m.operands && invariant; o++)
+            {
+                for (j = 0; j < m.reaching[o].size(); j++)
+                    if (inside[m.reaching[o][j]])
+                        break;
+                invariant = j == m.reaching[o].size() ||
+                    (m.reaching[o].size() == 1 && hoisted[m.reaching[o][0]]);
+            }
+            if (!invariant)
+                continue;
+
+            // A copy is the only assignment to its temporary, which is
+            // only read in the preheader it was made in.
+            if (!m.copy)
+            {
+                count = 0;
+                definitions->DefinitionsOf(m.variable, reach);
+                for (j = 0; j < reach.size(); j++)
+                    count += inside[reach[j]];
+                if (count != 1)
+                    continue;
+
+                for (j = 0; j < exits.size(); j++)
+                    if (!graph->Dominates(m.block, exits[j]))
+                        break;
+                for (; j < exits.size() && invariant; j++)
+                {
+                    BasicBlock& exit = graph->Block(exits[j]);
+                    if (exit.successors.empty() &&
+                        !numbering.IsLocal(m.variable))
+                        invariant = false;
+                    for (s = 0; s < exit.successors.size(); s++)
+                        if (!graph->InLoop(exit.successors[s], l) &&
+                            liveness->In(exit.successors[s]).Test(m.variable))
+                            invariant = false;
+                }
+                if (!invariant)
+                    continue;
+            }
+
+            hoisted[m.definition] = 1;
+            order.push_back(list[k]);
+            changed = true;
+        }
+    } while (changed);
+
+    // Constants go only where a hoisted quad needs them, and stay in
+    // the loop too if it still uses them there.
+    for (k = 0; k < list.size(); k++)
+    {
+        Member& m = members[list[k]];
+        for (o = 0; o < m.operands; o++)
+            for (j = 0; j < m.reaching[o].size(); j++)
+            {
+                d = m.reaching[o][j];
+                if (m.definition >= 0 && hoisted[m.definition])
+                    needed[d] = 1;
+                else
+                    used[d] = 1;
+            }
+    }
+
+    for (k = 0; k < order.size(); k++)
+    {
+        Member& m = members[order[k]];
+        q = (*quads)[m.quad];
+        if ((q.opcode == iconst || q.opcode == rconst) && !needed[m.definition])
+            hoisted[m.definition] = 0;
+    }
+
+    before = -1;
+    for (k = 0; k < order.size(); k++)
+    {
+        if (!hoisted[members[order[k]].definition])
+            continue;
+
+        if (before < 0)
+            before = Preheader(l);
+
+        q = (*quads)[members[order[k]].quad];
+        if ((q.opcode != iconst && q.opcode != rconst) ||
+            !used[members[order[k]].definition])
+        {
+            Member& m = members[order[k]];
+            quads->Move(m.quad, m.quad, quads->Previous(before));
+            m.block = loop.header;
+            summaries.back().hoisted += 1;
+            continue;
+        }
+
+        // Still used in the loop: hoist a copy into a new temporary
+        // and have the hoisted quads use that instead. The copy is a
+        // member of the loops around this one.
+        v = q.Definition();
+        t = function->TemporaryVariable(v->type);
+        q.sym3 = t;
+        c.quad = quads->InsertBefore(before, q);
+        c.block = loop.header;
+        c.definition = hoisted.size();
+        c.variable = -1;
+        c.operands = 0;
+        c.copy = true;
+        inside.push_back(0);
+        hoisted.push_back(0);
+        used.push_back(0);
+        needed.push_back(0);
+        if (loop.parent >= 0)
+            copies[loop.parent].push_back(members.size());
+        members.push_back(c);
+        summaries.back().hoisted += 1;
+
+        d = members[order[k]].definition;
+        for (j = k + 1; j < order.size(); j++)
+        {
+            Member& u = members[order[j]];
+            q = (*quads)[u.quad];
+            SSAForm::UseOperands(q, operands);
+            changed = false;
+            for (o = 0; o < u.operands; o++)
+                if (u.reaching[o].size() == 1 && u.reaching[o][0] == d)
+                {
+                    *operands[o] = t;
+                    u.reaching[o][0] = c.definition;
+                    changed = true;
+                }
+            if (changed)
+                quads->Replace(u.quad, q);
+        }
+    }
+
+    for (k = 0; k < list.size(); k++)
+    {
+        Member& m = members[list[k]];
+        if (m.definition >= 0)
+            inside[m.definition] = hoisted[m.definition] = 0;
+        for (o = 0; o < m.operands; o++)
+            for (j = 0; j < m.reaching[o].size(); j++)
+                used[m.reaching[o][j]] = needed[m.reaching[o][j]] = 0;
+    }
+
+    return summaries.back().hoisted;
+}
+
+
+/*
+ * LoopInvariantCodeMotion::Run
+ *
+ * Hoist the invariant quads out of every loop, innermost first, with
+ * one graph and one set of analyses for the whole function. Loops come
+ * larger first, so going from the end takes an inner loop before the
+ * one around it; the copies made in a loop are handed on to the loop
+ * around it. Returns true if any quad was hoisted.
+ */
+
+bool LoopInvariantCodeMotion::Run(void)
+{
+    int              l, parent, hoists;
+
+    if (quads == NULL)
+        return false;
+
+    ControlFlowGraph     loops(function);
+    if (loops.Loops() == 0)
+        return false;
+
+    ReachingDefinitions  reaching(&loops);
+    Liveness             live(&loops);
+
+    graph = &loops;
+    definitions = &reaching;
+    liveness = &live;
+    Collect();
+    copies.assign(graph->Loops(), std::vector<size_t>());
+    inside.assign(definitions->Definitions(), 0);
+    hoisted.assign(definitions->Definitions(), 0);
+    used.assign(definitions->Definitions(), 0);
+    needed.assign(definitions->Definitions(), 0);
+
+    hoists = 0;
+    for (l = graph->Loops() - 1; l >= 0; l--)
+    {
+        hoists += Hoist(l);
+        parent = graph->LoopAt(l).parent;
+        if (parent >= 0)
+            copies[parent].insert(copies[parent].end(),
+                                  copies[l].begin(), copies[l].end());
+    }
+
+    graph = NULL;
+    definitions = NULL;
+    liveness = NULL;
+    members.clear();
+    copies.clear();
+
+    return hoists > 0;
+}
+
+
+/*
+ * LoopInvariantCodeMotion::Report
+ *
+ * Print how many loops were looked at and how many quads were hoisted,
+ * in all functions, and list the loops with the label of their header
+ * and how deeply they are nested.
+ */
+
+void LoopInvariantCodeMotion::Report(std::ostream& o)
+{
+    unsigned long   total;
+    size_t          k;
+
+    total = 0;
+    for (k = 0; k < summaries.size(); k++)
+        total += summaries[k].hoisted;
+
+    o << "Loop-invariant code motion report\n";
+    o << "Loops:               " << summaries.size() << '\n';
+    o << "Quads hoisted:       " << total << '\n';
+
+    if (summaries.empty())
+        return;
+
+    o << std::setw(20) << "function"
+      << std::setw(10) << "header"
+      << std::setw(10) << "depth"
+      << std::setw(10) << "hoisted" << '\n';
+    for (k = 0; k < summaries.size(); k++)
+    {
+        o << std::setw(20) << summaries[k].function->id
+          << std::setw(10) << summaries[k].label
+          << std::setw(10) << summaries[k].depth
+          << std::setw(10) << summaries[k].hoisted << '\n';
+    }
+}
@@ -5,27 +5,81 @@
 #include <ast.hh>
 #include <parser.hh>
 #include <symtab.hh>
+#include <vm.hh>
+#include <asmgen.hh>
+#include <cgen.hh>
+#include <optimize.hh>
+#include <cfg.hh>
 
 extern int yyparse(void);
 extern int yydebug;
 extern int errorCount;
 extern int warningCount;
 
-static char *optionString = "dh";
+static char *optionString = "CdGhijOp:rSx";
+
+int printQuads = 1;
+int executeProgram = 0;
+int generateAssembly = 0;
+int generateC = 0;
+int printGraphs = 0;
+int superinstructions = 0;
+int compileHotFunctions = 0;
+int reportStatistics = 0;
+int optimizeQuads = 0;
 
 void Usage(char *program)
 {
     std::cerr << "Usage:\n"
-         << program << " [-d] [filename]\n"
+         << program << " [-d] [-x|-i|-j|-S|-C|-G] [-O [-p rule]...] [-r] [filename]\n"
          << program << " -h\n"
          << "\n"
          << "Options:\n"
          << "  -h               Shows this message.\n"
-         << "  -d               Turn on parser debugging.\n";
+         << "  -d               Turn on parser debugging.\n"
+         << "  -x               Execute the program instead of printing it.\n"
+         << "  -i               Execute the program using superinstructions.\n"
+         << "  -j               Execute the program, compiling hot functions.\n"
+         << "  -S               Print x86-64 assembly instead of quads.\n"
+         << "  -C               Print C source instead of quads.\n"
+         << "  -G               Print control-flow graphs for dot instead of quads.\n"
+         << "  -O               Optimize the quads.\n"
+         << "  -p rule          Turn off the named peephole rule.\n"
+         << "  -r               Report statistics on standard error.\n";
 
     exit(1);
 }
 
+
+/*
+ * CompileFunction
+ *
+ * Called by the parser once the body of a function has been parsed.
+ * Flatten and fold the body, generate quads from it and, with -O,
+ * optimize them. The function keeps the flat tree for printing.
+ */
+
+void CompileFunction(FunctionInformation *function)
+{
+    FlatAST     *tree;
+    QuadsList   *quads;
+
+    if (function->GetBody() == NULL)
+        return;
+
+    tree = new FlatAST(function->GetBody());
+    tree->Fold();
+    quads = new QuadsList(function);
+    tree->GenerateCode(*quads);
+    function->SetTree(tree);
+    function->SetQuads(quads);
+
+    if (optimizeQuads)
+        Optimize(function);
+    if (reportStatistics)
+        ControlFlowGraph(function).Record();
+}
+
 int main(int argc, char **argv)
 {
     int          option;
@@ -74,6 +128,42 @@ int main(int argc, char **argv)
         case 'd':
             yydebug = 1;
             break;
+        case 'x':
+            printQuads = 0;
+            executeProgram = 1;
+            break;
+        case 'i':
+            printQuads = 0;
+            executeProgram = 1;
+            superinstructions = 1;
+            break;
+        case 'S':
+            printQuads = 0;
+            generateAssembly = 1;
+            break;
+        case 'C':
+            printQuads = 0;
+            generateC = 1;
+            break;
+        case 'G':
+            printQuads = 0;
+            printGraphs = 1;
+            break;
+        case 'j':
+            printQuads = 0;
+            executeProgram = 1;
+            compileHotFunctions = 1;
+            break;
+        case 'O':
+            optimizeQuads = 1;
+            break;
+        case 'p':
+            if (!PeepholeOptimizer::Disable(optarg))
+                Usage(argv[0]);
+            break;
+        case 'r':
+            reportStatistics = 1;
+            break;
         case 'h':
             Usage(argv[0]);
             break;
@@ -98,11 +188,55 @@ int main(int argc, char **argv)
         Usage(argv[0]);
 
     //
-    // Compile the input
+    // Compile the input. A division by a constant takes several quads
+    // once it is reduced, which the virtual machine pays a dispatch for
+    // each of, so it is only reduced when the program is compiled to C,
+    // to assembly or, with -j, to native code for its hot functions.
     //
 
+    StrengthReduction::ReduceDivisions(!executeProgram || compileHotFunctions);
     yyparse();
 
+    if (reportStatistics)
+    {
+        SymbolTable::Report(std::cerr);
+        astArena.Report(std::cerr);
+        FlatAST::Report(std::cerr);
+        ControlFlowGraph::Report(std::cerr);
+        if (optimizeQuads)
+            OptimizationReport(std::cerr);
+    }
+
+    //
+    // Run it
+    //
+
+    if (executeProgram && errorCount == 0)
+    {
+        VirtualMachine vm;
+
+        vm.UseSuperinstructions(superinstructions);
+        vm.CountDispatches(reportStatistics);
+        vm.UseJIT(compileHotFunctions);
+        vm.Run(currentFunction);
+        if (reportStatistics)
+            vm.Report(std::cerr);
+    }
+
+    if (generateAssembly && errorCount == 0)
+    {
+        AssemblyGenerator asmgen(std::cout);
+
+        asmgen.Generate(currentFunction);
+    }
+
+    if (generateC && errorCount == 0)
+    {
+        CGenerator cgen(std::cout);
+
+        cgen.Generate(currentFunction);
+    }
+
     return 0;
 }
 
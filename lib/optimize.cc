@@ -0,0 +1,124 @@
+#include <iostream>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <optimize.hh>
+#include <cfg.hh>
+#include <dataflow.hh>
+#include <ssa.hh>
+
+
+static unsigned long    quadsGenerated;
+static unsigned long    quadsOptimized;
+static unsigned long    deadQuads;
+
+
+/*
+ * RemoveDeadCode
+ *
+ * Remove pure quads that assign a variable that isn't live after
+ * them. Each block is walked backwards from its live-out set, so a
+ * chain of dead quads within a block goes in one walk; removing a
+ * quad can make quads in other blocks dead too, so liveness is found
+ * again until nothing more goes. Dead quads are made nops until then,
+ * so that the graph stays the same and only liveness has to be found
+ * again.
+ */
+
+static void RemoveDeadCode(FunctionInformation *fn)
+{
+    QuadsList           *quads = fn->GetQuads();
+    ControlFlowGraph     graph(fn);
+    Liveness             liveness(&graph);
+    std::vector<long>    dead;
+    Quad                 q;
+    BitSet               live;
+    size_t               k;
+    long                 i;
+    int                  b, v;
+    bool                 removed;
+
+    do
+    {
+        removed = false;
+        for (b = 0; b < graph.Blocks(); b++)
+        {
+            if (!graph.Reachable(b))
+                continue;
+
+            live = liveness.Out(b);
+            live.Resize(liveness.Numbering().Size());
+            for (i = graph.Block(b).last; ; i = quads->Previous(i))
+            {
+                q = (*quads)[i];
+                v = q.Definition() ?
+                    liveness.Numbering().Number(q.Definition()) : -1;
+                if (q.Pure() && v >= 0 && !live.Test(v))
+                {
+                    quads->Replace(i, Quad());
+                    dead.push_back(i);
+                    deadQuads += 1;
+                    removed = true;
+                }
+                else
+                    liveness.Step(q, live);
+                if (i == graph.Block(b).first)
+                    break;
+            }
+        }
+        if (removed)
+            liveness.Update();
+    } while (removed);
+
+    for (k = 0; k < dead.size(); k++)
+        quads->Remove(dead[k]);
+}
+
+
+/*
+ * Optimize
+ *
+ * Run the optimization passes on the quads of one function.
+ */
+
+void Optimize(FunctionInformation *fn)
+{
+    if (fn->GetQuads() == NULL)
+        return;
+
+    quadsGenerated += fn->GetQuads()->Size();
+
+    PeepholeOptimizer(fn).Run();
+    ConstantPropagation(fn).Run();
+    LoopInvariantCodeMotion(fn).Run();
+    StrengthReduction(fn).Run();
+    ValueNumbering(fn).Run();
+    RemoveDeadCode(fn);
+    PeepholeOptimizer(fn).Run();
+
+    quadsOptimized += fn->GetQuads()->Size();
+}
+
+
+/*
+ * OptimizationReport
+ *
+ * Print how many quads were generated and how many were left after
+ * optimization in all functions, followed by the reports of the
+ * passes.
+ */
+
+void OptimizationReport(std::ostream& o)
+{
+    o << "Optimization report\n";
+    o << "Quads generated:     " << quadsGenerated << '\n';
+    o << "Quads optimized:     " << quadsOptimized << '\n';
+    o << "Dead quads removed:  " << deadQuads << '\n';
+    PeepholeOptimizer::Report(o);
+    SSAForm::Report(o);
+    ConstantPropagation::Report(o);
+    LoopInvariantCodeMotion::Report(o);
+    StrengthReduction::Report(o);
+    ValueNumbering::Report(o);
+    DataflowAnalysis::Report(o);
+}
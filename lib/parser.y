@@ -4,11 +4,16 @@
 #include <string.hh>
 #include <ast.hh>
 #include <symtab.hh>
+#include <cfg.hh>
 
 extern char                    *yytext;
 extern int                      yylineno, errorCount, warningCount;
+extern int                      printQuads;
+extern int                      printGraphs;
 extern FunctionInformation     *currentFunction;
 
+extern void CompileFunction(FunctionInformation *);
+
 extern int yylex(void);
 extern void yyerror(char *);
 extern char CheckCompatibleTypes(Expression **, Expression **);
@@ -50,7 +55,7 @@ extern std::ostream& warning(void);
     TypeInformation         *type;
     FunctionInformation     *function;
 
-    string                  *id;
+    Atom                    *id;
     int                      integer;
     double                   real;
     void                    *null;
@@ -66,7 +71,7 @@ extern std::ostream& warning(void);
 %type <call>            call
 %type <lvalue>          lvalue
 %type <type>            type
-%type <id>              id
+%type <id>              id ID
 %type <integer>         integer
 %type <real>            real
 %type <function>        funcname
@@ -74,10 +79,9 @@ extern std::ostream& warning(void);
 %type <elseIfList>      elseifpart
 
 /*
- * Normally tokens would have semantic types, but we've decided to
- * use the yytext variable for communicating data from the scanner
- * to the parser, so in this parser, none of the tokens have a
- * semantic type.
+ * Numbers are communicated from the scanner to the parser through
+ * the yytext variable. Identifiers are interned by the scanner,
+ * which passes their atom as the semantic value of ID.
  */
 
 %token FUNCTION ID DECLARE ARRAY INTEGER OF REAL XBEGIN XEND IF THEN
@@ -117,9 +121,14 @@ program     :   variables functions block ';'
                 if (errorCount == 0)
                 {
                     currentFunction->SetBody($3);
-                    currentFunction->GenerateCode();
-                    std::cout << currentFunction;
+                    CompileFunction(currentFunction);
+                    if (printQuads)
+                        std::cout << currentFunction;
+                    if (printGraphs)
+                        ControlFlowGraph(currentFunction).PrintDot(std::cout);
                 }
+                currentFunction->SetBody(NULL);
+                astArena.Release();
             }
             ;
 
@@ -141,14 +150,14 @@ declarations:   declarations declaration
 
 declaration :   id ':' type ';'
             {
-                if (currentFunction->OkToAddSymbol(*($1)))
+                if (currentFunction->OkToAddSymbol($1))
                 {
                     if ($3 != NULL)
-                        currentFunction->AddVariable(*($1), $3);
+                        currentFunction->AddVariable($1->name, $3);
                 }
                 else
                 {
-                    error() << *($1) << " is already declared\n" << std::flush;
+                    error() << $1->name << " is already declared\n" << std::flush;
                 }
             }
             | functions
@@ -186,10 +195,10 @@ functions   :   functions function
 
 function : FUNCTION id
         {
-          FunctionInformation* newFunction = new FunctionInformation(*($2));
+          FunctionInformation* newFunction = new FunctionInformation($2->name);
 
           newFunction->SetParent(currentFunction);
-          currentFunction->AddFunction(*($2), newFunction);
+          currentFunction->AddFunction($2->name, newFunction);
           currentFunction = newFunction;
         }
         parameters ':' type
@@ -198,7 +207,13 @@ function : FUNCTION id
         }
         function_body ';'
         {
-          std::cout << currentFunction << std::endl;
+          CompileFunction(currentFunction);
+          if (printQuads)
+            std::cout << currentFunction << std::endl;
+          if (printGraphs)
+            ControlFlowGraph(currentFunction).PrintDot(std::cout);
+          currentFunction->SetBody(NULL);
+          astArena.Release();
           currentFunction = currentFunction->GetParent();
 
         }
@@ -233,14 +248,14 @@ paramlist   :   paramlist ';' parameter
 
 parameter   :   id ':' type
             {
-                if (currentFunction->OkToAddSymbol(*($1)))
+                if (currentFunction->OkToAddSymbol($1))
                 {
-                    currentFunction->AddParameter(*($1), $3);
+                    currentFunction->AddParameter($1->name, $3);
                 }
                 else
                 {
-                    error() << *($1) << " already defined\n" << std::flush;
-                    currentFunction->AddParameter(*($1), $3);
+                    error() << $1->name << " already defined\n" << std::flush;
+                    currentFunction->AddParameter($1->name, $3);
                 }
             }
             ;
@@ -264,10 +279,10 @@ type        :   id
                 SymbolInformation       *info;
                 TypeInformation         *typeInfo;
 
-                info = currentFunction->LookupIdentifier(*($1));
+                info = currentFunction->LookupIdentifier($1);
                 if (info == NULL)
                 {
-                    error() << "undefined type " << *($1) << "\n" << std::flush;
+                    error() << "undefined type " << $1->name << "\n" << std::flush;
                     $$ = NULL;
                 }
                 else
@@ -276,7 +291,7 @@ type        :   id
 
                     if (typeInfo == NULL)
                     {
-                        error() << *($1) << " is not a type" << "\n" <<std::flush;
+                        error() << $1->name << " is not a type" << "\n" <<std::flush;
                         $$ = NULL;
                     }
                     else
@@ -470,12 +485,12 @@ variable    :   id
                 SymbolInformation       *info;
                 VariableInformation     *varInfo;
 
-                info = currentFunction->LookupIdentifier(*($1));
+                info = currentFunction->LookupIdentifier($1);
                 if (info == NULL)
                 {
                     error()
                         << "undeclared variable: "
-                        << *($1)
+                        << $1->name
                         << "\n"
                         << std::flush;
 
@@ -489,7 +504,7 @@ variable    :   id
                     {
                         error()
                             << "identifier "
-                            << *($1)
+                            << $1->name
                             << " is not a variable\n"
                             << std::flush;
                         $$ = NULL;
@@ -507,10 +522,10 @@ funcname    :   id
                 SymbolInformation       *info;
                 FunctionInformation     *funcInfo;
 
-                info = currentFunction->LookupIdentifier(*($1));
+                info = currentFunction->LookupIdentifier($1);
                 if (info == NULL)
                 {
-                    error() << *($1) << " is not defined\n" << std::flush;
+                    error() << $1->name << " is not defined\n" << std::flush;
                     $$ = NULL;
                 }
                 else
@@ -519,7 +534,7 @@ funcname    :   id
 
                     if (funcInfo == NULL)
                     {
-                        error() << *($1) << " is not a function\n" << std::flush;
+                        error() << $1->name << " is not a function\n" << std::flush;
                         $$ = NULL;
                     }
                     else
@@ -569,7 +584,7 @@ call        :   funcname '(' expressions ')'
 
 id          :   ID
             {
-                $$ = new string(yytext);
+                $$ = $1;
             }
             ;
 
@@ -645,12 +660,12 @@ factor     : expression '^' base
 base       : '-' expression { $$ = new UnaryMinus($2); }
            | id
            {
-              SymbolInformation* symbol = currentFunction->LookupIdentifier(*($1));
+              SymbolInformation* symbol = currentFunction->LookupIdentifier($1);
               VariableInformation* variable = symbol->SymbolAsVariable();
               if(variable != NULL) {
                 $$ = new Identifier(symbol->SymbolAsVariable());
               } else {
-                error() << "Unable to find variable: " << *($1) << std::endl;
+                error() << "Unable to find variable: " << $1->name << std::endl;
               }
            }
            | integer { $$ = new IntegerConstant($1) }
@@ -810,6 +825,9 @@ char CheckAssignmentTypes(LeftValue **left, Expression **right)
  * type conversion is necessary, the Expressions pointed to by the
  * ExpressionList will be modified accordingly.
  *
+ * Both lists are linked from the last element, so they are paired up
+ * last to first and then checked first to last, without recursion.
+ *
  * This function prints it's own error messages.
  */
 
@@ -817,11 +835,17 @@ char CheckFunctionParameters(FunctionInformation *func,
                              VariableInformation *formals,
                              ExpressionList      *params)
 {
-    if (formals == NULL && params == NULL)
+    std::vector<std::pair<VariableInformation *, ExpressionList *> > pairs;
+    unsigned long                                                   i;
+
+    while (formals != NULL && params != NULL)
     {
-        return 1;
+        pairs.push_back(std::make_pair(formals, params));
+        formals = formals->prev;
+        params = params->precedingExpressions;
     }
-    else if (formals == NULL && params != NULL)
+
+    if (formals == NULL && params != NULL)
     {
         error() << "too many arguments in call to " << func->id << '\n'
                 << std::flush;
@@ -833,48 +857,48 @@ char CheckFunctionParameters(FunctionInformation *func,
                 << std::flush;
         return 0;
     }
-    else
+
+    for (i = pairs.size(); i > 0; i--)
     {
-        if (CheckFunctionParameters(func, formals->prev,
-                                    params->precedingExpressions))
+        formals = pairs[i - 1].first;
+        params = pairs[i - 1].second;
+
+        if (formals->type == params->expression->valueType)
         {
-            if (formals->type == params->expression->valueType)
-            {
-                return 1;
-            }
-            else if (formals->type == kIntegerType &&
-                     params->expression->valueType == kRealType)
-            {
-                params->expression = new TruncateReal(params->expression);
-                return 1;
-            }
-            else if (formals->type == kRealType &&
-                     params->expression->valueType == kIntegerType)
-            {
-                params->expression = new IntegerToReal(params->expression);
-                return 1;
-            }
-            else
-            {
-                error() << "incompatible types in call to "
-                        << func->id
-                        << '\n'
-                        << std::flush;
-                error() << "  parameter "
-                        << formals->id
-                        << " was declared "
-                        << ShortSymbols
-                        << formals->type
-                        << '\n'
-                        << std::flush;
-                error() << "  argument was of type "
-                        << params->expression->valueType
-                        << '\n'
-                        << LongSymbols << std::flush;
-                return 0;
-            }
+            continue;
+        }
+        else if (formals->type == kIntegerType &&
+                 params->expression->valueType == kRealType)
+        {
+            params->expression = new TruncateReal(params->expression);
+        }
+        else if (formals->type == kRealType &&
+                 params->expression->valueType == kIntegerType)
+        {
+            params->expression = new IntegerToReal(params->expression);
+        }
+        else
+        {
+            error() << "incompatible types in call to "
+                    << func->id
+                    << '\n'
+                    << std::flush;
+            error() << "  parameter "
+                    << formals->id
+                    << " was declared "
+                    << ShortSymbols
+                    << formals->type
+                    << '\n'
+                    << std::flush;
+            error() << "  argument was of type "
+                    << params->expression->valueType
+                    << '\n'
+                    << LongSymbols << std::flush;
+            return 0;
         }
     }
+
+    return 1;
 }
 
 
@@ -0,0 +1,379 @@
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <optimize.hh>
+
+
+//
+// The pattern table. At each position the rules are tried in this
+// order, and the first one that fires wins. The window is the number
+// of quads, starting at the current one, that the rule matches; a rule
+// is not tried where fewer quads than that are left.
+//
+
+#define PEEPHOLE_WINDOW 3
+
+PeepholeOptimizer::Pattern PeepholeOptimizer::patterns[] =
+{
+    { "jump-to-next",     2, &PeepholeOptimizer::JumpToNext,      true, 0 },
+    { "jump-to-jump",     1, &PeepholeOptimizer::JumpToJump,      true, 0 },
+    { "branch-over-jump", 3, &PeepholeOptimizer::BranchOverJump,  true, 0 },
+    { "unreachable-code", 2, &PeepholeOptimizer::UnreachableCode, true, 0 },
+    { "unused-label",     1, &PeepholeOptimizer::UnusedLabel,     true, 0 },
+    { "temporary-copy",   2, &PeepholeOptimizer::TemporaryCopy,   true, 0 },
+    { NULL,               0, NULL,                                false, 0 }
+};
+
+
+PeepholeOptimizer::PeepholeOptimizer(FunctionInformation *fn) :
+    function(fn),
+    quads(fn->GetQuads())
+{
+}
+
+
+/*
+ * PeepholeOptimizer::Scan
+ *
+ * Find every label, count the jumps to it and count how many times
+ * each temporary is read. Remove and Retarget keep the labels and
+ * the jump counts up to date. The read counts are only ever too high
+ * after quads have been removed, which just makes TemporaryCopy more
+ * careful than it needs to be until the next sweep.
+ */
+
+void PeepholeOptimizer::Scan(void)
+{
+    QuadsListIterator        iter(quads);
+    VariableInformation     *uses[2];
+    Quad                    *quad;
+    int                      i, n;
+
+    labels.clear();
+    references.clear();
+    reads.assign(function->GetTemporaryCount() + 1, 0);
+
+    while ((quad = iter.Next()) != NULL)
+    {
+        if (quad->opcode == clabel)
+            labels[quad->int1] = iter.Index();
+        else if (quad->opcode == jump || quad->opcode == jtrue ||
+                 quad->opcode == jfalse)
+            references[quad->int1] += 1;
+
+        n = quad->Uses(uses);
+        for (i = 0; i < n; i++)
+            if (uses[i] != NULL && uses[i]->temporary > 0)
+                reads[uses[i]->temporary] += 1;
+    }
+}
+
+bool PeepholeOptimizer::IsJump(long i)
+{
+    return quads->Opcode(i) == jump || quads->Opcode(i) == jtrue ||
+        quads->Opcode(i) == jfalse;
+}
+
+void PeepholeOptimizer::Remove(long i)
+{
+    if (IsJump(i))
+        references[(*quads)[i].int1] -= 1;
+    else if (quads->Opcode(i) == clabel)
+        labels.erase((*quads)[i].int1);
+    quads->Remove(i);
+}
+
+void PeepholeOptimizer::Retarget(long i, long label)
+{
+    Quad        q = (*quads)[i];
+
+    references[q.int1] -= 1;
+    references[label] += 1;
+    q.int1 = label;
+    quads->Replace(i, q);
+}
+
+/*
+ * PeepholeOptimizer::FinalTarget
+ *
+ * Follow a chain of labels that are immediately followed by a jump
+ * and return the label at the end of it. A chain that loops back on
+ * itself is left alone.
+ */
+
+long PeepholeOptimizer::FinalTarget(long label)
+{
+    long        start = label;
+    long        i;
+    unsigned    steps;
+
+    for (steps = 0; steps <= labels.size(); steps++)
+    {
+        if (labels.count(label) == 0)
+            return label;
+        for (i = quads->Next(labels[label]);
+             i >= 0 && quads->Opcode(i) == clabel;
+             i = quads->Next(i))
+            ;
+        if (i < 0 || quads->Opcode(i) != jump)
+            return label;
+        label = (*quads)[i].int1;
+    }
+
+    return start;
+}
+
+
+//
+// The rules. Each one gets the indices of the quads in its window,
+// which are all in the list, and returns true if it changed anything.
+//
+
+/*
+ * jump L; clabel L
+ *
+ * A jump to a label that comes next, possibly after other labels,
+ * does nothing. This goes for conditional jumps too.
+ */
+
+bool PeepholeOptimizer::JumpToNext(long *w)
+{
+    long        i, label;
+
+    if (!IsJump(w[0]))
+        return false;
+
+    label = (*quads)[w[0]].int1;
+    for (i = w[1]; i >= 0 && quads->Opcode(i) == clabel; i = quads->Next(i))
+    {
+        if ((*quads)[i].int1 == label)
+        {
+            Remove(w[0]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * jump L1 ... clabel L1; jump L2
+ *
+ * A jump to a jump can go straight to the final target.
+ */
+
+bool PeepholeOptimizer::JumpToJump(long *w)
+{
+    long        label;
+
+    if (!IsJump(w[0]))
+        return false;
+
+    label = FinalTarget((*quads)[w[0]].int1);
+    if (label == (*quads)[w[0]].int1)
+        return false;
+
+    Retarget(w[0], label);
+    return true;
+}
+
+/*
+ * jfalse L1 c; jump L2; clabel L1
+ *
+ * A conditional jump over an unconditional one becomes a single
+ * conditional jump the other way.
+ */
+
+bool PeepholeOptimizer::BranchOverJump(long *w)
+{
+    Quad        branch;
+    long        target;
+
+    if ((quads->Opcode(w[0]) != jtrue && quads->Opcode(w[0]) != jfalse) ||
+        quads->Opcode(w[1]) != jump || quads->Opcode(w[2]) != clabel ||
+        (*quads)[w[0]].int1 != (*quads)[w[2]].int1)
+        return false;
+
+    target = (*quads)[w[1]].int1;
+    Retarget(w[0], target);
+    branch = (*quads)[w[0]];
+    branch.opcode = branch.opcode == jtrue ? jfalse : jtrue;
+    quads->Replace(w[0], branch);
+    Remove(w[1]);
+    return true;
+}
+
+/*
+ * jump L; q
+ *
+ * Nothing after an unconditional jump or a return is reached unless
+ * it has a label.
+ */
+
+bool PeepholeOptimizer::UnreachableCode(long *w)
+{
+    if ((quads->Opcode(w[0]) != jump && quads->Opcode(w[0]) != creturn) ||
+        quads->Opcode(w[1]) == clabel)
+        return false;
+
+    Remove(w[1]);
+    return true;
+}
+
+/*
+ * clabel L
+ *
+ * A label that nothing jumps to can go.
+ */
+
+bool PeepholeOptimizer::UnusedLabel(long *w)
+{
+    if (quads->Opcode(w[0]) != clabel ||
+        references[(*quads)[w[0]].int1] > 0)
+        return false;
+
+    Remove(w[0]);
+    return true;
+}
+
+/*
+ * op a b T; iassign T - x
+ *
+ * A temporary that is computed only to be copied into a variable, and
+ * isn't read anywhere else, isn't needed: the quad that computes it
+ * can assign the variable directly.
+ */
+
+bool PeepholeOptimizer::TemporaryCopy(long *w)
+{
+    VariableInformation *temporary;
+    Quad                 first;
+    Quad                 copy;
+
+    if ((quads->Opcode(w[1]) != iassign && quads->Opcode(w[1]) != rassign) ||
+        quads->Opcode(w[0]) == aassign)
+        return false;
+
+    copy = (*quads)[w[1]];
+    first = (*quads)[w[0]];
+    temporary = copy.sym1->SymbolAsVariable();
+    if (temporary == NULL || temporary->temporary == 0 ||
+        reads[temporary->temporary] != 1 ||
+        first.Definition() != temporary)
+        return false;
+
+    first.sym3 = copy.sym3;
+    quads->Replace(w[0], first);
+    Remove(w[1]);
+    return true;
+}
+
+
+/*
+ * PeepholeOptimizer::Run
+ *
+ * Sweep the quads until no rule fires. The labels and temporaries
+ * are counted again before every sweep. Returns true if anything was
+ * changed.
+ */
+
+bool PeepholeOptimizer::Run(void)
+{
+    long        window[PEEPHOLE_WINDOW];
+    long        i, previous;
+    int         k, p;
+    bool        changed, fired;
+
+    if (quads == NULL)
+        return false;
+
+    changed = false;
+    do
+    {
+        fired = false;
+        Scan();
+        i = quads->First();
+        while (i >= 0)
+        {
+            previous = quads->Previous(i);
+            window[0] = i;
+            for (k = 1; k < PEEPHOLE_WINDOW; k++)
+                window[k] = window[k - 1] >= 0 ? quads->Next(window[k - 1]) : -1;
+
+            for (p = 0; patterns[p].name != NULL; p++)
+                if (patterns[p].enabled &&
+                    window[patterns[p].window - 1] >= 0 &&
+                    (this->*patterns[p].rule)(window))
+                    break;
+
+            if (patterns[p].name == NULL)
+            {
+                i = quads->Next(i);
+                continue;
+            }
+
+            patterns[p].hits += 1;
+            fired = changed = true;
+            i = previous >= 0 ? quads->Next(previous) : quads->First();
+        }
+    } while (fired);
+
+    return changed;
+}
+
+
+/*
+ * PeepholeOptimizer::Disable
+ *
+ * Turn off the rule with the given name. Returns false if there is no
+ * such rule.
+ */
+
+bool PeepholeOptimizer::Disable(const char *name)
+{
+    int         p;
+
+    for (p = 0; patterns[p].name != NULL; p++)
+    {
+        if (strcmp(patterns[p].name, name) == 0)
+        {
+            patterns[p].enabled = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * PeepholeOptimizer::Report
+ *
+ * Print how many times each rule has fired.
+ */
+
+void PeepholeOptimizer::Report(std::ostream& o)
+{
+    unsigned long   total;
+    int             p;
+
+    total = 0;
+    o << "Peephole report\n";
+    o << std::setw(20) << "rule"
+      << std::setw(10) << "hits" << '\n';
+
+    for (p = 0; patterns[p].name != NULL; p++)
+    {
+        o << std::setw(20) << patterns[p].name
+          << std::setw(10) << patterns[p].hits;
+        if (!patterns[p].enabled)
+            o << "  (off)";
+        o << '\n';
+        total += patterns[p].hits;
+    }
+
+    o << "Rewrites:            " << total << '\n';
+}
@@ -0,0 +1,78 @@
+/*
+ * Run-time support for programs compiled with parser -S. Link the
+ * generated assembly with this file and the math library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+extern void komp_main(void);
+
+void komp_error(const char *message)
+{
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: %s\n", message);
+    exit(1);
+}
+
+void komp_division_by_zero(void)
+{
+    komp_error("integer division by zero");
+}
+
+long putint(long x)
+{
+    printf("%ld\n", x);
+    return 0;
+}
+
+long putreal(double x)
+{
+    if (isnan(x))
+        printf("nan\n");
+    else
+        printf("%g\n", x);
+    return 0;
+}
+
+long getint(void)
+{
+    long x = 0;
+
+    if (scanf("%ld", &x) != 1)
+        return 0;
+    return x;
+}
+
+double getreal(void)
+{
+    double x = 0.0;
+
+    if (scanf("%lf", &x) != 1)
+        return 0.0;
+    return x;
+}
+
+long komp_ipow(long x, long y)
+{
+    long result = 1;
+
+    if (y < 0)
+        return x == 1 ? 1 : x == -1 ? (y & 1 ? -1 : 1) : 0;
+
+    while (y > 0)
+    {
+        if (y & 1)
+            result = (long)((unsigned long)result * (unsigned long)x);
+        x = (long)((unsigned long)x * (unsigned long)x);
+        y >>= 1;
+    }
+    return result;
+}
+
+int main(void)
+{
+    komp_main();
+    return 0;
+}
@@ -0,0 +1,569 @@
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <set>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <optimize.hh>
+#include <cfg.hh>
+#include <ssa.hh>
+#include <vm.hh>
+
+
+unsigned long ConstantPropagation::propagated;
+unsigned long ConstantPropagation::folded;
+unsigned long ConstantPropagation::removed;
+
+
+//
+// Integer arithmetic wraps around, just like it does at run time.
+//
+
+static long WrapAdd(long a, long b) { return (long)((unsigned long)a + (unsigned long)b); }
+static long WrapSub(long a, long b) { return (long)((unsigned long)a - (unsigned long)b); }
+static long WrapMul(long a, long b) { return (long)((unsigned long)a * (unsigned long)b); }
+
+
+ConstantPropagation::ConstantPropagation(FunctionInformation *fn) :
+    function(fn),
+    quads(fn->GetQuads()),
+    graph(NULL),
+    ssa(NULL)
+{
+}
+
+
+/*
+ * ConstantPropagation::ValueOf
+ * ConstantPropagation::Lower
+ *
+ * Only temporaries are followed; every other variable may hold
+ * anything. Lower moves the value of a temporary down to the meet of
+ * its old value and a new one, and if that changed it, queues the
+ * temporary so its uses are evaluated again.
+ */
+
+ConstantPropagation::Value ConstantPropagation::ValueOf(SymbolInformation *s)
+{
+    VariableInformation *v;
+
+    v = s != NULL ? s->SymbolAsVariable() : NULL;
+    if (v == NULL || v->temporary <= 0 || v->temporary >= (long)values.size())
+        return Value(kVarying);
+    return values[v->temporary];
+}
+
+bool ConstantPropagation::Equal(const Value& a, const Value& b)
+{
+    return a.state == b.state &&
+        (a.state != kConstant ||
+         (a.integer == b.integer &&
+          memcmp(&a.real, &b.real, sizeof(a.real)) == 0));
+}
+
+void ConstantPropagation::Lower(VariableInformation *v, const Value& value)
+{
+    if (v == NULL || v->temporary <= 0 || v->temporary >= (long)values.size())
+        return;
+
+    Value&   old = values[v->temporary];
+
+    if (value.state == kUnknown || Equal(old, value) || old.state == kVarying)
+        return;
+
+    old = old.state == kUnknown ? value : Value(kVarying);
+    changed.push_back(v->temporary);
+}
+
+
+/*
+ * ConstantPropagation::Evaluate
+ *
+ * Compute the value of the result of a quad from the values of its
+ * operands. If either operand may be anything, so may the result,
+ * except that an iand with a zero or an ior with something nonzero
+ * is known anyway.
+ */
+
+ConstantPropagation::Value ConstantPropagation::Evaluate(Quad& q)
+{
+    Value       a, b, r(kConstant);
+    long        x, y;
+    double      u, w;
+    bool        absorbing;
+
+    switch (q.opcode)
+    {
+    case iconst:
+        r.integer = q.int1;
+        return r;
+    case rconst:
+        r.real = q.real1;
+        return r;
+    case iassign: case rassign:
+        return ValueOf(q.sym1);
+    case itor: case rtrunc: case ineg: case rneg: case inot:
+    case iadd: case isub: case imul: case idiv: case ipow:
+    case radd: case rsub: case rmul: case rdiv: case rpow:
+    case igt: case ilt: case ieq: case ile: case ige: case ine:
+    case rgt: case rlt: case req: case rle: case rge: case rne:
+    case iand: case ior:
+        break;
+    default:
+        return Value(kVarying);
+    }
+
+    a = ValueOf(q.sym1);
+    b = q.sym2 != NULL ? ValueOf(q.sym2) : Value(kConstant);
+
+    if (q.opcode == iand || q.opcode == ior)
+    {
+        absorbing = q.opcode == ior;
+        if ((a.state == kConstant && (a.integer != 0) == absorbing) ||
+            (b.state == kConstant && (b.integer != 0) == absorbing))
+        {
+            r.integer = absorbing;
+            return r;
+        }
+    }
+
+    if (a.state == kVarying || b.state == kVarying)
+        return Value(kVarying);
+    if (a.state == kUnknown || b.state == kUnknown)
+        return Value(kUnknown);
+
+    x = a.integer;
+    y = b.integer;
+    u = a.real;
+    w = b.real;
+
+    switch (q.opcode)
+    {
+    case itor:
+        r.real = (double)x;
+        break;
+    case rtrunc:
+        if (!(u > -9.2e18 && u < 9.2e18))
+            return Value(kVarying);
+        r.integer = (long)u;
+        break;
+    case iadd: r.integer = WrapAdd(x, y); break;
+    case isub: r.integer = WrapSub(x, y); break;
+    case imul: r.integer = WrapMul(x, y); break;
+    case ipow: r.integer = IntegerPower(x, y); break;
+    case ineg: r.integer = WrapSub(0, x); break;
+    case idiv:
+        if (y == 0)
+            return Value(kVarying);
+        r.integer = y == -1 ? WrapSub(0, x) : x / y;
+        break;
+    case radd: r.real = u + w; break;
+    case rsub: r.real = u - w; break;
+    case rmul: r.real = u * w; break;
+    case rdiv: r.real = u / w; break;
+    case rpow: r.real = pow(u, w); break;
+    case rneg: r.real = -u; break;
+    case igt:  r.integer = x > y; break;
+    case ilt:  r.integer = x < y; break;
+    case ieq:  r.integer = x == y; break;
+    case ile:  r.integer = x <= y; break;
+    case ige:  r.integer = x >= y; break;
+    case ine:  r.integer = x != y; break;
+    case rgt:  r.integer = u > w; break;
+    case rlt:  r.integer = u < w; break;
+    case req:  r.integer = u == w; break;
+    case rle:  r.integer = u <= w; break;
+    case rge:  r.integer = u >= w; break;
+    case rne:  r.integer = u != w; break;
+    case iand: r.integer = x && y; break;
+    case ior:  r.integer = x || y; break;
+    case inot: r.integer = !x; break;
+    default:
+        return Value(kVarying);
+    }
+
+    if (!std::isfinite(r.real))
+        return Value(kVarying);
+    return r;
+}
+
+
+/*
+ * ConstantPropagation::Take
+ *
+ * Mark the edge from block from to block to as taken, and queue it if
+ * it wasn't already.
+ */
+
+void ConstantPropagation::Take(int from, int to)
+{
+    std::vector<int>&    successors = graph->Block(from).successors;
+    size_t               k;
+
+    k = std::find(successors.begin(), successors.end(), to) -
+        successors.begin();
+    if (k == successors.size() || taken[from][k])
+        return;
+
+    taken[from][k] = 1;
+    edges.push_back(std::make_pair(from, to));
+}
+
+/*
+ * ConstantPropagation::Visit
+ * ConstantPropagation::VisitPhi
+ *
+ * Evaluate a quad or a phi in a block that has been reached. A jump
+ * takes the edges its condition allows, and the last quad of a block
+ * that doesn't jump takes the edge to the next block. A phi is the
+ * meet of its arguments over the edges taken so far.
+ */
+
+void ConstantPropagation::Visit(long i)
+{
+    Quad        q((*quads)[i]);
+    Value       condition;
+    size_t      k;
+    int         b;
+
+    b = graph->BlockOf(i);
+    if (!executable[b])
+        return;
+
+    switch (q.opcode)
+    {
+    case jtrue: case jfalse:
+        condition = ValueOf(q.sym2);
+        if (condition.state == kVarying)
+        {
+            Take(b, labels[q.int1]);
+            Take(b, b + 1);
+        }
+        else if (condition.state == kConstant)
+        {
+            if ((condition.integer != 0) == (q.opcode == jtrue))
+                Take(b, labels[q.int1]);
+            else
+                Take(b, b + 1);
+        }
+        return;
+    case jump:
+        Take(b, labels[q.int1]);
+        return;
+    case creturn:
+        return;
+    default:
+        Lower(q.Definition(), Evaluate(q));
+        if (i == graph->Block(b).last)
+            for (k = 0; k < graph->Block(b).successors.size(); k++)
+                Take(b, graph->Block(b).successors[k]);
+        return;
+    }
+}
+
+void ConstantPropagation::VisitPhi(int p)
+{
+    Phi&                 phi = ssa->PhiAt(p);
+    std::vector<int>    *successors;
+    Value                meet, a;
+    size_t               j, k;
+    int                  from;
+
+    if (!executable[phi.block])
+        return;
+
+    for (j = 0; j < phi.arguments.size(); j++)
+    {
+        from = graph->Block(phi.block).predecessors[j];
+        successors = &graph->Block(from).successors;
+        k = std::find(successors->begin(), successors->end(), phi.block) -
+            successors->begin();
+        if (!taken[from][k] || phi.arguments[j] == NULL)
+            continue;
+
+        a = ValueOf(phi.arguments[j]);
+        if (a.state == kUnknown)
+            continue;
+        if (meet.state == kUnknown)
+            meet = a;
+        else if (!Equal(meet, a))
+            meet = Value(kVarying);
+    }
+
+    Lower(phi.result, meet);
+}
+
+
+/*
+ * ConstantPropagation::Propagate
+ *
+ * Work through the taken edges and the changed temporaries until
+ * both lists are empty. A block that is reached for the first time
+ * has all of its quads evaluated; after that only its phis need to
+ * be. A condition that is still unknown at the end is never assigned
+ * on the way to its jump, so it could be anything, and both of its
+ * edges are taken before trying again.
+ */
+
+void ConstantPropagation::Propagate(void)
+{
+    Quad        q;
+    size_t      k;
+    long        i, t;
+    int         b;
+    bool        stuck;
+
+    executable[0] = 1;
+    for (i = graph->Block(0).first; ; i = quads->Next(i))
+    {
+        Visit(i);
+        if (i == graph->Block(0).last)
+            break;
+    }
+
+    do
+    {
+        while (!edges.empty() || !changed.empty())
+        {
+            while (!edges.empty())
+            {
+                b = edges.front().second;
+                edges.pop_front();
+
+                if (executable[b])
+                {
+                    for (k = 0; k < ssa->PhisIn(b).size(); k++)
+                        VisitPhi(ssa->PhisIn(b)[k]);
+                    continue;
+                }
+
+                executable[b] = 1;
+                for (k = 0; k < ssa->PhisIn(b).size(); k++)
+                    VisitPhi(ssa->PhisIn(b)[k]);
+                for (i = graph->Block(b).first; ; i = quads->Next(i))
+                {
+                    Visit(i);
+                    if (i == graph->Block(b).last)
+                        break;
+                }
+            }
+
+            while (!changed.empty())
+            {
+                t = changed.front();
+                changed.pop_front();
+                for (k = 0; k < users[t].size(); k++)
+                    Visit(users[t][k]);
+                for (k = 0; k < phiUsers[t].size(); k++)
+                    VisitPhi(phiUsers[t][k]);
+            }
+        }
+
+        stuck = false;
+        for (b = 0; b < graph->Blocks(); b++)
+        {
+            q = (*quads)[graph->Block(b).last];
+            if (executable[b] && (q.opcode == jtrue || q.opcode == jfalse) &&
+                ValueOf(q.sym2).state == kUnknown)
+            {
+                Take(b, labels[q.int1]);
+                Take(b, b + 1);
+                stuck = stuck || !edges.empty();
+            }
+        }
+    } while (stuck);
+}
+
+
+/*
+ * ConstantPropagation::Rewrite
+ *
+ * Turn the quads that compute constants into iconst and rconst, and
+ * branches on constants into jumps, or nothing. The quads that are no
+ * longer needed are added to dead, to be removed once the function is
+ * out of SSA form. Phis need nothing: every version that reaches a
+ * constant phi already holds the constant.
+ */
+
+Quad ConstantPropagation::Constant(VariableInformation *v)
+{
+    Value       value = ValueOf(v);
+
+    if (v->type == kRealType)
+        return Quad(rconst, value.real, NULL, v);
+    return Quad(iconst, value.integer, NULL, v);
+}
+
+void ConstantPropagation::Rewrite(std::vector<long>& dead)
+{
+    Quad                 q;
+    Value                condition;
+    VariableInformation *v;
+    long                 i;
+    int                  b;
+
+    for (b = 0; b < graph->Blocks(); b++)
+    {
+        if (!executable[b])
+        {
+            for (i = graph->Block(b).first; ; i = quads->Next(i))
+            {
+                dead.push_back(i);
+                if (i == graph->Block(b).last)
+                    break;
+            }
+            if (graph->Reachable(b))
+                removed += 1;
+            continue;
+        }
+
+        for (i = graph->Block(b).first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            if (q.opcode == jtrue || q.opcode == jfalse)
+            {
+                condition = ValueOf(q.sym2);
+                if (condition.state == kConstant)
+                {
+                    if ((condition.integer != 0) == (q.opcode == jtrue))
+                        quads->Replace(i, Quad(jump, q.int1, NULL, NULL));
+                    else
+                        dead.push_back(i);
+                    folded += 1;
+                }
+            }
+            else if (q.opcode != iconst && q.opcode != rconst &&
+                     (v = q.Definition()) != NULL &&
+                     ValueOf(v).state == kConstant)
+            {
+                quads->Replace(i, Constant(v));
+                propagated += 1;
+            }
+            if (i == graph->Block(b).last)
+                break;
+        }
+    }
+}
+
+
+/*
+ * ConstantPropagation::Run
+ *
+ * Put the function in SSA form, propagate constants, rewrite the
+ * quads and take the function out of SSA form again. SSA form has no
+ * room for a jump to the entry, so if there is one the function gets
+ * an empty entry block while this runs. Returns true if anything was
+ * found to be constant or unreachable.
+ */
+
+bool ConstantPropagation::Run(void)
+{
+    SymbolInformation  **operands[2];
+    std::vector<long>    dead;
+    std::set<long>       starts;
+    VariableInformation *v;
+    Quad                 q;
+    unsigned long        before;
+    long                 i, entry;
+    size_t               k;
+    int                  b, m, o, p;
+
+    if (quads == NULL || quads->First() < 0)
+        return false;
+
+    // The entry block holds the labels the function starts with.
+    for (i = quads->First(); i >= 0 && quads->Opcode(i) == clabel;
+         i = quads->Next(i))
+        starts.insert((*quads)[i].int1);
+
+    entry = -1;
+    for (i = quads->First(); i >= 0; i = quads->Next(i))
+        if ((quads->Opcode(i) == jump || quads->Opcode(i) == jtrue ||
+             quads->Opcode(i) == jfalse) && starts.count((*quads)[i].int1))
+            break;
+    if (i >= 0)
+        entry = quads->InsertBefore(quads->First(), q);
+
+    ControlFlowGraph     g(function);
+    SSAForm              form(&g);
+
+    graph = &g;
+    ssa = &form;
+
+    labels.clear();
+    values.assign(function->GetTemporaryCount() + 1, Value(kVarying));
+    users.assign(values.size(), std::vector<long>());
+    phiUsers.assign(values.size(), std::vector<int>());
+    executable.assign(g.Blocks(), 0);
+    taken.resize(g.Blocks());
+
+    //
+    // Find the labels, the temporaries that are assigned somewhere
+    // they can be reached, and the uses of every temporary.
+    //
+
+    for (b = 0; b < g.Blocks(); b++)
+    {
+        taken[b].assign(g.Block(b).successors.size(), 0);
+        for (i = g.Block(b).first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            if (q.opcode == clabel)
+                labels[q.int1] = b;
+            if (g.Reachable(b) && (v = q.Definition()) != NULL &&
+                v->temporary > 0)
+                values[v->temporary] = Value(kUnknown);
+
+            m = SSAForm::UseOperands(q, operands);
+            for (o = 0; o < m; o++)
+                if ((v = (*operands[o])->SymbolAsVariable()) != NULL &&
+                    v->temporary > 0)
+                    users[v->temporary].push_back(i);
+
+            if (i == g.Block(b).last)
+                break;
+        }
+    }
+
+    for (p = 0; p < form.Phis(); p++)
+    {
+        values[form.PhiAt(p).result->temporary] = Value(kUnknown);
+        for (k = 0; k < form.PhiAt(p).arguments.size(); k++)
+            if ((v = form.PhiAt(p).arguments[k]) != NULL && v->temporary > 0)
+                phiUsers[v->temporary].push_back(p);
+    }
+
+    before = propagated + folded + removed;
+
+    Propagate();
+    Rewrite(dead);
+    form.Destruct();
+
+    for (k = 0; k < dead.size(); k++)
+        quads->Remove(dead[k]);
+    if (entry >= 0)
+        quads->Remove(entry);
+
+    graph = NULL;
+    ssa = NULL;
+
+    return propagated + folded + removed != before;
+}
+
+
+/*
+ * ConstantPropagation::Report
+ *
+ * Print how many quads and phis were found to be constant, how many branches were
+ * folded and how many blocks were never reached, in all functions.
+ */
+
+void ConstantPropagation::Report(std::ostream& o)
+{
+    o << "Constant propagation report\n";
+    o << "Constants found:     " << propagated << '\n';
+    o << "Branches folded:     " << folded << '\n';
+    o << "Blocks removed:      " << removed << '\n';
+}
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+#include <map>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <cfg.hh>
+#include <dataflow.hh>
+#include <ssa.hh>
+
+
+unsigned long SSAForm::placed;
+unsigned long SSAForm::renamed;
+
+
+SSAForm::SSAForm(ControlFlowGraph *g) :
+    graph(g),
+    function(g->Function()),
+    quads(g->Quads()),
+    firstVersion(g->Function()->GetTemporaryCount()),
+    lastVersion(firstVersion)
+{
+    Liveness     liveness(g);
+
+    phisIn.resize(g->Blocks());
+    if (g->Blocks() == 0)
+        return;
+
+    if (!g->Block(0).predecessors.empty())
+    {
+        std::cerr << "Bug: SSA form of " << function->id
+                  << " with a jump to its entry\n";
+        abort();
+    }
+
+    Promote(liveness.Numbering());
+    PlacePhis(liveness);
+    Rename(liveness.Numbering());
+    lastVersion = function->GetTemporaryCount();
+}
+
+
+/*
+ * SSAForm::UseOperands
+ *
+ * Store pointers to the operands of a quad that Quad::Uses would
+ * return in operands, so that they can be changed, and return how
+ * many there are.
+ */
+
+int SSAForm::UseOperands(Quad& q, SymbolInformation **operands[2])
+{
+    int         n = 0;
+
+    switch (q.opcode)
+    {
+    case iconst: case rconst: case call:
+    case jump: case clabel: case hcf: case nop:
+        break;
+    case jtrue: case jfalse:
+        operands[n++] = &q.sym2;
+        break;
+    case creturn:
+        if (q.sym3 != NULL)
+            operands[n++] = &q.sym3;
+        break;
+    case istore: case rstore:
+        operands[n++] = &q.sym1;
+        operands[n++] = &q.sym3;
+        break;
+    default:
+        if (q.sym1 != NULL)
+            operands[n++] = &q.sym1;
+        if (q.sym2 != NULL)
+            operands[n++] = &q.sym2;
+        break;
+    }
+
+    return n;
+}
+
+
+/*
+ * SSAForm::Promote
+ *
+ * Decide which variables to rename: the temporaries that are assigned
+ * more than once, and the scalar variables of the function that no
+ * call can see.
+ */
+
+void SSAForm::Promote(VariableNumbering& numbering)
+{
+    std::vector<int>     definitions(numbering.Size(), 0);
+    BitSet               exposed(numbering.Size());
+    Quad                 q;
+    VariableInformation *v;
+    long                 i;
+    int                  n;
+
+    for (i = quads->First(); i >= 0; i = quads->Next(i))
+    {
+        q = (*quads)[i];
+        if (q.opcode == call)
+            exposed.Union(numbering.Visible(q));
+        if ((v = q.Definition()) != NULL && (n = numbering.Number(v)) >= 0)
+            definitions[n] += 1;
+    }
+
+    promoted.assign(numbering.Size(), 0);
+    for (n = 0; n < numbering.Size(); n++)
+    {
+        v = numbering.Variable(n);
+        if (numbering.IsTemporary(n))
+            promoted[n] = definitions[n] > 1;
+        else
+            promoted[n] = numbering.IsLocal(n) && !exposed.Test(n) &&
+                v->type->elementType == NULL;
+        renamed += promoted[n];
+    }
+}
+
+
+/*
+ * SSAForm::PlacePhis
+ *
+ * Place a phi for a variable at the dominance frontier of every block
+ * that assigns it, and since a phi is an assignment too, at the
+ * frontier of every block that gets one. Blocks where the variable is
+ * dead don't need a phi.
+ */
+
+void SSAForm::PlacePhis(Liveness& liveness)
+{
+    VariableNumbering&               numbering = liveness.Numbering();
+    std::vector<std::vector<int> >   sites(numbering.Size());
+    std::vector<int>                 work;
+    std::vector<int>                 hasPhi(graph->Blocks(), -1);
+    std::vector<int>                 queued(graph->Blocks(), -1);
+    VariableInformation             *v;
+    long                             i;
+    size_t                           k;
+    int                              b, n, x, y;
+
+    for (b = 0; b < graph->Blocks(); b++)
+    {
+        if (!graph->Reachable(b))
+            continue;
+        for (i = graph->Block(b).first; ; i = quads->Next(i))
+        {
+            v = (*quads)[i].Definition();
+            if (v != NULL && (n = numbering.Number(v)) >= 0 && promoted[n] &&
+                (sites[n].empty() || sites[n].back() != b))
+                sites[n].push_back(b);
+            if (i == graph->Block(b).last)
+                break;
+        }
+    }
+
+    for (n = 0; n < numbering.Size(); n++)
+    {
+        if (!promoted[n])
+            continue;
+
+        work = sites[n];
+        for (k = 0; k < work.size(); k++)
+            queued[work[k]] = n;
+
+        while (!work.empty())
+        {
+            x = work.back();
+            work.pop_back();
+            for (k = 0; k < graph->Block(x).frontier.size(); k++)
+            {
+                y = graph->Block(x).frontier[k];
+                if (hasPhi[y] == n || !liveness.In(y).Test(n))
+                    continue;
+
+                hasPhi[y] = n;
+                phisIn[y].push_back(phis.size());
+                phis.push_back(Phi(y, numbering.Variable(n)));
+                phis.back().arguments.assign(
+                    graph->Block(y).predecessors.size(), NULL);
+                placed += 1;
+
+                if (queued[y] != n)
+                {
+                    queued[y] = n;
+                    work.push_back(y);
+                }
+            }
+        }
+    }
+}
+
+
+/*
+ * SSAForm::Rename
+ *
+ * Walk the dominator tree from the entry, keeping a stack of versions
+ * for every variable. Each assignment and phi pushes a new temporary,
+ * which the uses below it are changed to, and the versions on top of
+ * the stacks at the end of a block become the arguments of the phis
+ * in its successors. The walk keeps its own stack, like the graph
+ * does.
+ */
+
+void SSAForm::Rename(VariableNumbering& numbering)
+{
+    std::vector<std::vector<VariableInformation *> > stacks(numbering.Size());
+    std::vector<int>                 pushed;
+    std::vector<int>                 walk;
+    std::vector<size_t>              next;
+    std::vector<size_t>              mark;
+    SymbolInformation              **operands[2];
+    VariableInformation             *v, *t;
+    Quad                             q;
+    std::vector<int>                *predecessors;
+    long                             i;
+    size_t                           k, j;
+    int                              b, s, n, m, o;
+    bool                             changed;
+
+    walk.push_back(0);
+    next.push_back(0);
+    mark.push_back(0);
+
+    while (!walk.empty())
+    {
+        b = walk.back();
+
+        if (next.back() > 0)
+        {
+            if (next.back() - 1 < graph->Block(b).dominates.size())
+            {
+                s = graph->Block(b).dominates[next.back() - 1];
+                next.back() += 1;
+                walk.push_back(s);
+                next.push_back(0);
+                mark.push_back(0);
+                continue;
+            }
+
+            while (pushed.size() > mark.back())
+            {
+                stacks[pushed.back()].pop_back();
+                pushed.pop_back();
+            }
+            walk.pop_back();
+            next.pop_back();
+            mark.pop_back();
+            continue;
+        }
+
+        next.back() = 1;
+        mark.back() = pushed.size();
+
+        for (k = 0; k < phisIn[b].size(); k++)
+        {
+            Phi& phi = phis[phisIn[b][k]];
+            n = numbering.Number(phi.variable);
+            phi.result = function->TemporaryVariable(phi.variable->type);
+            versions[phi.result] = phi.variable;
+            stacks[n].push_back(phi.result);
+            pushed.push_back(n);
+        }
+
+        for (i = graph->Block(b).first; ; i = quads->Next(i))
+        {
+            q = (*quads)[i];
+            changed = false;
+
+            m = UseOperands(q, operands);
+            for (o = 0; o < m; o++)
+            {
+                v = (*operands[o])->SymbolAsVariable();
+                if (v != NULL && (n = numbering.Number(v)) >= 0 &&
+                    promoted[n] && !stacks[n].empty())
+                {
+                    *operands[o] = stacks[n].back();
+                    changed = true;
+                }
+            }
+
+            v = q.Definition();
+            if (v != NULL && (n = numbering.Number(v)) >= 0 && promoted[n])
+            {
+                t = function->TemporaryVariable(v->type);
+                versions[t] = v;
+                q.sym3 = t;
+                stacks[n].push_back(t);
+                pushed.push_back(n);
+                changed = true;
+            }
+
+            if (changed)
+                quads->Replace(i, q);
+            if (i == graph->Block(b).last)
+                break;
+        }
+
+        for (k = 0; k < graph->Block(b).successors.size(); k++)
+        {
+            s = graph->Block(b).successors[k];
+            predecessors = &graph->Block(s).predecessors;
+            j = std::find(predecessors->begin(), predecessors->end(), b) -
+                predecessors->begin();
+            for (m = 0; m < (int)phisIn[s].size(); m++)
+            {
+                Phi& phi = phis[phisIn[s][m]];
+                n = numbering.Number(phi.variable);
+                phi.arguments[j] = stacks[n].empty() ? phi.variable
+                                                     : stacks[n].back();
+            }
+        }
+    }
+}
+
+
+/*
+ * SSAForm::Destruct
+ *
+ * Take the function out of SSA form by giving every version back the
+ * variable it is a version of. The phis are then all of the form
+ * x := phi(x, ..., x) and can simply be dropped, and nothing refers
+ * to the versions any more.
+ */
+
+void SSAForm::Destruct(void)
+{
+    std::map<VariableInformation *, VariableInformation *>::iterator    found;
+    SymbolInformation  **operands[2];
+    Quad                 q;
+    VariableInformation *v;
+    long                 i;
+    int                  m, o;
+    bool                 changed;
+
+    for (i = quads->First(); i >= 0; i = quads->Next(i))
+    {
+        q = (*quads)[i];
+        changed = false;
+
+        m = UseOperands(q, operands);
+        for (o = 0; o < m; o++)
+        {
+            v = (*operands[o])->SymbolAsVariable();
+            if (v != NULL && (found = versions.find(v)) != versions.end())
+            {
+                *operands[o] = found->second;
+                changed = true;
+            }
+        }
+
+        v = q.Definition();
+        if (v != NULL && (found = versions.find(v)) != versions.end())
+        {
+            q.sym3 = found->second;
+            changed = true;
+        }
+
+        if (changed)
+            quads->Replace(i, q);
+    }
+
+    phis.clear();
+    phisIn.assign(graph->Blocks(), std::vector<int>());
+    versions.clear();
+    if (function->GetTemporaryCount() == lastVersion)
+        function->ReleaseTemporaries(firstVersion);
+}
+
+
+/*
+ * SSAForm::Report
+ *
+ * Print how many phis were placed and how many variables were
+ * renamed, in all functions.
+ */
+
+void SSAForm::Report(std::ostream& o)
+{
+    o << "SSA report\n";
+    o << "Phis placed:         " << placed << '\n';
+    o << "Variables renamed:   " << renamed << '\n';
+}
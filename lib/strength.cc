@@ -0,0 +1,393 @@
+#include <limits.h>
+#include <iostream>
+#include <vector>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <optimize.hh>
+
+
+unsigned long StrengthReduction::powers;
+unsigned long StrengthReduction::products;
+unsigned long StrengthReduction::quotients;
+bool StrengthReduction::divisions = true;
+
+
+//
+// A power is only turned into multiplications if it takes no more
+// than this many.
+//
+
+#define MAX_MULTIPLICATIONS 4
+
+
+/*
+ * Reciprocal
+ *
+ * Find the magic number m and shift s for signed division by d, where
+ * |d| is at least 2 and not a power of two: the quotient is the high
+ * word of m * x, plus or minus x, shifted right s bits and corrected
+ * by one when negative. This is the algorithm from Hacker's Delight,
+ * for 64-bit words.
+ */
+
+static void Reciprocal(long d, long& m, int& s)
+{
+    const unsigned long  two63 = 1UL << 63;
+    unsigned long        ad, anc, t, q1, r1, q2, r2, delta;
+    int                  p;
+
+    ad = d < 0 ? -(unsigned long)d : d;
+    t = two63 + ((unsigned long)d >> 63);
+    anc = t - 1 - t % ad;
+    p = 63;
+    q1 = two63 / anc;
+    r1 = two63 - q1 * anc;
+    q2 = two63 / ad;
+    r2 = two63 - q2 * ad;
+
+    do
+    {
+        p += 1;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1 += 1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
+        {
+            q2 += 1;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    m = (long)(q2 + 1);
+    if (d < 0)
+        m = -(unsigned long)m;
+    s = p - 64;
+}
+
+
+StrengthReduction::StrengthReduction(FunctionInformation *fn) :
+    function(fn),
+    quads(fn->GetQuads())
+{
+}
+
+
+/*
+ * StrengthReduction::Scan
+ *
+ * Find the temporaries that are assigned once, by an iconst or an
+ * rconst.
+ */
+
+void StrengthReduction::Scan(void)
+{
+    std::map<VariableInformation *, int>             definitions;
+    std::map<VariableInformation *, int>::iterator   d;
+    VariableInformation *v;
+    long                 i;
+
+    for (i = quads->First(); i >= 0; i = quads->Next(i))
+    {
+        v = (*quads)[i].Definition();
+        if (v == NULL || v->temporary <= 0)
+            continue;
+        definitions[v] += 1;
+        if (quads->Opcode(i) == iconst || quads->Opcode(i) == rconst)
+            constants[v] = i;
+    }
+
+    for (d = definitions.begin(); d != definitions.end(); ++d)
+        if (d->second > 1)
+            constants.erase(d->first);
+}
+
+
+/*
+ * StrengthReduction::IntegerConstant, StrengthReduction::RealConstant
+ *
+ * Return true if the operand is a temporary holding a constant, and
+ * store the constant in value.
+ */
+
+bool StrengthReduction::IntegerConstant(SymbolInformation *s, long& value)
+{
+    std::map<VariableInformation *, long>::iterator  found;
+
+    if (s == NULL ||
+        (found = constants.find(s->SymbolAsVariable())) == constants.end() ||
+        quads->Opcode(found->second) != iconst)
+        return false;
+
+    value = (*quads)[found->second].int1;
+    return true;
+}
+
+bool StrengthReduction::RealConstant(SymbolInformation *s, double& value)
+{
+    std::map<VariableInformation *, long>::iterator  found;
+
+    if (s == NULL ||
+        (found = constants.find(s->SymbolAsVariable())) == constants.end() ||
+        quads->Opcode(found->second) != rconst)
+        return false;
+
+    value = (*quads)[found->second].real1;
+    return true;
+}
+
+VariableInformation *StrengthReduction::Temporary(SymbolInformation *s)
+{
+    return function->TemporaryVariable(s->SymbolAsVariable()->type);
+}
+
+/*
+ * StrengthReduction::Rewrite
+ *
+ * Replace quad i by a sequence of quads. The last one takes the place
+ * of i and should assign what i did; the others go before it.
+ */
+
+void StrengthReduction::Rewrite(long i, std::vector<Quad>& sequence)
+{
+    size_t      k;
+
+    for (k = 0; k + 1 < sequence.size(); k++)
+        quads->InsertBefore(i, sequence[k]);
+    quads->Replace(i, sequence.back());
+}
+
+
+/*
+ * StrengthReduction::Power
+ *
+ * Raise to a constant power by squaring for every bit of the exponent
+ * below the top one, and multiplying by the base again where the bit
+ * is set. A real power is only reduced for exponent 2, since the
+ * product is rounded once, just like pow rounds, and a longer chain
+ * would round every step.
+ */
+
+bool StrengthReduction::Power(long i, Quad& q)
+{
+    std::vector<Quad>    sequence;
+    SymbolInformation   *r;
+    double               e;
+    long                 n;
+    int                  k;
+
+    if (q.opcode == rpow)
+    {
+        if (!RealConstant(q.sym2, e) || e != 2.0)
+            return false;
+        sequence.push_back(Quad(rmul, q.sym1, q.sym1, q.sym3));
+        Rewrite(i, sequence);
+        powers += 1;
+        return true;
+    }
+
+    if (!IntegerConstant(q.sym2, n) || n < 0 ||
+        (n > 1 && 63 - __builtin_clzl(n) + __builtin_popcountl(n) - 1 >
+                  MAX_MULTIPLICATIONS))
+        return false;
+
+    if (n == 0)
+        sequence.push_back(Quad(iconst, 1L, (SymbolInformation *)NULL, q.sym3));
+    else if (n == 1)
+        sequence.push_back(Quad(iassign, q.sym1, (SymbolInformation *)NULL,
+                                q.sym3));
+    else
+    {
+        r = q.sym1;
+        for (k = 62 - __builtin_clzl(n); k >= 0; k--)
+        {
+            sequence.push_back(Quad(imul, r, r, Temporary(q.sym1)));
+            r = sequence.back().sym3;
+            if ((n >> k) & 1)
+            {
+                sequence.push_back(Quad(imul, r, q.sym1, Temporary(q.sym1)));
+                r = sequence.back().sym3;
+            }
+        }
+        sequence.back().sym3 = q.sym3;
+    }
+
+    Rewrite(i, sequence);
+    powers += 1;
+    return true;
+}
+
+
+/*
+ * StrengthReduction::Product
+ *
+ * Multiply by a power of two, on either side, with a left shift.
+ */
+
+bool StrengthReduction::Product(long i, Quad& q)
+{
+    std::vector<Quad>    sequence;
+    SymbolInformation   *x;
+    long                 c;
+
+    if (IntegerConstant(q.sym2, c))
+        x = q.sym1;
+    else if (IntegerConstant(q.sym1, c))
+        x = q.sym2;
+    else
+        return false;
+
+    if (c < 2 || (c & (c - 1)) != 0)
+        return false;
+
+    sequence.push_back(Quad(ishl, x, (long)__builtin_ctzl(c), q.sym3));
+    Rewrite(i, sequence);
+    products += 1;
+    return true;
+}
+
+
+/*
+ * StrengthReduction::Quotient
+ *
+ * Divide by a constant without idiv. For a power of two, 2^k - 1 is
+ * added to a negative dividend before shifting, taken from the sign
+ * bits of the dividend. For anything else, the sign of the shifted
+ * high word is added to it. Division by the smallest integer is left
+ * alone, and so is division by zero, which must still fail.
+ */
+
+bool StrengthReduction::Quotient(long i, Quad& q)
+{
+    std::vector<Quad>    sequence;
+    SymbolInformation   *x, *r, *t;
+    long                 d, a, m;
+    int                  k, s;
+
+    if (!IntegerConstant(q.sym2, d) || d == 0 || d == LONG_MIN)
+        return false;
+
+    x = q.sym1;
+    a = d < 0 ? -d : d;
+
+    if (a == 1)
+    {
+        sequence.push_back(Quad(d == 1 ? iassign : ineg, x,
+                                (SymbolInformation *)NULL, q.sym3));
+    }
+    else if (!divisions)
+        return false;
+    else if ((a & (a - 1)) == 0)
+    {
+        k = __builtin_ctzl(a);
+        if (k == 1)
+            sequence.push_back(Quad(ishr, x, 63L, Temporary(x)));
+        else
+        {
+            sequence.push_back(Quad(isar, x, 63L, Temporary(x)));
+            t = sequence.back().sym3;
+            sequence.push_back(Quad(ishr, t, 64L - k, Temporary(x)));
+        }
+        t = sequence.back().sym3;
+        sequence.push_back(Quad(iadd, x, t, Temporary(x)));
+        r = sequence.back().sym3;
+        sequence.push_back(Quad(isar, r, (long)k, Temporary(x)));
+        if (d < 0)
+        {
+            r = sequence.back().sym3;
+            sequence.push_back(Quad(ineg, r, (SymbolInformation *)NULL,
+                                    Temporary(x)));
+        }
+    }
+    else
+    {
+        Reciprocal(d, m, s);
+        if (m == LONG_MIN)
+            return false;
+
+        sequence.push_back(Quad(imulh, x, m, Temporary(x)));
+        r = sequence.back().sym3;
+        if (d > 0 && m < 0)
+            sequence.push_back(Quad(iadd, r, x, Temporary(x)));
+        else if (d < 0 && m > 0)
+            sequence.push_back(Quad(isub, r, x, Temporary(x)));
+        r = sequence.back().sym3;
+        if (s > 0)
+            sequence.push_back(Quad(isar, r, (long)s, Temporary(x)));
+        r = sequence.back().sym3;
+        sequence.push_back(Quad(ishr, r, 63L, Temporary(x)));
+        t = sequence.back().sym3;
+        sequence.push_back(Quad(iadd, r, t, Temporary(x)));
+    }
+
+    sequence.back().sym3 = q.sym3;
+    Rewrite(i, sequence);
+    quotients += 1;
+    return true;
+}
+
+
+/*
+ * StrengthReduction::Run
+ *
+ * Reduce every power, product and quotient by a constant in the
+ * function. Returns true if any was.
+ */
+
+bool StrengthReduction::Run(void)
+{
+    Quad        q;
+    long        i;
+    bool        changed;
+
+    if (quads == NULL)
+        return false;
+
+    Scan();
+
+    changed = false;
+    for (i = quads->First(); i >= 0; i = quads->Next(i))
+    {
+        q = (*quads)[i];
+        switch (q.opcode)
+        {
+        case ipow:
+        case rpow:
+            changed = Power(i, q) || changed;
+            break;
+        case imul:
+            changed = Product(i, q) || changed;
+            break;
+        case idiv:
+            changed = Quotient(i, q) || changed;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return changed;
+}
+
+
+/*
+ * StrengthReduction::Report
+ *
+ * Print how many powers, products and quotients were reduced, in all
+ * functions.
+ */
+
+void StrengthReduction::Report(std::ostream& o)
+{
+    o << "Strength reduction report\n";
+    o << "Powers reduced:      " << powers << '\n';
+    o << "Products reduced:    " << products << '\n';
+    o << "Quotients reduced:   " << quotients << '\n';
+}
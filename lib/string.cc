@@ -1,36 +1,65 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-#include <strstream>
+#include <utility>
 #include <string.hh>
 
-using std::ostrstream;
-
 #ifndef MAX
 #define MAX(a,b) ((a)>(b)?(a):(b))
 #endif
 
 
+/*
+ * string::ensure_size
+ *
+ * Make room for request characters plus the terminating NUL. Heap
+ * buffers at least double when they grow.
+ */
+
 void string::ensure_size(int request)
 {
-    if (request > size)
+    char    *tmp;
+
+    if (request < size)
+        return;
+
+    request = MAX(request + 1, 2 * size);
+    if (text == local)
+    {
+        tmp = (char *)malloc(request);
+        if (tmp == NULL)
+            abort();
+        memcpy(tmp, local, position + 1);
+    }
+    else
     {
-        if (request - size < chunk_size)
-            request = size + chunk_size;
-        if (text == NULL)
-        {
-            text = (char *)malloc(request);
-            if (text == NULL)
-                abort();
-        }
-        else
-        {
-            text = (char *)realloc(text, request);
-            if (text == NULL)
-                abort();
-        }
-        size = request;
+        tmp = (char *)realloc(text, request);
+        if (tmp == NULL)
+            abort();
     }
+    text = tmp;
+    size = request;
+}
+
+
+/*
+ * string::append
+ *
+ * Append n characters from s. s may point into this string's own
+ * buffer, as it does for s += s, so it is rebased if the buffer moves.
+ */
+
+void string::append(const char *s, int n)
+{
+    char    *old = text;
+
+    ensure_size(position + n);
+    if (s >= old && s <= old + position)
+        s = text + (s - old);
+    memcpy(&text[position], s, n);
+    position += n;
+    text[position] = '\0';
 }
 
 void string::upcase(void)
@@ -56,93 +85,111 @@ void string::downcase(void)
 
 string::string()
 {
-    text = NULL;
-    size = 0;
+    text = local;
+    size = STRING_INLINE_SIZE;
     position = 0;
-    chunk_size = 10;
+    local[0] = '\0';
 }
 
-string::string(char *s)
+string::string(const char *s)
 {
-    text = strdup(s);
-    if (text == NULL)
-        abort();
-    size = strlen(s) + 1;
-    position = strlen(s);
-    chunk_size = 10;
+    text = local;
+    size = STRING_INLINE_SIZE;
+    position = 0;
+    local[0] = '\0';
+    append(s, strlen(s));
 }
 
 string::string(char c, int sz)
 {
-    text = (char *)malloc(sz);
-    if (text == NULL)
-        abort();
-    memset(text, c, sz);
-    size = sz;
+    text = local;
+    size = STRING_INLINE_SIZE;
     position = 0;
-    chunk_size = 10;
+    local[0] = '\0';
+    ensure_size(sz);
+    memset(text, c, sz);
+    text[0] = '\0';
 }
 
 string::string(int s)
 {
-    char        buf[1024];
-    ostrstream  str(buf, 1024);
+    char        buf[32];
 
-    str << s;
-    text = (char *)malloc(strlen(buf) + 1);
-    if (text == NULL)
-        abort();
-    memcpy(text, buf, strlen(buf) + 1);
-    size = strlen(buf) + 1;
-    position = strlen(buf);
-    chunk_size = 10;
+    text = local;
+    size = STRING_INLINE_SIZE;
+    position = 0;
+    local[0] = '\0';
+    append(buf, snprintf(buf, sizeof(buf), "%d", s));
 }
 
 string::string(const string& s)
 {
-    if (s.text)
+    text = local;
+    size = STRING_INLINE_SIZE;
+    position = 0;
+    local[0] = '\0';
+    append(s.text, s.position);
+}
+
+string::string(string&& s)
+{
+    if (s.text == s.local)
     {
-        text = (char *)malloc(s.size);
-        memcpy(text, s.text, s.size);
-        position = s.position;
-        size = s.size;
+        text = local;
+        size = STRING_INLINE_SIZE;
+        memcpy(local, s.local, s.position + 1);
     }
     else
     {
-        text = NULL;
-        size = 0;
-        position = 0;
+        text = s.text;
+        size = s.size;
+        s.text = s.local;
+        s.size = STRING_INLINE_SIZE;
     }
+    position = s.position;
+    s.position = 0;
+    s.local[0] = '\0';
 }
 
 string::~string(void)
 {
-    if (text)
+    if (text != local)
         free(text);
 }
 
 string& string::operator=(const string& s)
 {
-    char *tmp;
-    int   sz, pos;
+    if (this != &s)
+    {
+        position = 0;
+        append(s.text, s.position);
+    }
 
-    if (s.size > 0)
+    return *this;
+}
+
+string& string::operator=(string&& s)
+{
+    if (this == &s)
+        return *this;
+
+    if (s.text == s.local)
     {
-        tmp = (char *)malloc(s.size);
-        memcpy(tmp, s.text, s.size);
+        position = 0;
+        append(s.text, s.position);
     }
     else
     {
-        tmp = NULL;
+        if (text != local)
+            free(text);
+        text = s.text;
+        size = s.size;
+        position = s.position;
+        s.text = s.local;
+        s.size = STRING_INLINE_SIZE;
     }
-    sz = s.size;
-    pos = s.position;
-
-    if (text != NULL)
-        free(text);
-    text = tmp;
-    position = pos;
-    size = sz;
+    s.position = 0;
+    s.local[0] = '\0';
 
     return *this;
 }
@@ -150,90 +197,115 @@ string& string::operator=(const string& s)
 
 string& string::operator=(const char *s)
 {
-    ensure_size(strlen(s) + 1);
-    strcpy(text, s);
-    position = strlen(s);
+    position = 0;
+    append(s, strlen(s));
 
     return *this;
 }
 
 string& string::operator=(const char c)
 {
-    ensure_size(1);
-    text[0] = c;
-    position = 1;
+    position = 0;
+    append(&c, 1);
 
     return *this;
 }
 
 string& string::operator+=(const string& s)
 {
-    ensure_size(position + s.position);
-    memcpy(&text[position], s.text, s.position);
-    position += s.position;
+    append(s.text, s.position);
 
     return *this;
 }
 
 string& string::operator+=(const char *s)
 {
-    ensure_size(position + strlen(s));
-    memcpy(&text[position], s, strlen(s));
-    position += strlen(s);
+    append(s, strlen(s));
 
     return *this;
 }
 
 string& string::operator+=(const char c)
 {
-    ensure_size(position + 1);
-    text[position] = c;
-    position += 1;
+    append(&c, 1);
 
     return *this;
 }
 
-string& operator+(const string& s1, const string& s2)
+string& string::operator+=(const int i)
 {
-    string *res;
+    char        buf[32];
 
-    res = new string;
-    res->ensure_size(s1.position + s2.position);
-    memcpy(&res->text[0], s1.text, s1.position);
-    memcpy(&res->text[s1.position], s2.text, s2.position);
-    res->position = s1.position + s2.position;
+    append(buf, snprintf(buf, sizeof(buf), "%d", i));
 
-    return *res;
+    return *this;
 }
 
-string& operator+(const string& s1, const char c)
+
+/*
+ * Concatenation
+ *
+ * The versions that take an rvalue on the left append to it and move
+ * it into the result, so chains of + only ever grow one buffer.
+ */
+
+string operator+(const string& s1, const string& s2)
 {
-    string *res;
+    string res;
 
-    res = new string;
-    res->ensure_size(s1.position + 1);
-    memcpy(&res->text[0], s1.text, s1.position);
-    res->text[s1.position] = c;
-    res->position = s1.position + 1;
+    res.ensure_size(s1.position + s2.position);
+    res.append(s1.text, s1.position);
+    res.append(s2.text, s2.position);
 
-    return *res;
+    return res;
 }
 
+string operator+(const string& s1, const char *s2)
+{
+    string res(s1);
+
+    res += s2;
+    return res;
+}
 
-string& operator+(const string& s1, const int i )
+string operator+(const string& s1, const char c)
 {
-    string      *res;
-    char         buf[1024];
-    ostrstream   str(buf, 1024);
+    string res(s1);
+
+    res += c;
+    return res;
+}
 
-    str << i << '\0';
-    res = new string;
-    res->ensure_size(s1.position + strlen(buf) + 1);
-    memcpy(&res->text[0], s1.text, s1.position);
-    memcpy(&res->text[s1.position], buf, strlen(buf) + 1);
-    res->position = s1.position + strlen(buf);
+string operator+(const string& s1, const int i)
+{
+    string res(s1);
 
-    return *res;
+    res += i;
+    return res;
+}
+
+string operator+(string&& s1, const string& s2)
+{
+    s1 += s2;
+    return std::move(s1);
+}
+
+string operator+(string&& s1, const char *s2)
+{
+    s1 += s2;
+    return std::move(s1);
+}
+
+string operator+(string&& s1, const char c)
+{
+    s1 += c;
+    return std::move(s1);
+}
+
+string operator+(string&& s1, const int i)
+{
+    s1 += i;
+    return std::move(s1);
 }
 
 int operator==(const string& s1, const string& s2)
@@ -288,12 +360,6 @@ int string::length(void) const
 
 char& string::operator[](int ix)
 {
-    if (ix == position)
-    {
-        ensure_size(position + 1);
-        text[position] = '\0';
-        return text[position];
-    }
     if (ix > position)
         abort();
     else
@@ -302,34 +368,27 @@ char& string::operator[](int ix)
 
 const char string::operator[](const int ix) const
 {
-    if (ix == position)
-    {
-        return '\0';
-    }
     if (ix > position)
         abort();
     else
         return text[ix];
 }
 
+/*
+ * Output
+ *
+ * Strings are written directly, unless a field width has been set,
+ * in which case the text goes through the usual padding.
+ */
+
 std::ostream& operator<<(std::ostream& o, const string& s)
 {
-    char *tmp;
-
-    tmp = (char *)malloc(s.position + 1);
-    memcpy(tmp, s.text, s.position);
-    tmp[s.position] = '\0';
-
-    return o << tmp;
+    if (o.width() != 0)
+        return o << s.text;
+    return o.write(s.text, s.position);
 }
 
 std::ostream& operator<<(std::ostream& o, const string* s)
 {
-    char *tmp;
-
-    tmp = (char *)malloc(s->position + 1);
-    memcpy(tmp, s->text, s->position);
-    tmp[s->position] = '\0';
-
-    return o << tmp;
+    return o << *s;
 }
@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
 #include "symtab.hh"
 #include "ast.hh"
 #include "string.hh"
@@ -101,6 +103,26 @@ std::ostream& TypeInformation::print(std::ostream& o)
     return o;
 }
 
+/*
+ * Temporaries are printed as T:n. The name is formatted first so that
+ * a field width applies to all of it.
+ */
+
+static void PrintName(std::ostream& o, VariableInformation *var)
+{
+    char    buf[32];
+
+    if (var->temporary != 0)
+    {
+        snprintf(buf, sizeof(buf), "T:%ld", var->temporary);
+        o << buf;
+    }
+    else
+    {
+        o << var->id;
+    }
+}
+
 std::ostream& VariableInformation::print(std::ostream& o)
 {
     switch (outputFormat)
@@ -108,7 +130,9 @@ std::ostream& VariableInformation::print(std::ostream& o)
     case kFullFormat:
         o << "VariableInformation @ " << (void*)this << '\n';
         o << "  Tag:   " << tag << '\n';
-        o << "  ID:    " << id << '\n';
+        o << "  ID:    ";
+        PrintName(o, this);
+        o << '\n';
         o << "  Table: " << (void*)table  << '\n';
         o << "  Type:  " << (void*)type << ' ';
         if (type) o << SummarySymbols << type << LongSymbols;
@@ -119,7 +143,8 @@ std::ostream& VariableInformation::print(std::ostream& o)
         break;
 
     case kSummaryFormat:
-        o << id << " : ";
+        PrintName(o, this);
+        o << " : ";
         o << type;
         if (prev != NULL)
         {
@@ -128,7 +153,7 @@ std::ostream& VariableInformation::print(std::ostream& o)
         break;
 
     case kShortFormat:
-        o << id;
+        PrintName(o, this);
         break;
 
     default:
@@ -189,8 +214,10 @@ std::ostream& FunctionInformation::print(std::ostream& o)
             o << "  Locals: none\n";
         }
 
-        o << "  Body:  " << (void*)body << '\n';
-        if (body) o << body;
+        o << "  Temporaries: " << temporaryCount << '\n';
+
+        o << "  Body:  " << (void*)tree << '\n';
+        if (tree) o << tree;
         o << '\n';
 
         o << "  Quads: " << (void*)quads << '\n';
@@ -239,9 +266,18 @@ FunctionInformation *FunctionInformation::GetParent(void)
     return parent;
 }
 
+/*
+ * FunctionInformation::SetBody
+ *
+ * Set the parse tree of the function body. The flat tree that code
+ * was generated from is derived from the old body, so it goes too.
+ */
+
 void FunctionInformation::SetBody(StatementList *b)
 {
     body = b;
+    delete tree;
+    tree = NULL;
 }
 
 StatementList *FunctionInformation::GetBody(void)
@@ -249,6 +285,17 @@ StatementList *FunctionInformation::GetBody(void)
     return body;
 }
 
+void FunctionInformation::SetTree(FlatAST *t)
+{
+    delete tree;
+    tree = t;
+}
+
+void FunctionInformation::SetQuads(QuadsList *q)
+{
+    quads = q;
+}
+
 void FunctionInformation::SetReturnType(TypeInformation *newReturnType)
 {
     returnType = newReturnType;
@@ -264,8 +311,38 @@ VariableInformation *FunctionInformation::GetLastParam(void)
     return lastParam;
 }
 
+VariableInformation *FunctionInformation::GetLastLocal(void)
+{
+    return lastLocal;
+}
+
+SymbolTable *FunctionInformation::GetSymbolTable(void)
+{
+    return &symbolTable;
+}
+
+QuadsList *FunctionInformation::GetQuads(void)
+{
+    return quads;
+}
+
+VariableInformation *FunctionInformation::GetTemporary(long n)
+{
+    return &temporaries[n - 1];
+}
+
+long FunctionInformation::GetTemporaryCount(void)
+{
+    return temporaryCount;
+}
+
 
 SymbolInformation *FunctionInformation::LookupIdentifier(const string& name)
+{
+    return LookupIdentifier(InternIdentifier(name));
+}
+
+SymbolInformation *FunctionInformation::LookupIdentifier(Atom *name)
 {
     SymbolInformation *info;
 
@@ -380,15 +457,31 @@ VariableInformation *FunctionInformation::TemporaryVariable(TypeInformation *typ
 
     temporaryCount += 1;
 
-    info = new VariableInformation(string("T:") + (int)temporaryCount, type);
+    temporaries.push_back(VariableInformation(string(), type));
+    info = &temporaries.back();
     info->prev = NULL;
-    AddSymbol(info);
+    info->table = &symbolTable;
+    info->temporary = temporaryCount;
 
     return info;
 }
 
+void FunctionInformation::ReleaseTemporaries(long n)
+{
+    while (temporaryCount > n)
+    {
+        temporaries.pop_back();
+        temporaryCount -= 1;
+    }
+}
+
 
 char FunctionInformation::OkToAddSymbol(const string& name)
+{
+    return OkToAddSymbol(InternIdentifier(name));
+}
+
+char FunctionInformation::OkToAddSymbol(Atom *name)
 {
     SymbolInformation *info;
 
@@ -404,15 +497,6 @@ char FunctionInformation::OkToAddSymbol(const string& name)
 }
 
 
-void FunctionInformation::GenerateCode(void)
-{
-    if (body)
-    {
-        quads = new QuadsList;
-        body->GenerateCode(*quads);
-    }
-}
-
 
 
 /*
@@ -420,74 +504,231 @@ void FunctionInformation::GenerateCode(void)
  */
 
 
-int SymbolTable::nextTemporary;
+unsigned long SymbolTable::tables;
+unsigned long SymbolTable::symbols;
+unsigned long SymbolTable::lookups;
+unsigned long SymbolTable::probes;
+unsigned long SymbolTable::longestProbe;
+unsigned long SymbolTable::grows;
+
+#define SYMBOL_TABLE_INITIAL_BITS   3
 
 SymbolTable::SymbolTable()
 {
-    int i;
+    tableBits = SYMBOL_TABLE_INITIAL_BITS;
+    slots.assign(1 << tableBits, -1);
+    tables += 1;
+}
+
+
+/*
+ * SymbolTable::Find
+ *
+ * Return the slot that holds the symbol for atom, or the empty slot
+ * where it would go. The hash is spread over the slots by multiplying
+ * with 2^64 / phi, since the low bits of the case-folded atom hash
+ * depend on little more than the last character.
+ */
+
+long SymbolTable::Find(Atom *atom)
+{
+    unsigned long   mask = slots.size() - 1;
+    unsigned long   slot = (atom->hash * 0x9E3779B97F4A7C15UL) >> (64 - tableBits);
+    unsigned long   length = 1;
+
+    while (slots[slot] >= 0 && entries[slots[slot]].info->atom != atom)
+    {
+        slot = (slot + 1) & mask;
+        length += 1;
+    }
+
+    lookups += 1;
+    probes += length;
+    if (length > longestProbe)
+        longestProbe = length;
+
+    return slot;
+}
+
+
+/*
+ * SymbolTable::Grow
+ *
+ * Double the number of slots and put every entry that was in a slot
+ * back.
+ */
+
+void SymbolTable::Grow(void)
+{
+    std::vector<int>    old;
+    unsigned long       mask, slot;
+    unsigned long       i;
 
-    tableSize = 1023;
-    table = new SymbolTableElement*[1023];
+    old.swap(slots);
+    tableBits += 1;
+    slots.assign(1 << tableBits, -1);
+    mask = slots.size() - 1;
+    grows += 1;
 
-    for (i = 0; i < tableSize; i++)
-        table[i] = NULL;
+    for (i = 0; i < old.size(); i++)
+    {
+        if (old[i] < 0)
+            continue;
+        slot = (entries[old[i]].hash * 0x9E3779B97F4A7C15UL) >> (64 - tableBits);
+        while (slots[slot] >= 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = old[i];
+    }
 }
 
+
 void SymbolTable::AddSymbol(SymbolInformation *info)
 {
-    int                 index;
-    SymbolTableElement *elem;
-    string              tmp = info->id;
+    SymbolTableElement  elem;
+    long                slot;
 
     info->table = this;
-    tmp.upcase();
-    index = tmp.hash();
-    index = (index < 0 ? -index : index) % tableSize;
-    if (table[index] == NULL)
+    if (info->atom == NULL)
+        info->atom = InternIdentifier(info->id);
+    elem.info = info;
+    elem.hash = info->atom->hash;
+
+    if ((entries.size() + 1) * 3 > slots.size() * 2)
+        Grow();
+
+    //
+    // If there already is a symbol with the same name, lookups keep
+    // finding that one. The new one is only listed when printing.
+    //
+
+    slot = Find(info->atom);
+    if (slots[slot] < 0)
+        slots[slot] = entries.size();
+    entries.push_back(elem);
+    symbols += 1;
+}
+
+SymbolInformation *SymbolTable::LookupSymbol(const string& id)
+{
+    return LookupSymbol(InternIdentifier(id));
+}
+
+SymbolInformation *SymbolTable::LookupSymbol(Atom *atom)
+{
+    long                 slot;
+
+    slot = Find(atom);
+    if (slots[slot] < 0)
+        return NULL;
+
+    return entries[slots[slot]].info;
+}
+
+
+/*
+ * SymbolTable::Report
+ *
+ * Print statistics on all symbol tables: how many there are, how
+ * big they got and how many slots lookups had to look at.
+ */
+
+void SymbolTable::Report(std::ostream& o)
+{
+    o << "Symbol table report\n";
+    o << "Tables:              " << tables << '\n';
+    o << "Identifiers:         " << AtomCount() << '\n';
+    o << "Symbols:             " << symbols << '\n';
+    o << "Grown:               " << grows << '\n';
+    o << "Lookups:             " << lookups << '\n';
+    o << "Probes:              " << probes;
+    if (lookups > 0)
+        o << " (" << (double)probes / lookups << " per lookup)";
+    o << '\n';
+    o << "Longest probe:       " << longestProbe << '\n';
+}
+
+/*
+ * The atom table
+ *
+ * All atoms live in one open addressing table like the symbol tables,
+ * keyed on the case-folded name.
+ */
+
+static std::vector<Atom *>  atoms;
+static std::vector<int>     atomSlots;
+static int                  atomBits;
+
+static string AtomName(const char *name) { return string(name); }
+static string AtomName(const string& name) { return name; }
+
+template <class Name>
+static Atom *Intern(const Name& name)
+{
+    unsigned long   hash, mask, slot;
+    unsigned long   i;
+    int             n;
+    Atom           *atom;
+
+    hash = 0;
+    for (n = 0; name[n] != '\0'; n++)
+        hash = hash * 65599 + toupper(name[n]);
+
+    if ((atoms.size() + 1) * 3 > atomSlots.size() * 2)
     {
-        table[index] = new SymbolTableElement;
-        table[index]->info = info;
-        table[index]->next = NULL;
+        atomBits = atomBits == 0 ? 8 : atomBits + 1;
+        atomSlots.assign(1 << atomBits, -1);
+        mask = atomSlots.size() - 1;
+        for (i = 0; i < atoms.size(); i++)
+        {
+            slot = (atoms[i]->hash * 0x9E3779B97F4A7C15UL) >> (64 - atomBits);
+            while (atomSlots[slot] >= 0)
+                slot = (slot + 1) & mask;
+            atomSlots[slot] = i;
+        }
     }
-    else
+
+    mask = atomSlots.size() - 1;
+    slot = (hash * 0x9E3779B97F4A7C15UL) >> (64 - atomBits);
+    while (atomSlots[slot] >= 0)
     {
-        elem = table[index];
-        while (elem->next)
+        atom = atoms[atomSlots[slot]];
+        if (atom->hash == hash && atom->name.length() == n)
         {
-            elem = elem->next;
+            for (i = 0; i < (unsigned long)n; i++)
+                if (toupper(atom->name[i]) != toupper(name[i]))
+                    break;
+            if (i == (unsigned long)n)
+                return atom;
         }
-        elem->next = new SymbolTableElement;
-        elem->next->info = info;
-        elem->next->next = NULL;
+        slot = (slot + 1) & mask;
     }
+
+    atom = new Atom(AtomName(name), hash, atoms.size());
+    atomSlots[slot] = atoms.size();
+    atoms.push_back(atom);
+
+    return atom;
 }
 
-SymbolInformation *SymbolTable::LookupSymbol(const string& id)
+Atom *InternIdentifier(const char *name)
 {
-    int                  index;
-    SymbolTableElement  *elem;
-    string               tmp = id;
-
-    tmp.upcase();
-    index = tmp.hash();
-    index = (index < 0 ? -index : index) % tableSize;
-    elem = table[index];
+    return Intern(name);
+}
 
-    while (elem)
-    {
-        if (elem->info->id == id)
-            return elem->info;
-        else
-            elem = elem->next;
-    }
+Atom *InternIdentifier(const string& name)
+{
+    return Intern(name);
+}
 
-    return NULL;
+long AtomCount(void)
+{
+    return atoms.size();
 }
 
+
 std::ostream& SymbolTable::print(std::ostream& o)
 {
-    int                      i;
-    SymbolTableElement      *elem;
+    unsigned long            i;
 
     o << "------------------------------------------------"
       << "-------------------------------\n";
@@ -496,17 +737,10 @@ std::ostream& SymbolTable::print(std::ostream& o)
       << "-------------------------------\n";
 
     o << SummarySymbols;
-    for (i = 0; i < tableSize; i++)
+    for (i = 0; i < entries.size(); i++)
     {
-        if (table[i] != NULL)
-        {
-            elem = table[i];
-            while (elem != NULL)
-            {
-                o << i << '\t' << (void*)elem->info << ' ' <<elem->info<< '\n';
-                elem = elem->next;
-            }
-        }
+        o << i << '\t' << (void*)entries[i].info << ' '
+          << entries[i].info << '\n';
     }
     o << LongSymbols;
 
@@ -0,0 +1,337 @@
+#include <iostream>
+#include <cstring>
+
+#include <symtab.hh>
+#include <codegen.hh>
+#include <optimize.hh>
+#include <cfg.hh>
+
+
+unsigned long ValueNumbering::redundant;
+unsigned long ValueNumbering::replaced;
+
+
+bool ValueNumbering::Expression::operator<(const Expression& e) const
+{
+    if (opcode != e.opcode)
+        return opcode < e.opcode;
+    if (a != e.a)
+        return a < e.a;
+    if (b != e.b)
+        return b < e.b;
+    return memory < e.memory;
+}
+
+
+ValueNumbering::ValueNumbering(FunctionInformation *fn) :
+    function(fn),
+    quads(fn->GetQuads()),
+    memory(0)
+{
+}
+
+
+long ValueNumbering::NewValue(bool isConstant)
+{
+    holders.push_back(NULL);
+    constant.push_back(isConstant);
+    return holders.size() - 1;
+}
+
+/*
+ * ValueNumbering::ValueOf
+ *
+ * Return the number of the value in a variable. A variable that
+ * hasn't been seen in the block yet holds a value of its own.
+ */
+
+long ValueNumbering::ValueOf(VariableInformation *v)
+{
+    std::map<VariableInformation *, long>::iterator  i;
+    long                                             value;
+
+    i = values.find(v);
+    if (i != values.end())
+        return i->second;
+
+    value = NewValue(false);
+    Assign(v, value);
+    return value;
+}
+
+void ValueNumbering::Assign(VariableInformation *v, long value)
+{
+    std::map<VariableInformation *, long>::iterator  i;
+
+    i = values.find(v);
+    if (i != values.end() && holders[i->second] == v)
+        holders[i->second] = NULL;
+
+    values[v] = value;
+    if (holders[value] == NULL)
+        holders[value] = v;
+}
+
+/*
+ * ValueNumbering::Forget
+ *
+ * A call may have changed every variable that isn't a temporary. The
+ * value of an array is where it is, and that never changes.
+ */
+
+void ValueNumbering::Forget(void)
+{
+    std::map<VariableInformation *, long>::iterator  i, next;
+
+    for (i = values.begin(); i != values.end(); i = next)
+    {
+        next = i;
+        ++next;
+        if (i->first->temporary > 0 || i->first->type->elementType != NULL)
+            continue;
+        if (holders[i->second] == i->first)
+            holders[i->second] = NULL;
+        values.erase(i);
+    }
+}
+
+
+/*
+ * ValueNumbering::Replace
+ *
+ * Replace an operand by the first variable that still holds its
+ * value, unless the value is a constant. Returns true if it was
+ * replaced.
+ */
+
+bool ValueNumbering::Replace(SymbolInformation *&operand)
+{
+    VariableInformation *v, *holder;
+    long                 value;
+
+    if (operand == NULL || (v = operand->SymbolAsVariable()) == NULL)
+        return false;
+
+    value = ValueOf(v);
+    holder = holders[value];
+    if (constant[value] || holder == NULL || holder == v)
+        return false;
+
+    operand = holder;
+    replaced += 1;
+    return true;
+}
+
+bool ValueNumbering::ReplaceOperands(Quad& q)
+{
+    bool        changed = false;
+
+    switch (q.opcode)
+    {
+    case iconst: case rconst: case iaddr: case call: case aassign:
+    case jump: case clabel: case hcf: case nop:
+        break;
+    case jtrue: case jfalse:
+        changed = Replace(q.sym2);
+        break;
+    case creturn:
+        changed = Replace(q.sym3);
+        break;
+    case istore: case rstore:
+        changed = Replace(q.sym1);
+        changed = Replace(q.sym3) || changed;
+        break;
+    default:
+        changed = Replace(q.sym1);
+        changed = Replace(q.sym2) || changed;
+        break;
+    }
+
+    return changed;
+}
+
+
+/*
+ * ValueNumbering::Numbered
+ *
+ * Fill in the expression a quad computes, if it computes one that can
+ * be looked up. Besides the pure quads, integer division and loads
+ * give the same result when repeated, and if the first one didn't
+ * fail the second one won't either. Operands of commutative quads are
+ * put in order, and the constant operand of a shift or multiply-high
+ * takes the place of the second one.
+ */
+
+bool ValueNumbering::Numbered(Quad& q, Expression& e)
+{
+    long        t;
+
+    e.opcode = q.opcode;
+    e.a = e.b = e.memory = 0;
+
+    switch (q.opcode)
+    {
+    case iconst:
+        e.a = q.int1;
+        return true;
+    case rconst:
+        memcpy(&e.a, &q.real1, sizeof(e.a));
+        return true;
+    case iassign: case rassign: case aassign:
+        return false;
+    case iload: case rload:
+        e.a = ValueOf(q.sym1->SymbolAsVariable());
+        e.memory = memory;
+        return true;
+    case idiv:
+        break;
+    default:
+        if (!q.Pure())
+            return false;
+        break;
+    }
+
+    e.a = ValueOf(q.sym1->SymbolAsVariable());
+    if (q.sym2 != NULL)
+        e.b = ValueOf(q.sym2->SymbolAsVariable());
+    else
+        e.b = q.int2;
+
+    switch (q.opcode)
+    {
+    case iadd: case imul: case radd: case rmul:
+    case ieq: case ine: case req: case rne:
+    case iand: case ior:
+        if (e.a > e.b)
+        {
+            t = e.a;
+            e.a = e.b;
+            e.b = t;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
+
+/*
+ * ValueNumbering::Block
+ *
+ * Number the values in the block from quad first to quad last.
+ * Returns true if any quad was changed.
+ */
+
+bool ValueNumbering::Block(long first, long last)
+{
+    std::map<Expression, long>::iterator     found;
+    Quad                                     q;
+    Expression                               e;
+    VariableInformation                     *dest;
+    long                                     i, value;
+    bool                                     changed, any;
+
+    values.clear();
+    expressions.clear();
+    holders.clear();
+    constant.clear();
+    memory = 0;
+
+    any = false;
+    for (i = first; ; i = quads->Next(i))
+    {
+        q = (*quads)[i];
+        changed = ReplaceOperands(q);
+        dest = q.Definition();
+
+        if (q.opcode == iassign || q.opcode == rassign)
+        {
+            Assign(dest, ValueOf(q.sym1->SymbolAsVariable()));
+        }
+        else if (Numbered(q, e))
+        {
+            found = expressions.find(e);
+            if (found == expressions.end())
+            {
+                value = NewValue(q.opcode == iconst || q.opcode == rconst);
+                expressions[e] = value;
+            }
+            else
+            {
+                value = found->second;
+                if (!constant[value] && holders[value] != NULL &&
+                    holders[value] != dest)
+                {
+                    q = Quad(dest->type == kRealType ? rassign : iassign,
+                             holders[value], (SymbolInformation *)NULL, dest);
+                    changed = true;
+                    redundant += 1;
+                }
+            }
+            Assign(dest, value);
+        }
+        else
+        {
+            if (q.opcode == call)
+                Forget();
+            if (q.opcode == call || q.opcode == istore ||
+                q.opcode == rstore || q.opcode == aassign)
+                memory += 1;
+            if (dest != NULL && q.opcode != aassign)
+                Assign(dest, NewValue(false));
+        }
+
+        if (changed)
+        {
+            quads->Replace(i, q);
+            any = true;
+        }
+        if (i == last)
+            break;
+    }
+
+    return any;
+}
+
+
+/*
+ * ValueNumbering::Run
+ *
+ * Number the values in every block of the function. Returns true if
+ * anything was changed.
+ */
+
+bool ValueNumbering::Run(void)
+{
+    int         b;
+    bool        changed;
+
+    if (quads == NULL)
+        return false;
+
+    ControlFlowGraph     graph(function);
+
+    changed = false;
+    for (b = 0; b < graph.Blocks(); b++)
+        if (Block(graph.Block(b).first, graph.Block(b).last))
+            changed = true;
+
+    return changed;
+}
+
+
+/*
+ * ValueNumbering::Report
+ *
+ * Print how many quads were found to be redundant and how many
+ * operands were replaced.
+ */
+
+void ValueNumbering::Report(std::ostream& o)
+{
+    o << "Value numbering report\n";
+    o << "Redundant quads:     " << redundant << '\n';
+    o << "Operands replaced:   " << replaced << '\n';
+}
@@ -0,0 +1,1457 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include <ast.hh>
+#include <symtab.hh>
+#include <codegen.hh>
+#include <vm.hh>
+#include <jit.hh>
+
+
+//
+// Every function reserves a few registers in each bank for values
+// that have to be fetched from, or stored to, an enclosing function's
+// frame.
+//
+
+#define SCRATCH_REGISTERS 3
+#define SCRATCH_RESULT    2
+
+//
+// A function is compiled once the interpreter has called it this
+// many times.
+//
+
+#define JIT_THRESHOLD     50
+
+
+void RuntimeError(const char *message)
+{
+    std::cout << std::flush;
+    std::cerr << "Runtime error: " << message << '\n' << std::flush;
+    exit(1);
+}
+
+
+//
+// Integer arithmetic wraps around, like it does in the generated code.
+//
+
+static inline long WrapAdd(long a, long b) { return (long)((unsigned long)a + (unsigned long)b); }
+static inline long WrapSub(long a, long b) { return (long)((unsigned long)a - (unsigned long)b); }
+static inline long WrapMul(long a, long b) { return (long)((unsigned long)a * (unsigned long)b); }
+
+
+/*
+ * IntegerPower
+ *
+ * Raise x to the power of y by repeated squaring. Negative exponents
+ * truncate towards zero, just like idiv does.
+ */
+
+long IntegerPower(long x, long y)
+{
+    long result = 1;
+
+    if (y < 0)
+        return (x == 1) ? 1 : (x == -1) ? ((y & 1) ? -1 : 1) : 0;
+
+    while (y > 0)
+    {
+        if (y & 1)
+            result = WrapMul(result, x);
+        x = WrapMul(x, x);
+        y >>= 1;
+    }
+
+    return result;
+}
+
+
+/*
+ * PutReal
+ *
+ * Print a real on a line of its own. Every NaN is printed as nan: its
+ * sign depends on which instructions made it, and the C compiler may
+ * fold the generated code differently from how the VM computes it.
+ */
+
+void PutReal(double x)
+{
+    if (isnan(x))
+        std::cout << "nan\n";
+    else
+        std::cout << x << '\n';
+}
+
+
+VirtualMachine::VirtualMachine(long size) :
+    stackSize(size),
+    stackLimit(NULL),
+    jit(NULL),
+    superinstructions(false),
+    profile(false)
+{
+    memset(dispatches, 0, sizeof(dispatches));
+    integerStack = new long[stackSize];
+    realStack    = new double[stackSize];
+    memory       = new VMWord[stackSize];
+    arguments    = new VMWord[stackSize / 16];
+    frames       = new VMFrame[stackSize / 16];
+
+    state.memory = memory;
+    state.memoryTop = 0;
+    state.arguments = arguments;
+}
+
+VirtualMachine::~VirtualMachine()
+{
+    std::map<FunctionInformation *, VMFunction *>::iterator  i;
+
+    for (i = functions.begin(); i != functions.end(); ++i)
+        delete i->second;
+
+    delete[] integerStack;
+    delete[] realStack;
+    delete[] memory;
+    delete[] arguments;
+    delete[] frames;
+    delete jit;
+}
+
+/*
+ * VirtualMachine::UseJIT
+ *
+ * Turn the JIT on or off. It only knows how to generate x86-64 code,
+ * so elsewhere everything is interpreted.
+ */
+
+void VirtualMachine::UseJIT(bool on)
+{
+#if !defined(__x86_64__)
+    on = false;
+#endif
+
+    if (on && jit == NULL)
+        jit = new JITCompiler;
+    else if (!on)
+    {
+        delete jit;
+        jit = NULL;
+    }
+}
+
+
+/*
+ * VirtualMachine::Function
+ *
+ * Find the VMFunction for a FunctionInformation, creating it if
+ * this is the first time we see it. New functions are put on the
+ * pending list and lowered by Run, so mutually recursive functions
+ * don't cause any trouble.
+ */
+
+VMFunction *VirtualMachine::Function(FunctionInformation *info)
+{
+    VMFunction      *fn;
+
+    if (functions.count(info))
+        return functions[info];
+
+    fn = new VMFunction(info,
+                        info->GetParent() ? Function(info->GetParent())
+                                          : (VMFunction *)NULL);
+    functions[info] = fn;
+
+    if (info == kIPrintFunction)
+        fn->builtin = vm_putint;
+    else if (info == kFPrintFunction)
+        fn->builtin = vm_putreal;
+    else if (info == kIReadFunction)
+        fn->builtin = vm_getint;
+    else if (info == kFReadFunction)
+        fn->builtin = vm_getreal;
+    else
+    {
+        fn->integerRegisters = SCRATCH_REGISTERS;
+        fn->realRegisters = SCRATCH_REGISTERS;
+        pending.push_back(fn);
+    }
+
+    return fn;
+}
+
+
+/*
+ * VirtualMachine::Owner
+ *
+ * Find the function that owns a variable, starting the search in fn
+ * and moving outwards. depth is set to the number of static links
+ * that have to be followed to reach the owner's frame.
+ */
+
+VMFunction *VirtualMachine::Owner(VMFunction *fn,
+                                  VariableInformation *var,
+                                  int& depth)
+{
+    depth = 0;
+    while (fn != NULL)
+    {
+        if (var->table == fn->info->GetSymbolTable())
+            return fn;
+        fn = fn->parent;
+        depth += 1;
+    }
+
+    std::cerr << "Bug: variable " << var->id << " has no owner.\n";
+    abort();
+}
+
+/*
+ * VirtualMachine::Slot
+ *
+ * Return the register number or memory offset of a variable in its
+ * owner's frame, allocating one the first time the variable is seen.
+ */
+
+int VirtualMachine::Slot(VMFunction *fn, VariableInformation *var)
+{
+    std::map<VariableInformation *, int>::iterator   i;
+    int                                              slot;
+
+    i = fn->slots.find(var);
+    if (i != fn->slots.end())
+        return i->second;
+
+    if (var->type == kIntegerType)
+        slot = fn->integerRegisters++;
+    else if (var->type == kRealType)
+        slot = fn->realRegisters++;
+    else if (var->type != NULL && var->type->elementType != NULL)
+    {
+        slot = fn->memoryWords;
+        fn->memoryWords += var->type->arrayDimensions;
+    }
+    else
+    {
+        std::cerr << "Bug: variable " << var->id << " has no type.\n";
+        abort();
+    }
+
+    fn->slots[var] = slot;
+    return slot;
+}
+
+VMInstruction& VirtualMachine::Emit(VMFunction *fn,
+                                    tVMOpcode op, int a, int b, int c)
+{
+    fn->code.push_back(VMInstruction(op, a, b, c));
+    return fn->code.back();
+}
+
+
+/*
+ * VirtualMachine::Use
+ * VirtualMachine::Def
+ * VirtualMachine::Commit
+ *
+ * Use returns the register holding the value of a scalar variable,
+ * fetching it into scratch register n first if the variable belongs
+ * to an enclosing function. Def returns the register an instruction
+ * should write a variable's new value to, and Commit writes it back
+ * to the enclosing function afterwards if necessary.
+ */
+
+int VirtualMachine::Use(VMFunction *fn, VariableInformation *var, int n)
+{
+    VMFunction  *owner;
+    int          depth, slot;
+
+    owner = Owner(fn, var, depth);
+    slot = Slot(owner, var);
+    if (depth == 0)
+        return slot;
+
+    Emit(fn, var->type == kRealType ? vm_rupload : vm_iupload,
+         slot, depth, n);
+    return n;
+}
+
+int VirtualMachine::Def(VMFunction *fn, VariableInformation *var)
+{
+    VMFunction  *owner;
+    int          depth, slot;
+
+    owner = Owner(fn, var, depth);
+    slot = Slot(owner, var);
+
+    return depth == 0 ? slot : SCRATCH_RESULT;
+}
+
+void VirtualMachine::Commit(VMFunction *fn, VariableInformation *var)
+{
+    VMFunction  *owner;
+    int          depth, slot;
+
+    owner = Owner(fn, var, depth);
+    slot = Slot(owner, var);
+    if (depth != 0)
+        Emit(fn, var->type == kRealType ? vm_rupstore : vm_iupstore,
+             SCRATCH_RESULT, depth, slot);
+}
+
+/*
+ * VirtualMachine::Address
+ *
+ * Load the address of an array variable into integer register n.
+ */
+
+int VirtualMachine::Address(VMFunction *fn, VariableInformation *var, int n)
+{
+    VMFunction  *owner;
+    int          depth, slot;
+
+    owner = Owner(fn, var, depth);
+    slot = Slot(owner, var);
+
+    if (depth == 0)
+        Emit(fn, vm_iaddr, slot, 0, n);
+    else
+        Emit(fn, vm_iaddrup, slot, depth, n);
+
+    return n;
+}
+
+
+/*
+ * VirtualMachine::Lower
+ *
+ * Translate a function's quads to VM instructions. Labels are
+ * recorded as they are seen and jump targets are patched once the
+ * whole function has been translated.
+ */
+
+static tVMOpcode LowerOpcode(tQuadType op)
+{
+    switch (op)
+    {
+    case itor:   return vm_itor;
+    case rtrunc: return vm_rtrunc;
+    case iadd:   return vm_iadd;
+    case isub:   return vm_isub;
+    case imul:   return vm_imul;
+    case idiv:   return vm_idiv;
+    case ipow:   return vm_ipow;
+    case radd:   return vm_radd;
+    case rsub:   return vm_rsub;
+    case rmul:   return vm_rmul;
+    case rdiv:   return vm_rdiv;
+    case rpow:   return vm_rpow;
+    case ineg:   return vm_ineg;
+    case rneg:   return vm_rneg;
+    case ishl:   return vm_ishl;
+    case isar:   return vm_isar;
+    case ishr:   return vm_ishr;
+    case imulh:  return vm_imulh;
+    case igt:    return vm_igt;
+    case ilt:    return vm_ilt;
+    case ieq:    return vm_ieq;
+    case ile:    return vm_ile;
+    case ige:    return vm_ige;
+    case ine:    return vm_ine;
+    case rgt:    return vm_rgt;
+    case rlt:    return vm_rlt;
+    case req:    return vm_req;
+    case rle:    return vm_rle;
+    case rge:    return vm_rge;
+    case rne:    return vm_rne;
+    case iand:   return vm_iand;
+    case ior:    return vm_ior;
+    case inot:   return vm_inot;
+    case iload:  return vm_iload;
+    case rload:  return vm_rload;
+    case iassign: return vm_imove;
+    case rassign: return vm_rmove;
+    default:     return vm_hcf;
+    }
+}
+
+void VirtualMachine::Lower(VMFunction *fn)
+{
+    std::map<long, int>                 labels;
+    std::vector<std::pair<int, long> >  fixups;
+    VariableInformation                *a, *b, *c;
+    VariableInformation                *formal;
+    std::vector<VariableInformation *>  params;
+    VMParameter                         binding;
+    VMFunction                         *callee;
+    Quad                               *quad;
+    int                                 i;
+
+    //
+    // Parameters get their slots first. They are linked backwards
+    // from the last one, but arguments are pushed first to last.
+    //
+
+    for (formal = fn->info->GetLastParam(); formal; formal = formal->prev)
+        params.insert(params.begin(), formal);
+    for (i = 0; i < (int)params.size(); i++)
+    {
+        binding.type = params[i]->type;
+        binding.slot = Slot(fn, params[i]);
+        binding.words = params[i]->type->elementType
+            ? params[i]->type->arrayDimensions : 1;
+        fn->parameters.push_back(binding);
+    }
+
+    if (fn->info->GetQuads() != NULL)
+    {
+        QuadsListIterator       iter(fn->info->GetQuads());
+
+        while ((quad = iter.Next()) != NULL)
+        {
+            a = quad->sym1 ? quad->sym1->SymbolAsVariable() : NULL;
+            b = quad->sym2 ? quad->sym2->SymbolAsVariable() : NULL;
+            c = quad->sym3 ? quad->sym3->SymbolAsVariable() : NULL;
+
+            switch (quad->opcode)
+            {
+            case iconst:
+                Emit(fn, vm_iconst, 0, 0, Def(fn, c)).imm.i = quad->int1;
+                Commit(fn, c);
+                break;
+
+            case rconst:
+                Emit(fn, vm_rconst, 0, 0, Def(fn, c)).imm.r = quad->real1;
+                Commit(fn, c);
+                break;
+
+            case iaddr:
+                if (Def(fn, c) == SCRATCH_RESULT)
+                {
+                    Address(fn, a, SCRATCH_RESULT);
+                    Commit(fn, c);
+                }
+                else
+                    Address(fn, a, Def(fn, c));
+                break;
+
+            case itor:
+            case rtrunc:
+            case ineg:
+            case rneg:
+            case inot:
+            case iload:
+            case rload:
+            case iassign:
+            case rassign:
+                Emit(fn, LowerOpcode(quad->opcode),
+                     Use(fn, a, 0), 0, Def(fn, c));
+                Commit(fn, c);
+                break;
+
+            case ishl: case isar: case ishr: case imulh:
+                Emit(fn, LowerOpcode(quad->opcode),
+                     Use(fn, a, 0), 0, Def(fn, c)).imm.i = quad->int2;
+                Commit(fn, c);
+                break;
+
+            case iadd: case isub: case imul: case idiv: case ipow:
+            case radd: case rsub: case rmul: case rdiv: case rpow:
+            case igt:  case ilt:  case ieq:
+            case ile:  case ige:  case ine:
+            case rgt:  case rlt:  case req:
+            case rle:  case rge:  case rne:
+            case iand: case ior:
+                Emit(fn, LowerOpcode(quad->opcode),
+                     Use(fn, a, 0), Use(fn, b, 1), Def(fn, c));
+                Commit(fn, c);
+                break;
+
+            case jtrue:
+            case jfalse:
+                fixups.push_back(std::make_pair((int)fn->code.size(),
+                                                quad->int1));
+                Emit(fn, quad->opcode == jtrue ? vm_jtrue : vm_jfalse,
+                     Use(fn, b, 0), 0, 0);
+                break;
+
+            case jump:
+                fixups.push_back(std::make_pair((int)fn->code.size(),
+                                                quad->int1));
+                Emit(fn, vm_jump, 0, 0, 0);
+                break;
+
+            case clabel:
+                labels[quad->int1] = fn->code.size();
+                break;
+
+            case istore:
+            case rstore:
+                Emit(fn, quad->opcode == istore ? vm_istore : vm_rstore,
+                     Use(fn, a, 0), 0, Use(fn, c, 1));
+                break;
+
+            case creturn:
+                if (c->type == kIntegerType)
+                    Emit(fn, vm_ireturn, Use(fn, c, 0), 0, 0);
+                else if (c->type == kRealType)
+                    Emit(fn, vm_rreturn, Use(fn, c, 0), 0, 0);
+                else
+                    Emit(fn, vm_areturn,
+                         Address(fn, c, 0), c->type->arrayDimensions, 0);
+                break;
+
+            case param:
+                if (a->type == kIntegerType)
+                    Emit(fn, vm_iparam, Use(fn, a, 0), 0, 0);
+                else if (a->type == kRealType)
+                    Emit(fn, vm_rparam, Use(fn, a, 0), 0, 0);
+                else
+                    Emit(fn, vm_aparam,
+                         Address(fn, a, 0), a->type->arrayDimensions, 0);
+                break;
+
+            case call:
+                callee = Function(quad->sym1->SymbolAsFunction());
+                if (callee->builtin != vm_last)
+                {
+                    Emit(fn, callee->builtin, 0, 0, Def(fn, c));
+                    Commit(fn, c);
+                }
+                else if (c->type->elementType != NULL)
+                {
+                    Emit(fn, vm_call, 0, 0, Slot(fn, c)).imm.f = callee;
+                }
+                else
+                {
+                    Emit(fn, vm_call, 0, 0, Def(fn, c)).imm.f = callee;
+                    Commit(fn, c);
+                }
+                break;
+
+            case aassign:
+                Emit(fn, vm_acopy,
+                     Address(fn, a, 0), quad->int2, Address(fn, c, 1));
+                break;
+
+            case nop:
+                break;
+
+            case hcf:
+            default:
+                Emit(fn, vm_hcf, 0, 0, 0);
+                break;
+            }
+        }
+    }
+
+    Emit(fn, vm_return, 0, 0, 0);
+
+    for (i = 0; i < (int)fixups.size(); i++)
+    {
+        if (labels.count(fixups[i].second) == 0)
+        {
+            std::cerr << "Bug: jump to undefined label "
+                      << fixups[i].second << ".\n";
+            abort();
+        }
+        fn->code[fixups[i].first].b = labels[fixups[i].second];
+    }
+}
+
+
+/*
+ * VirtualMachine::Run
+ *
+ * Lower the program and every function reachable from it, then
+ * execute it. Returns whatever the main program returns.
+ */
+
+long VirtualMachine::Run(FunctionInformation *program)
+{
+    VMFunction  *main;
+    struct rlimit limit;
+    char         here;
+
+    //
+    // Native code runs on the machine stack, so leave a megabyte of
+    // it for the C++ code underneath when deciding how deep native
+    // calls can go.
+    //
+
+    if (getrlimit(RLIMIT_STACK, &limit) != 0 ||
+        limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > (256UL << 20))
+        limit.rlim_cur = 8UL << 20;
+    stackLimit = &here - (limit.rlim_cur - (1UL << 20));
+
+    main = Function(program);
+    while (!pending.empty())
+    {
+        VMFunction *fn = pending.back();
+        pending.pop_back();
+        Lower(fn);
+        if (superinstructions)
+            Fuse(fn);
+    }
+
+    return Execute(main);
+}
+
+
+/*
+ * Superinstructions
+ *
+ * Fuse looks for pairs of adjacent instructions where the first one
+ * computes a temporary that only the second one reads, and replaces
+ * them with a single superinstruction. Fused instructions can be
+ * fused again, so iconst, ilt, jfalse becomes jge_ic in two steps.
+ * The second instruction of a pair must not be a jump target.
+ */
+
+static int *JumpTarget(VMInstruction& i)
+{
+    switch (i.opcode)
+    {
+    case vm_jtrue:
+    case vm_jfalse:
+    case vm_jump:
+        return &i.b;
+    case vm_jlt_ii: case vm_jge_ii: case vm_jgt_ii:
+    case vm_jle_ii: case vm_jeq_ii: case vm_jne_ii:
+    case vm_jlt_rr: case vm_jge_rr: case vm_jgt_rr:
+    case vm_jle_rr: case vm_jeq_rr: case vm_jne_rr:
+    case vm_jlt_ic: case vm_jge_ic: case vm_jgt_ic:
+    case vm_jle_ic: case vm_jeq_ic: case vm_jne_ic:
+        return &i.c;
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Count how many times each register is read by instructions that
+ * Lower produces. Superinstructions only ever replace these.
+ */
+
+static void CountReads(const VMInstruction& i,
+                       std::vector<int>& ireads,
+                       std::vector<int>& rreads)
+{
+    switch (i.opcode)
+    {
+    case vm_iadd: case vm_isub: case vm_imul: case vm_idiv: case vm_ipow:
+    case vm_igt:  case vm_ilt:  case vm_ieq:
+    case vm_ile:  case vm_ige:  case vm_ine:
+    case vm_iand: case vm_ior:
+        ireads[i.a] += 1;
+        ireads[i.b] += 1;
+        break;
+    case vm_radd: case vm_rsub: case vm_rmul: case vm_rdiv: case vm_rpow:
+    case vm_rgt:  case vm_rlt:  case vm_req:
+    case vm_rle:  case vm_rge:  case vm_rne:
+        rreads[i.a] += 1;
+        rreads[i.b] += 1;
+        break;
+    case vm_itor:  case vm_ineg: case vm_inot: case vm_jtrue: case vm_jfalse:
+    case vm_ishl:  case vm_isar: case vm_ishr: case vm_imulh:
+    case vm_iload: case vm_rload: case vm_ireturn: case vm_areturn:
+    case vm_iparam: case vm_aparam: case vm_imove: case vm_iupstore:
+        ireads[i.a] += 1;
+        break;
+    case vm_rtrunc: case vm_rneg: case vm_rreturn: case vm_rparam: case vm_rmove:
+    case vm_rupstore:
+        rreads[i.a] += 1;
+        break;
+    case vm_istore:
+    case vm_acopy:
+        ireads[i.a] += 1;
+        ireads[i.c] += 1;
+        break;
+    case vm_rstore:
+        rreads[i.a] += 1;
+        ireads[i.c] += 1;
+        break;
+    default:
+        break;
+    }
+}
+
+static bool FusePair(const VMInstruction& x,
+                     const VMInstruction& y,
+                     VMInstruction& fused,
+                     const std::vector<int>& ireads)
+{
+    int      t = x.c;
+    bool     dead;
+
+    // Only instructions with an integer result get fused with the
+    // next one; c of anything else needn't be an integer register.
+    dead = t >= 0 && t < (int)ireads.size() && ireads[t] == 1;
+
+    fused = y;
+    switch (x.opcode)
+    {
+    case vm_iconst:
+        if (!dead)
+            return false;
+        if (y.b == t && y.a != t)
+            fused.a = y.a;
+        else if (y.a == t && y.b != t &&
+                 (y.opcode == vm_iadd || y.opcode == vm_imul))
+            fused.a = y.b;
+        else
+            return false;
+
+        switch (y.opcode)
+        {
+        case vm_iadd: fused.opcode = vm_iadd_ic; break;
+        case vm_isub: fused.opcode = vm_isub_ic; break;
+        case vm_imul: fused.opcode = vm_imul_ic; break;
+        case vm_ilt:  fused.opcode = vm_ilt_ic;  break;
+        case vm_igt:  fused.opcode = vm_igt_ic;  break;
+        case vm_ieq:  fused.opcode = vm_ieq_ic;  break;
+        case vm_ile:  fused.opcode = vm_ile_ic;  break;
+        case vm_ige:  fused.opcode = vm_ige_ic;  break;
+        case vm_ine:  fused.opcode = vm_ine_ic;  break;
+        default:      return false;
+        }
+        fused.b = 0;
+        fused.imm.i = x.imm.i;
+        return true;
+
+    case vm_ilt: case vm_igt: case vm_ieq:
+    case vm_ile: case vm_ige: case vm_ine:
+    case vm_rlt: case vm_rgt: case vm_req: case vm_rne:
+    case vm_ilt_ic: case vm_igt_ic: case vm_ieq_ic:
+    case vm_ile_ic: case vm_ige_ic: case vm_ine_ic:
+        if (!dead || (y.opcode != vm_jtrue && y.opcode != vm_jfalse) ||
+            y.a != t)
+            return false;
+
+        fused = x;
+        fused.c = y.b;
+        switch (x.opcode)
+        {
+        case vm_ilt: fused.opcode = y.opcode == vm_jtrue ? vm_jlt_ii : vm_jge_ii; break;
+        case vm_igt: fused.opcode = y.opcode == vm_jtrue ? vm_jgt_ii : vm_jle_ii; break;
+        case vm_ieq: fused.opcode = y.opcode == vm_jtrue ? vm_jeq_ii : vm_jne_ii; break;
+        case vm_ile: fused.opcode = y.opcode == vm_jtrue ? vm_jle_ii : vm_jgt_ii; break;
+        case vm_ige: fused.opcode = y.opcode == vm_jtrue ? vm_jge_ii : vm_jlt_ii; break;
+        case vm_ine: fused.opcode = y.opcode == vm_jtrue ? vm_jne_ii : vm_jeq_ii; break;
+        case vm_rlt: fused.opcode = y.opcode == vm_jtrue ? vm_jlt_rr : vm_jge_rr; break;
+        case vm_rgt: fused.opcode = y.opcode == vm_jtrue ? vm_jgt_rr : vm_jle_rr; break;
+        case vm_req: fused.opcode = y.opcode == vm_jtrue ? vm_jeq_rr : vm_jne_rr; break;
+        case vm_rne: fused.opcode = y.opcode == vm_jtrue ? vm_jne_rr : vm_jeq_rr; break;
+        case vm_ilt_ic: fused.opcode = y.opcode == vm_jtrue ? vm_jlt_ic : vm_jge_ic; break;
+        case vm_igt_ic: fused.opcode = y.opcode == vm_jtrue ? vm_jgt_ic : vm_jle_ic; break;
+        case vm_ieq_ic: fused.opcode = y.opcode == vm_jtrue ? vm_jeq_ic : vm_jne_ic; break;
+        case vm_ile_ic: fused.opcode = y.opcode == vm_jtrue ? vm_jle_ic : vm_jgt_ic; break;
+        case vm_ige_ic: fused.opcode = y.opcode == vm_jtrue ? vm_jge_ic : vm_jlt_ic; break;
+        case vm_ine_ic: fused.opcode = y.opcode == vm_jtrue ? vm_jne_ic : vm_jeq_ic; break;
+        default: return false;
+        }
+        return true;
+
+    case vm_iaddr:
+        if (!dead || y.opcode != vm_iadd)
+            return false;
+        if (y.a == t && y.b != t)
+            fused.b = y.b;
+        else if (y.b == t && y.a != t)
+            fused.b = y.a;
+        else
+            return false;
+        fused.opcode = vm_iaddr_ix;
+        fused.a = x.a;
+        return true;
+
+    case vm_iaddr_ix:
+        if (!dead)
+            return false;
+        if ((y.opcode == vm_iload || y.opcode == vm_rload) && y.a == t)
+        {
+            fused.opcode = y.opcode == vm_iload ? vm_iload_ix : vm_rload_ix;
+            fused.a = x.a;
+            fused.b = x.b;
+            return true;
+        }
+        if (y.opcode == vm_istore && y.c == t && y.a != t)
+        {
+            fused.opcode = vm_istore_ix;
+            fused.b = x.b;
+            fused.c = x.a;
+            return true;
+        }
+        if (y.opcode == vm_rstore && y.c == t)
+        {
+            fused.opcode = vm_rstore_ix;
+            fused.b = x.b;
+            fused.c = x.a;
+            return true;
+        }
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+void VirtualMachine::Fuse(VMFunction *fn)
+{
+    std::vector<int>            ireads(fn->integerRegisters);
+    std::vector<int>            rreads(fn->realRegisters);
+    std::vector<bool>           target;
+    std::vector<int>            moved;
+    std::vector<VMInstruction>  fused;
+    VariableInformation        *var;
+    VMInstruction               unit(vm_hcf, 0, 0, 0);
+    bool                        changed;
+    int                         i, n, *t;
+
+    for (i = 0; i < (int)fn->code.size(); i++)
+        CountReads(fn->code[i], ireads, rreads);
+
+    //
+    // Named variables can be read by nested functions through their
+    // static links, so they never count as dead.
+    //
+
+    for (var = fn->info->GetLastParam(); var; var = var->prev)
+        if (var->type == kIntegerType && fn->slots.count(var))
+            ireads[fn->slots[var]] += 2;
+    for (var = fn->info->GetLastLocal(); var; var = var->prev)
+        if (var->type == kIntegerType && fn->slots.count(var))
+            ireads[fn->slots[var]] += 2;
+
+    do
+    {
+        changed = false;
+        n = fn->code.size();
+        target.assign(n + 1, false);
+        moved.assign(n + 1, 0);
+        fused.clear();
+
+        for (i = 0; i < n; i++)
+            if ((t = JumpTarget(fn->code[i])) != NULL)
+                target[*t] = true;
+
+        for (i = 0; i < n; i++)
+        {
+            moved[i] = fused.size();
+            if (i + 1 < n && !target[i + 1] &&
+                FusePair(fn->code[i], fn->code[i + 1], unit, ireads))
+            {
+                moved[i + 1] = fused.size();
+                fused.push_back(unit);
+                changed = true;
+                i += 1;
+            }
+            else
+            {
+                fused.push_back(fn->code[i]);
+            }
+        }
+        moved[n] = fused.size();
+
+        for (i = 0; i < (int)fused.size(); i++)
+            if ((t = JumpTarget(fused[i])) != NULL)
+                *t = moved[*t];
+
+        fn->code.swap(fused);
+    } while (changed);
+}
+
+
+/*
+ * VirtualMachine::Report
+ *
+ * Print how many times each instruction was dispatched. For
+ * superinstructions, also print how many dispatches they saved
+ * compared to running the unfused instructions.
+ */
+
+static const char *opcodeNames[vm_last] =
+{
+    "iconst", "rconst", "iaddr", "iaddrup", "itor", "rtrunc",
+    "iadd", "isub", "imul", "idiv", "ipow",
+    "radd", "rsub", "rmul", "rdiv", "rpow",
+    "ineg", "rneg",
+    "ishl", "isar", "ishr", "imulh",
+    "igt", "ilt", "ieq", "ile", "ige", "ine",
+    "rgt", "rlt", "req", "rle", "rge", "rne",
+    "iand", "ior", "inot",
+    "jtrue", "jfalse", "jump",
+    "istore", "iload", "rstore", "rload",
+    "iupload", "iupstore", "rupload", "rupstore",
+    "ireturn", "rreturn", "areturn", "return",
+    "iparam", "rparam", "aparam", "call",
+    "putint", "putreal", "getint", "getreal",
+    "imove", "rmove", "acopy",
+    "iadd_ic", "isub_ic", "imul_ic", "ilt_ic", "igt_ic", "ieq_ic",
+    "ile_ic", "ige_ic", "ine_ic",
+    "jlt_ii", "jge_ii", "jgt_ii", "jle_ii", "jeq_ii", "jne_ii",
+    "jlt_rr", "jge_rr", "jgt_rr", "jle_rr", "jeq_rr", "jne_rr",
+    "jlt_ic", "jge_ic", "jgt_ic", "jle_ic", "jeq_ic", "jne_ic",
+    "iaddr_ix", "iload_ix", "rload_ix", "istore_ix", "rstore_ix",
+    "hcf"
+};
+
+static int FusedLength(int op)
+{
+    if (op >= vm_jlt_ic && op <= vm_jne_ic)
+        return 3;
+    if (op >= vm_iload_ix && op <= vm_rstore_ix)
+        return 3;
+    if (op >= vm_iadd_ic && op <= vm_iaddr_ix)
+        return 2;
+    return 1;
+}
+
+void VirtualMachine::Report(std::ostream& o)
+{
+    unsigned long   total, saved;
+    int             op;
+
+    total = saved = 0;
+    o << "Dispatch report\n";
+    o << std::setw(12) << "instruction"
+      << std::setw(14) << "dispatches"
+      << std::setw(14) << "saved" << '\n';
+
+    for (op = 0; op < vm_last; op++)
+    {
+        if (dispatches[op] == 0)
+            continue;
+
+        total += dispatches[op];
+        saved += dispatches[op] * (FusedLength(op) - 1);
+        o << std::setw(12) << opcodeNames[op]
+          << std::setw(14) << dispatches[op];
+        if (FusedLength(op) > 1)
+            o << std::setw(14) << dispatches[op] * (FusedLength(op) - 1);
+        o << '\n';
+    }
+
+    o << "Total dispatches:          " << total << '\n';
+    o << "Without superinstructions: " << total + saved << '\n';
+    if (total + saved > 0)
+        o << "Saved by fusion:           " << saved << " ("
+          << (100.0 * saved) / (total + saved) << "%)\n";
+
+    if (jit != NULL)
+        jit->Report(o);
+}
+
+
+/*
+ * VirtualMachine::Push
+ *
+ * Set up a frame for the function called by pc above fp, find its
+ * static link by walking outwards from the caller, and bind the
+ * arguments on top of the argument stack. The memory and argument
+ * stack tops are taken from, and updated in, state.
+ */
+
+VMFrame *VirtualMachine::Push(VMFrame *fp, const VMInstruction *pc)
+{
+    VMFunction     *callee = pc->imm.f;
+    VMFrame        *up;
+    long           *ir;
+    double         *rr;
+    int             i;
+
+    ir = fp->integerRegisters + fp->function->integerRegisters;
+    rr = fp->realRegisters + fp->function->realRegisters;
+    if (fp + 1 >= frames + stackSize / 16 ||
+        ir + callee->integerRegisters >= integerStack + stackSize ||
+        rr + callee->realRegisters >= realStack + stackSize ||
+        state.memoryTop + callee->memoryWords >= stackSize)
+        RuntimeError("stack overflow");
+
+    for (up = fp; up && up->function != callee->parent; up = up->staticLink)
+        ;
+
+    fp += 1;
+    fp->function = callee;
+    fp->staticLink = up;
+    fp->returnAddress = pc;
+    fp->integerRegisters = ir;
+    fp->realRegisters = rr;
+    fp->memoryBase = state.memoryTop;
+    fp->result = pc->c;
+
+    memset(ir, 0, sizeof(long) * callee->integerRegisters);
+    memset(rr, 0, sizeof(double) * callee->realRegisters);
+    memset(&memory[state.memoryTop], 0,
+           sizeof(VMWord) * callee->memoryWords);
+    state.memoryTop += callee->memoryWords;
+
+    state.arguments -= callee->parameters.size();
+    for (i = 0; i < (int)callee->parameters.size(); i++)
+    {
+        const VMParameter& p = callee->parameters[i];
+
+        if (p.type == kIntegerType)
+            ir[p.slot] = state.arguments[i].i;
+        else if (p.type == kRealType)
+            rr[p.slot] = state.arguments[i].r;
+        else
+            memmove(&memory[fp->memoryBase + p.slot],
+                    &memory[state.arguments[i].i], sizeof(VMWord) * p.words);
+    }
+
+    return fp;
+}
+
+
+/*
+ * VirtualMachine::NativeFrame
+ *
+ * Push the frame for a call from native code, after checking that
+ * the machine stack has room for another native function.
+ */
+
+VMFrame *VirtualMachine::NativeFrame(VirtualMachine *vm,
+                                     VMFrame *fp, const VMInstruction *pc)
+{
+    VMFrame            *frame;
+
+    if ((char *)&frame < vm->stackLimit)
+        RuntimeError("stack overflow");
+
+    return vm->Push(fp, pc);
+}
+
+
+/*
+ * VirtualMachine::NativeCall
+ *
+ * Call a compiled function. This is used by the interpreter, and by
+ * native code for calls to functions that return arrays. Native
+ * code returns integers and array addresses in rax and reals in
+ * xmm0; a function returning an array that falls off its end returns
+ * -1 so that the caller's array is left alone.
+ */
+
+void VirtualMachine::NativeCall(VirtualMachine *vm,
+                                VMFrame *fp, const VMInstruction *pc)
+{
+    typedef long   (*IntegerEntry)(VirtualMachine *, VMFrame *, VMState *);
+    typedef double (*RealEntry)(VirtualMachine *, VMFrame *, VMState *);
+
+    VMFunction         *callee = pc->imm.f;
+    TypeInformation    *type = callee->info->GetReturnType();
+    VMFrame            *frame;
+    long                value;
+
+    frame = NativeFrame(vm, fp, pc);
+    if (type == kRealType)
+    {
+        fp->realRegisters[pc->c] =
+            ((RealEntry)callee->native)(vm, frame, &vm->state);
+    }
+    else
+    {
+        value = ((IntegerEntry)callee->native)(vm, frame, &vm->state);
+        if (type == kIntegerType)
+            fp->integerRegisters[pc->c] = value;
+        else if (value >= 0)
+            memmove(&vm->memory[fp->memoryBase + pc->c], &vm->memory[value],
+                    sizeof(VMWord) * type->arrayDimensions);
+    }
+    vm->state.memoryTop = frame->memoryBase;
+}
+
+
+/*
+ * VirtualMachine::Execute
+ *
+ * The dispatch loop. This uses GCC's labels-as-values extension:
+ * before running, every instruction gets the address of its handler
+ * and each handler ends by jumping straight to the next one.
+ */
+
+#define DISPATCH()  goto *pc->handler
+#define NEXT()      do { pc += 1; goto *pc->handler; } while (0)
+
+long VirtualMachine::Execute(VMFunction *main)
+{
+    static const void *handlers[vm_last] =
+    {
+        &&do_iconst, &&do_rconst, &&do_iaddr, &&do_iaddrup,
+        &&do_itor, &&do_rtrunc,
+        &&do_iadd, &&do_isub, &&do_imul, &&do_idiv, &&do_ipow,
+        &&do_radd, &&do_rsub, &&do_rmul, &&do_rdiv, &&do_rpow,
+        &&do_ineg, &&do_rneg,
+        &&do_ishl, &&do_isar, &&do_ishr, &&do_imulh,
+        &&do_igt, &&do_ilt, &&do_ieq, &&do_ile, &&do_ige, &&do_ine,
+        &&do_rgt, &&do_rlt, &&do_req, &&do_rle, &&do_rge, &&do_rne,
+        &&do_iand, &&do_ior, &&do_inot,
+        &&do_jtrue, &&do_jfalse, &&do_jump,
+        &&do_istore, &&do_iload, &&do_rstore, &&do_rload,
+        &&do_iupload, &&do_iupstore, &&do_rupload, &&do_rupstore,
+        &&do_ireturn, &&do_rreturn, &&do_areturn, &&do_return,
+        &&do_iparam, &&do_rparam, &&do_aparam, &&do_call,
+        &&do_putint, &&do_putreal, &&do_getint, &&do_getreal,
+        &&do_imove, &&do_rmove, &&do_acopy,
+        &&do_iadd_ic, &&do_isub_ic, &&do_imul_ic,
+        &&do_ilt_ic, &&do_igt_ic, &&do_ieq_ic,
+        &&do_ile_ic, &&do_ige_ic, &&do_ine_ic,
+        &&do_jlt_ii, &&do_jge_ii, &&do_jgt_ii,
+        &&do_jle_ii, &&do_jeq_ii, &&do_jne_ii,
+        &&do_jlt_rr, &&do_jge_rr, &&do_jgt_rr,
+        &&do_jle_rr, &&do_jeq_rr, &&do_jne_rr,
+        &&do_jlt_ic, &&do_jge_ic, &&do_jgt_ic,
+        &&do_jle_ic, &&do_jeq_ic, &&do_jne_ic,
+        &&do_iaddr_ix, &&do_iload_ix, &&do_rload_ix,
+        &&do_istore_ix, &&do_rstore_ix,
+        &&do_hcf
+    };
+
+    std::map<FunctionInformation *, VMFunction *>::iterator  f;
+    const VMInstruction    *pc;
+    VMFrame                *fp, *up;
+    VMFunction             *callee;
+    long                   *ir;
+    double                 *rr;
+    long                    address, n, memoryTop;
+    VMWord                 *ap;
+    VMWord                  value;
+    int                     i;
+
+    for (f = functions.begin(); f != functions.end(); ++f)
+        for (i = 0; i < (int)f->second->code.size(); i++)
+        {
+            VMInstruction& instruction = f->second->code[i];
+
+            instruction.handler =
+                profile ? &&do_profile : handlers[instruction.opcode];
+            if (instruction.opcode == vm_call)
+                instruction.imm.f->callers.push_back(&instruction);
+        }
+
+    ap = arguments;
+    fp = frames;
+    fp->function = main;
+    fp->staticLink = NULL;
+    fp->returnAddress = NULL;
+    fp->integerRegisters = integerStack;
+    fp->realRegisters = realStack;
+    fp->memoryBase = 0;
+    fp->result = 0;
+    if (main->integerRegisters >= stackSize ||
+        main->realRegisters >= stackSize ||
+        main->memoryWords >= stackSize)
+        RuntimeError("stack overflow");
+    memoryTop = main->memoryWords;
+    memset(integerStack, 0, sizeof(long) * main->integerRegisters);
+    memset(realStack, 0, sizeof(double) * main->realRegisters);
+    memset(memory, 0, sizeof(VMWord) * main->memoryWords);
+
+    ir = fp->integerRegisters;
+    rr = fp->realRegisters;
+    pc = &main->code[0];
+    DISPATCH();
+
+do_iconst:  ir[pc->c] = pc->imm.i; NEXT();
+do_rconst:  rr[pc->c] = pc->imm.r; NEXT();
+do_iaddr:   ir[pc->c] = fp->memoryBase + pc->a; NEXT();
+do_iaddrup:
+    for (up = fp, n = pc->b; n > 0; n--) up = up->staticLink;
+    ir[pc->c] = up->memoryBase + pc->a;
+    NEXT();
+do_itor:    rr[pc->c] = (double)ir[pc->a]; NEXT();
+do_rtrunc:  ir[pc->c] = (long)rr[pc->a]; NEXT();
+
+do_iadd:    ir[pc->c] = WrapAdd(ir[pc->a], ir[pc->b]); NEXT();
+do_isub:    ir[pc->c] = WrapSub(ir[pc->a], ir[pc->b]); NEXT();
+do_imul:    ir[pc->c] = WrapMul(ir[pc->a], ir[pc->b]); NEXT();
+do_idiv:
+    if (ir[pc->b] == 0)
+        RuntimeError("integer division by zero");
+    if (ir[pc->b] == -1)
+        ir[pc->c] = WrapSub(0, ir[pc->a]);
+    else
+        ir[pc->c] = ir[pc->a] / ir[pc->b];
+    NEXT();
+do_ipow:    ir[pc->c] = IntegerPower(ir[pc->a], ir[pc->b]); NEXT();
+do_radd:    rr[pc->c] = rr[pc->a] + rr[pc->b]; NEXT();
+do_rsub:    rr[pc->c] = rr[pc->a] - rr[pc->b]; NEXT();
+do_rmul:    rr[pc->c] = rr[pc->a] * rr[pc->b]; NEXT();
+do_rdiv:    rr[pc->c] = rr[pc->a] / rr[pc->b]; NEXT();
+do_rpow:    rr[pc->c] = pow(rr[pc->a], rr[pc->b]); NEXT();
+do_ineg:    ir[pc->c] = WrapSub(0, ir[pc->a]); NEXT();
+do_rneg:    rr[pc->c] = -rr[pc->a]; NEXT();
+do_ishl:    ir[pc->c] = (unsigned long)ir[pc->a] << pc->imm.i; NEXT();
+do_isar:    ir[pc->c] = ir[pc->a] >> pc->imm.i; NEXT();
+do_ishr:    ir[pc->c] = (unsigned long)ir[pc->a] >> pc->imm.i; NEXT();
+do_imulh:
+    ir[pc->c] = ((__int128)ir[pc->a] * pc->imm.i) >> 64;
+    NEXT();
+
+do_igt:     ir[pc->c] = ir[pc->a] > ir[pc->b]; NEXT();
+do_ilt:     ir[pc->c] = ir[pc->a] < ir[pc->b]; NEXT();
+do_ieq:     ir[pc->c] = ir[pc->a] == ir[pc->b]; NEXT();
+do_ile:     ir[pc->c] = ir[pc->a] <= ir[pc->b]; NEXT();
+do_ige:     ir[pc->c] = ir[pc->a] >= ir[pc->b]; NEXT();
+do_ine:     ir[pc->c] = ir[pc->a] != ir[pc->b]; NEXT();
+do_rgt:     ir[pc->c] = rr[pc->a] > rr[pc->b]; NEXT();
+do_rlt:     ir[pc->c] = rr[pc->a] < rr[pc->b]; NEXT();
+do_req:     ir[pc->c] = rr[pc->a] == rr[pc->b]; NEXT();
+do_rle:     ir[pc->c] = rr[pc->a] <= rr[pc->b]; NEXT();
+do_rge:     ir[pc->c] = rr[pc->a] >= rr[pc->b]; NEXT();
+do_rne:     ir[pc->c] = rr[pc->a] != rr[pc->b]; NEXT();
+
+do_iand:    ir[pc->c] = ir[pc->a] && ir[pc->b]; NEXT();
+do_ior:     ir[pc->c] = ir[pc->a] || ir[pc->b]; NEXT();
+do_inot:    ir[pc->c] = !ir[pc->a]; NEXT();
+
+do_jtrue:
+    if (ir[pc->a])
+        pc = &fp->function->code[pc->b];
+    else
+        pc += 1;
+    DISPATCH();
+do_jfalse:
+    if (!ir[pc->a])
+        pc = &fp->function->code[pc->b];
+    else
+        pc += 1;
+    DISPATCH();
+do_jump:
+    pc = &fp->function->code[pc->b];
+    DISPATCH();
+
+do_istore:
+    address = ir[pc->c];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("store outside of memory");
+    memory[address].i = ir[pc->a];
+    NEXT();
+do_iload:
+    address = ir[pc->a];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("load outside of memory");
+    ir[pc->c] = memory[address].i;
+    NEXT();
+do_rstore:
+    address = ir[pc->c];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("store outside of memory");
+    memory[address].r = rr[pc->a];
+    NEXT();
+do_rload:
+    address = ir[pc->a];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("load outside of memory");
+    rr[pc->c] = memory[address].r;
+    NEXT();
+
+do_iupload:
+    for (up = fp, n = pc->b; n > 0; n--) up = up->staticLink;
+    ir[pc->c] = up->integerRegisters[pc->a];
+    NEXT();
+do_iupstore:
+    for (up = fp, n = pc->b; n > 0; n--) up = up->staticLink;
+    up->integerRegisters[pc->c] = ir[pc->a];
+    NEXT();
+do_rupload:
+    for (up = fp, n = pc->b; n > 0; n--) up = up->staticLink;
+    rr[pc->c] = up->realRegisters[pc->a];
+    NEXT();
+do_rupstore:
+    for (up = fp, n = pc->b; n > 0; n--) up = up->staticLink;
+    up->realRegisters[pc->c] = rr[pc->a];
+    NEXT();
+
+    //
+    // Returning pops the frame and stores the result in the register
+    // (or array memory) the caller asked for.
+    //
+
+do_ireturn:
+    value.i = ir[pc->a];
+    if (fp == frames)
+        return value.i;
+    fp -= 1;
+    fp->integerRegisters[(fp + 1)->result] = value.i;
+    goto do_pop;
+do_rreturn:
+    value.r = rr[pc->a];
+    if (fp == frames)
+        return (long)value.r;
+    fp -= 1;
+    fp->realRegisters[(fp + 1)->result] = value.r;
+    goto do_pop;
+do_areturn:
+    if (fp == frames)
+        return 0;
+    memmove(&memory[(fp - 1)->memoryBase + fp->result],
+            &memory[ir[pc->a]], sizeof(VMWord) * pc->b);
+    fp -= 1;
+    goto do_pop;
+do_return:
+    if (fp == frames)
+        return 0;
+    fp -= 1;
+    if ((fp + 1)->function->info->GetReturnType() == kRealType)
+        fp->realRegisters[(fp + 1)->result] = 0.0;
+    else if ((fp + 1)->function->info->GetReturnType() == kIntegerType)
+        fp->integerRegisters[(fp + 1)->result] = 0;
+do_pop:
+    memoryTop = (fp + 1)->memoryBase;
+    pc = (fp + 1)->returnAddress;
+    ir = fp->integerRegisters;
+    rr = fp->realRegisters;
+    NEXT();
+
+do_iparam:  (ap++)->i = ir[pc->a]; NEXT();
+do_rparam:  (ap++)->r = rr[pc->a]; NEXT();
+do_aparam:  (ap++)->i = ir[pc->a]; NEXT();
+
+    //
+    // Calling sets up a new frame above the current one. With the JIT
+    // on, a function that gets hot is compiled and every call to it
+    // is patched to go to do_native instead.
+    //
+
+do_call:
+    callee = pc->imm.f;
+    if (jit != NULL && callee->native == NULL &&
+        ++callee->calls >= JIT_THRESHOLD && jit->Compile(callee))
+    {
+        for (f = functions.begin(); f != functions.end(); ++f)
+            if (f->second->native != NULL)
+                for (i = 0; i < (int)f->second->callers.size(); i++)
+                    f->second->callers[i]->handler =
+                        profile ? &&do_profile : &&do_native;
+    }
+    if (callee->native != NULL)
+        goto do_native;
+
+    state.memoryTop = memoryTop;
+    state.arguments = ap;
+    fp = Push(fp, pc);
+    memoryTop = state.memoryTop;
+    ap = state.arguments;
+
+    ir = fp->integerRegisters;
+    rr = fp->realRegisters;
+    pc = &callee->code[0];
+    DISPATCH();
+
+do_native:
+    state.memoryTop = memoryTop;
+    state.arguments = ap;
+    NativeCall(this, fp, pc);
+    memoryTop = state.memoryTop;
+    ap = state.arguments;
+    NEXT();
+
+do_putint:
+    ap -= 1;
+    std::cout << ap->i << '\n';
+    ir[pc->c] = 0;
+    NEXT();
+do_putreal:
+    ap -= 1;
+    PutReal(ap->r);
+    ir[pc->c] = 0;
+    NEXT();
+do_getint:
+    if (!(std::cin >> ir[pc->c]))
+        ir[pc->c] = 0;
+    NEXT();
+do_getreal:
+    if (!(std::cin >> rr[pc->c]))
+        rr[pc->c] = 0.0;
+    NEXT();
+
+do_imove:   ir[pc->c] = ir[pc->a]; NEXT();
+do_rmove:   rr[pc->c] = rr[pc->a]; NEXT();
+do_acopy:
+    memmove(&memory[ir[pc->c]], &memory[ir[pc->a]], sizeof(VMWord) * pc->b);
+    NEXT();
+
+    //
+    // Superinstructions
+    //
+
+#define FUSED_BRANCH(cond) \
+    if (cond) pc = &fp->function->code[pc->c]; else pc += 1; DISPATCH()
+
+do_iadd_ic: ir[pc->c] = WrapAdd(ir[pc->a], pc->imm.i); NEXT();
+do_isub_ic: ir[pc->c] = WrapSub(ir[pc->a], pc->imm.i); NEXT();
+do_imul_ic: ir[pc->c] = WrapMul(ir[pc->a], pc->imm.i); NEXT();
+do_ilt_ic:  ir[pc->c] = ir[pc->a] < pc->imm.i; NEXT();
+do_igt_ic:  ir[pc->c] = ir[pc->a] > pc->imm.i; NEXT();
+do_ieq_ic:  ir[pc->c] = ir[pc->a] == pc->imm.i; NEXT();
+do_ile_ic:  ir[pc->c] = ir[pc->a] <= pc->imm.i; NEXT();
+do_ige_ic:  ir[pc->c] = ir[pc->a] >= pc->imm.i; NEXT();
+do_ine_ic:  ir[pc->c] = ir[pc->a] != pc->imm.i; NEXT();
+
+do_jlt_ii:  FUSED_BRANCH(ir[pc->a] < ir[pc->b]);
+do_jge_ii:  FUSED_BRANCH(ir[pc->a] >= ir[pc->b]);
+do_jgt_ii:  FUSED_BRANCH(ir[pc->a] > ir[pc->b]);
+do_jle_ii:  FUSED_BRANCH(ir[pc->a] <= ir[pc->b]);
+do_jeq_ii:  FUSED_BRANCH(ir[pc->a] == ir[pc->b]);
+do_jne_ii:  FUSED_BRANCH(ir[pc->a] != ir[pc->b]);
+do_jlt_rr:  FUSED_BRANCH(rr[pc->a] < rr[pc->b]);
+do_jge_rr:  FUSED_BRANCH(!(rr[pc->a] < rr[pc->b]));
+do_jgt_rr:  FUSED_BRANCH(rr[pc->a] > rr[pc->b]);
+do_jle_rr:  FUSED_BRANCH(!(rr[pc->a] > rr[pc->b]));
+do_jeq_rr:  FUSED_BRANCH(rr[pc->a] == rr[pc->b]);
+do_jne_rr:  FUSED_BRANCH(rr[pc->a] != rr[pc->b]);
+do_jlt_ic:  FUSED_BRANCH(ir[pc->a] < pc->imm.i);
+do_jge_ic:  FUSED_BRANCH(ir[pc->a] >= pc->imm.i);
+do_jgt_ic:  FUSED_BRANCH(ir[pc->a] > pc->imm.i);
+do_jle_ic:  FUSED_BRANCH(ir[pc->a] <= pc->imm.i);
+do_jeq_ic:  FUSED_BRANCH(ir[pc->a] == pc->imm.i);
+do_jne_ic:  FUSED_BRANCH(ir[pc->a] != pc->imm.i);
+
+do_iaddr_ix:
+    ir[pc->c] = fp->memoryBase + pc->a + ir[pc->b];
+    NEXT();
+do_iload_ix:
+    address = fp->memoryBase + pc->a + ir[pc->b];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("load outside of memory");
+    ir[pc->c] = memory[address].i;
+    NEXT();
+do_rload_ix:
+    address = fp->memoryBase + pc->a + ir[pc->b];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("load outside of memory");
+    rr[pc->c] = memory[address].r;
+    NEXT();
+do_istore_ix:
+    address = fp->memoryBase + pc->c + ir[pc->b];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("store outside of memory");
+    memory[address].i = ir[pc->a];
+    NEXT();
+do_rstore_ix:
+    address = fp->memoryBase + pc->c + ir[pc->b];
+    if (address < 0 || address >= memoryTop)
+        RuntimeError("store outside of memory");
+    memory[address].r = rr[pc->a];
+    NEXT();
+
+do_hcf:
+    RuntimeError("hcf instruction executed");
+    return 0;
+
+    //
+    // When counting dispatches, every instruction is threaded to
+    // this handler, which counts it and then runs the real one.
+    //
+
+do_profile:
+    dispatches[pc->opcode] += 1;
+    goto *handlers[pc->opcode];
+}